@@ -0,0 +1,37 @@
+# Helpers shared by the benchmark scripts, sourced by each of them
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# seconds <input> <command...>: print the best wall time in seconds of three
+# runs of the command reading input, its output discarded
+seconds()
+{
+    input=$1
+    shift
+    best=
+
+    for run in 1 2 3
+    do
+        start=$(date +%s%N)
+        "$@" < "$input" > /dev/null 2>&1
+        end=$(date +%s%N)
+
+        time=$(( (end - start) / 1000 ))
+        [ -z "$best" ] || [ $time -lt $best ] && best=$time
+    done
+
+    awk -v us=$best 'BEGIN { printf "%.3f", us / 1e6 }'
+}
+
+# rate <input> <command...>: print the throughput of the command in MB/s
+rate()
+{
+    input=$1
+    bytes=$(wc -c < "$input")
+    time=$(seconds "$@")
+
+    awk -v b=$bytes -v t=$time 'BEGIN { printf "%.1f MB/s (%.3f s)", b / t / 1e6, t }'
+}
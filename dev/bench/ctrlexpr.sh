@@ -0,0 +1,43 @@
+#!/bin/bash
+# ctrlexpr.sh [ctrlexpr...]: ctrlexpr throughput on two million generated
+# #if-style controlling expressions, mixing operators of every precedence
+# level, signed and unsigned literals, defined and ?:.  Give the binaries of
+# other builds to compare them.
+
+. "$(dirname "$0")/common.sh"
+
+awk 'BEGIN {
+    srand(1)
+    split("+ - * / % << >> < > <= >= == != & ^ | && || bitand bitor xor", ops, " ")
+    split("0 1 2 7 63 64 0x7fffffff 0xffffffffffffffff 017 1u 2U 1ull 10LL", lits, " ")
+    split("- + ! ~", unary, " ")
+    split("A B C X Y foo bar", ids, " ")
+
+    for (i = 0; i < 2000000; i++)
+        print expr(int(rand() * 5))
+}
+
+function pick(a, n) { return a[1 + int(rand() * n)] }
+
+function primary(r) {
+    r = rand()
+    if (r < 0.5) return pick(lits, 13)
+    if (r < 0.7) return int(rand() * 100000)
+    if (r < 0.85) return pick(ids, 7)
+    return "defined(" pick(ids, 7) ")"
+}
+
+function expr(d, r) {
+    if (d <= 0) return primary()
+    r = rand()
+    if (r < 0.5) return expr(d - 1) " " pick(ops, 21) " " expr(d - 1)
+    if (r < 0.65) return pick(unary, 4) " " expr(d - 1)
+    if (r < 0.8) return "(" expr(d - 1) ")"
+    if (r < 0.9) return expr(d - 1) " ? " expr(d - 1) " : " expr(d - 1)
+    return primary()
+}' > "$work/ctrlexpr.t"
+
+for ctrlexpr in "${@:-./ctrlexpr}"
+do
+    echo "$ctrlexpr: $(rate "$work/ctrlexpr.t" "$ctrlexpr")"
+done
@@ -0,0 +1,23 @@
+#!/bin/bash
+# hexdump.sh [posttoken...]: posttoken throughput on a few multi-megabyte
+# string literals, where dumping their bytes in hex dominates.  Give the
+# binaries of other builds to compare them.
+
+. "$(dirname "$0")/common.sh"
+
+line=$(printf 'abcdefghijklmnopqrstuvwxyz0123456789 %.0s' $(seq 100))
+
+for prefix in '' u8 u U L
+do
+    printf '%s"' "$prefix"
+    for i in $(seq 1000)
+    do
+        printf '%s' "$line"
+    done
+    printf '";\n'
+done > "$work/hexdump.t"
+
+for posttoken in "${@:-./posttoken}"
+do
+    echo "$posttoken: $(rate "$work/hexdump.t" "$posttoken")"
+done
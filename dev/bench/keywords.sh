@@ -0,0 +1,18 @@
+#!/bin/bash
+# keywords.sh [posttoken...]: posttoken throughput on keyword and operator
+# dense code, where looking up simple tokens dominates.  Give the binaries
+# of other builds to compare them.
+
+. "$(dirname "$0")/common.sh"
+
+for i in $(seq 40000)
+do
+    echo "static const unsigned int x$i = sizeof(long) * 2 + (a <= b ? c : d);"
+    echo "if (flag && !done) { return this->value; } else while (true) { break; }"
+    echo "template <typename T> class C : public virtual B { void f() const noexcept override; };"
+done > "$work/keywords.t"
+
+for posttoken in "${@:-./posttoken}"
+do
+    echo "$posttoken: $(rate "$work/keywords.t" "$posttoken")"
+done
@@ -0,0 +1,178 @@
+// MacroTable lookups timed against unordered_set and set, for defined and
+// undefined names and tables of different sizes, and defined through
+// CtrlExpr against a table of 20000 macros
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "pp.h"
+#include "macrotable.h"
+#include "exparse.h"
+
+using namespace std;
+
+static const size_t Queries = 4000000;
+
+// Names shaped like those of real configuration macros, unique by i
+static vector<string> Names(mt19937& rng, size_t count, const char* prefix)
+{
+    static const char* const Families[] = {
+        "__", "HAVE_", "CONFIG_", "_POSIX_", "USE_", "ENABLE_", "BOOST_", "Q_"
+    };
+
+    vector<string> names;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ostringstream name;
+
+        name << prefix << Families[rng() % 8] << "NAME_" << rng() % 100000
+            << "_" << i;
+        names.push_back(name.str());
+    }
+
+    return names;
+}
+
+// Nanoseconds per query of a loop over queries
+template <typename Lookup>
+static double Time(const vector<const string*>& queries, Lookup lookup)
+{
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+
+    for (const string* name : queries)
+        found += lookup(*name);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // Keep the loop from being optimized away
+    if (found > queries.size())
+        cerr << found;
+
+    return elapsed.count() * 1e9 / queries.size();
+}
+
+static vector<const string*> Queried(mt19937& rng, const vector<string>& names)
+{
+    vector<const string*> queries;
+
+    for (size_t i = 0; i < Queries; i++)
+        queries.push_back(&names[rng() % names.size()]);
+
+    return queries;
+}
+
+class NullPPTokenStream : public IPPTokenStream
+{
+public:
+    void emit_whitespace_sequence() {}
+    void emit_new_line() {}
+    void emit_header_name(const string&) {}
+    void emit_identifier(const string&) {}
+    void emit_pp_number(const string&) {}
+    void emit_character_literal(const string&) {}
+    void emit_user_defined_character_literal(const string&) {}
+    void emit_string_literal(const string&) {}
+    void emit_user_defined_string_literal(const string&) {}
+    void emit_preprocessing_op_or_punc(const string&) {}
+    void emit_non_whitespace_char(const string&) {}
+    void emit_error(const string&, const string&) {}
+    void emit_eof() {}
+};
+
+int main()
+{
+    mt19937 rng(1);
+
+    printf("ns per lookup, %zu random queries\n", Queries);
+    printf("%8s  %-20s  %-20s  %-20s\n", "macros", "MacroTable hit/miss",
+        "unordered_set", "set");
+
+    for (size_t count : { 1000, 20000, 200000 })
+    {
+        vector<string> defined = Names(rng, count, "");
+        vector<string> undefined = Names(rng, count, "X");
+
+        MacroTable table;
+        unordered_set<string> hashed;
+        set<string> ordered;
+
+        for (const string& name : defined)
+        {
+            table.define(name);
+            hashed.insert(name);
+            ordered.insert(name);
+        }
+
+        vector<const string*> hits = Queried(rng, defined);
+        vector<const string*> misses = Queried(rng, undefined);
+
+        auto inTable = [&](const string& s) { return table.isDefined(s); };
+        auto inHashed = [&](const string& s) { return hashed.count(s); };
+        auto inOrdered = [&](const string& s) { return ordered.count(s); };
+
+        printf("%8zu  %8.1f / %-9.1f  %8.1f / %-9.1f  %8.1f / %-9.1f\n",
+            count, Time(hits, inTable), Time(misses, inTable),
+            Time(hits, inHashed), Time(misses, inHashed),
+            Time(hits, inOrdered), Time(misses, inOrdered));
+    }
+
+    // "defined(X) && !defined Y" with X defined and Y not, through the whole
+    // evaluator with its results appended to a string
+    vector<string> defined = Names(rng, 20000, "");
+    MacroTable table;
+
+    for (const string& name : defined)
+        table.define(name);
+
+    vector<string> xs, ys;
+
+    for (size_t i = 0; i < 2000; i++)
+    {
+        xs.push_back(defined[rng() % defined.size()]);
+        ys.push_back("MISSING_" + to_string(i));
+    }
+
+    NullPPTokenStream output;
+    CtrlExpr expr(output, table);
+    string results, errors;
+    const size_t lines = 1000000;
+
+    expr.setOutput(&results, &errors);
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < lines; i++)
+    {
+        expr.emit_identifier("defined");
+        expr.emit_preprocessing_op_or_punc("(");
+        expr.emit_identifier(xs[i % xs.size()]);
+        expr.emit_preprocessing_op_or_punc(")");
+        expr.emit_preprocessing_op_or_punc("&&");
+        expr.emit_preprocessing_op_or_punc("!");
+        expr.emit_identifier("defined");
+        expr.emit_identifier(ys[i % ys.size()]);
+        expr.emit_new_line();
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if (results.size() != 2 * lines || !errors.empty())
+    {
+        cerr << "ERROR: unexpected results from CtrlExpr" << endl;
+        return EXIT_FAILURE;
+    }
+
+    printf("defined(X) && !defined Y, 20000 macros: %.1f ns per line\n",
+        elapsed.count() * 1e9 / lines);
+
+    return EXIT_SUCCESS;
+}
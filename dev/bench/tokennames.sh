@@ -0,0 +1,27 @@
+#!/bin/bash
+# tokennames.sh [posttoken...]: posttoken startup time, and its throughput
+# on tokens that are each printed with their token type name, where looking
+# up the names dominates.  Give the binaries of other builds to compare them.
+
+. "$(dirname "$0")/common.sh"
+
+: > "$work/empty.t"
+
+for i in $(seq 100000)
+do
+    echo "; , ( ) { } [ ] + - * / % = < > ! ~ & | ^ ? : :: -> . ..."
+done > "$work/tokennames.t"
+
+for posttoken in "${@:-./posttoken}"
+do
+    start=$(date +%s%N)
+    for run in $(seq 1000)
+    do
+        "$posttoken" < "$work/empty.t" > /dev/null
+    done
+    end=$(date +%s%N)
+
+    startup=$(awk -v ns=$(( end - start )) 'BEGIN { printf "%.0f", ns / 1000 / 1000 }')
+
+    echo "$posttoken: startup $startup us, $(rate "$work/tokennames.t" "$posttoken")"
+done
@@ -0,0 +1,384 @@
+#include <string>
+#include <vector>
+
+#include "pp.h"
+#include "macrotable.h"
+#include "conditional.h"
+
+using namespace std;
+
+// Longer conditions aren't evaluated
+static const size_t MaxLineTokens = 64;
+
+static bool IsDecimal(const string& s)
+{
+    for (char c : s)
+        if (c < '0' || c > '9')
+            return false;
+
+    return !s.empty();
+}
+
+ConditionalSkipper::ConditionalSkipper(IPPTokenStream& output,
+    const IMacroTable& macros)
+    : mOutput(output), mMacros(macros), mTokenizer(nullptr), mSkipped(0)
+{
+    reset();
+}
+
+void ConditionalSkipper::setTokenizer(PPTokenizer* tokenizer)
+{
+    mTokenizer = tokenizer;
+
+    if (mTokenizer)
+        mTokenizer->setSkipping(!active());
+}
+
+void ConditionalSkipper::reset()
+{
+    mGroups.clear();
+    mLine = CL_START;
+    mPass = true;
+    mCount = 0;
+    mCur = 0;
+}
+
+// Note a token of the current line and return whether it is passed on.
+// Only the tokens of conditional directives are kept.
+bool ConditionalSkipper::token(TokenKind kind, const string& data)
+{
+    switch (mLine)
+    {
+    case CL_START:
+        if (data == "#" || data == "%:")
+            mLine = mPass ? CL_DIRECTIVE : CL_HASH;
+        else
+            mLine = CL_TEXT;
+        break;
+
+    case CL_HASH:
+    case CL_DIRECTIVE:
+        if (mCount == 1)
+        {
+            bool opens = kind == CT_IDENTIFIER &&
+                (data == "if" || data == "ifdef" || data == "ifndef");
+            bool continues = kind == CT_IDENTIFIER &&
+                (data == "elif" || data == "else" || data == "endif");
+
+            // The other directives of a skipped group are dropped, and so
+            // are the conditionals nested in it
+            if (!opens && !continues)
+                mLine = CL_TEXT;
+            else if (mLine == CL_HASH && continues && !mGroups.empty() &&
+                    mGroups.back().enclosed)
+            {
+                mLine = CL_DIRECTIVE;
+                mPass = true;
+                mOutput.emit_preprocessing_op_or_punc(mTokens[0].data);
+            }
+        }
+        break;
+
+    case CL_TEXT:
+        break;
+    }
+
+    if (mLine != CL_TEXT)
+    {
+        // The line keeps its strings so steady state lines don't allocate
+        if (mCount < mTokens.size())
+        {
+            mTokens[mCount].kind = kind;
+            mTokens[mCount].data = data;
+        }
+        else if (mCount < MaxLineTokens)
+            mTokens.push_back(LineToken{ kind, data });
+
+        mCount++;
+    }
+
+    return mPass;
+}
+
+void ConditionalSkipper::endLine()
+{
+    if (mLine != CL_TEXT && mCount > 1)
+    {
+        const string& name = mTokens[1].data;
+
+        mCur = 2;
+
+        if (name == "if" || name == "ifdef" || name == "ifndef")
+        {
+            Group group = { active(), false, certain(), false, CE_FALSE };
+            Truth truth = CE_FALSE;
+
+            if (group.enclosed)
+                truth = name == "if" ? evaluate() : defined(name == "ifndef");
+
+            mGroups.push_back(group);
+            branch(truth);
+        }
+        else if (mGroups.empty())
+        {
+            // Unbalanced, left for the preprocessor to diagnose
+        }
+        else if (name == "endif")
+            mGroups.pop_back();
+        else if (name == "else")
+            branch(CE_TRUE);
+        else if (mGroups.back().enclosed && mGroups.back().taken != CE_TRUE)
+            branch(evaluate());
+        else
+            branch(CE_FALSE);
+    }
+
+    mLine = CL_START;
+    mPass = active();
+    mCount = 0;
+}
+
+// Enter the next branch of the innermost group, whose condition is truth
+void ConditionalSkipper::branch(Truth truth)
+{
+    Group& group = mGroups.back();
+
+    group.active = group.enclosed && group.taken != CE_TRUE &&
+        truth != CE_FALSE;
+    group.certain = group.known && group.taken == CE_FALSE &&
+        truth == CE_TRUE;
+
+    if (group.taken == CE_FALSE)
+        group.taken = truth;
+    else if (truth == CE_TRUE)
+        group.taken = CE_TRUE;
+
+    if (group.enclosed && !group.active)
+        mSkipped++;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::defined(bool negate)
+{
+    if (mCount != 3 || mTokens[2].kind != CT_IDENTIFIER)
+        return CE_UNKNOWN;
+
+    Truth truth = defined(mTokens[2].data);
+
+    return truth == CE_UNKNOWN || !negate ? truth :
+        truth == CE_TRUE ? CE_FALSE : CE_TRUE;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::defined(const string& name)
+{
+    if (mMacros.isUncertain(name))
+        return CE_UNKNOWN;
+
+    return mMacros.isDefined(name) ? CE_TRUE : CE_FALSE;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::evaluate()
+{
+    if (mCount > MaxLineTokens)
+        return CE_UNKNOWN;
+
+    Truth truth = evaluateOr();
+
+    // Anything left over is more than can be evaluated here
+    return mCur == mCount ? truth : CE_UNKNOWN;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::evaluateOr()
+{
+    Truth truth = evaluateAnd();
+
+    while (accept("||"))
+    {
+        Truth right = evaluateAnd();
+
+        if (truth == CE_TRUE || right == CE_TRUE)
+            truth = CE_TRUE;
+        else if (truth == CE_UNKNOWN || right == CE_UNKNOWN)
+            truth = CE_UNKNOWN;
+    }
+
+    return truth;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::evaluateAnd()
+{
+    Truth truth = evaluateUnary();
+
+    while (accept("&&"))
+    {
+        Truth right = evaluateUnary();
+
+        if (truth == CE_FALSE || right == CE_FALSE)
+            truth = CE_FALSE;
+        else if (truth == CE_UNKNOWN || right == CE_UNKNOWN)
+            truth = CE_UNKNOWN;
+    }
+
+    return truth;
+}
+
+ConditionalSkipper::Truth ConditionalSkipper::evaluateUnary()
+{
+    if (accept("!"))
+    {
+        Truth truth = evaluateUnary();
+
+        return truth == CE_UNKNOWN ? CE_UNKNOWN :
+            truth == CE_TRUE ? CE_FALSE : CE_TRUE;
+    }
+
+    if (accept("("))
+    {
+        Truth truth = evaluateOr();
+
+        return accept(")") ? truth : CE_UNKNOWN;
+    }
+
+    if (mCur == mCount)
+        return CE_UNKNOWN;
+
+    const LineToken& token = mTokens[mCur];
+
+    if (token.kind == CT_IDENTIFIER && token.data == "defined")
+    {
+        mCur++;
+
+        bool parenthesized = accept("(");
+
+        if (mCur == mCount || mTokens[mCur].kind != CT_IDENTIFIER)
+            return CE_UNKNOWN;
+
+        Truth truth = defined(mTokens[mCur++].data);
+
+        return !parenthesized || accept(")") ? truth : CE_UNKNOWN;
+    }
+
+    if (token.kind == CT_IDENTIFIER)
+    {
+        mCur++;
+
+        // Only an identifier that isn't a macro has a known value
+        if (token.data == "true")
+            return CE_TRUE;
+        else if (token.data == "false" || defined(token.data) == CE_FALSE)
+            return CE_FALSE;
+
+        return CE_UNKNOWN;
+    }
+
+    if (token.kind == CT_NUMBER && IsDecimal(token.data))
+    {
+        mCur++;
+
+        return token.data.find_first_not_of('0') != string::npos ?
+            CE_TRUE : CE_FALSE;
+    }
+
+    return CE_UNKNOWN;
+}
+
+bool ConditionalSkipper::accept(const char* punctuator)
+{
+    if (mCur < mCount && mTokens[mCur].kind == CT_PUNCTUATOR &&
+            mTokens[mCur].data == punctuator)
+    {
+        mCur++;
+        return true;
+    }
+
+    return false;
+}
+
+void ConditionalSkipper::emit_whitespace_sequence()
+{
+    if (mPass)
+        mOutput.emit_whitespace_sequence();
+}
+
+void ConditionalSkipper::emit_new_line()
+{
+    bool pass = mPass;
+
+    endLine();
+
+    if (pass)
+        mOutput.emit_new_line();
+
+    if (mTokenizer)
+        mTokenizer->setSkipping(!active());
+}
+
+void ConditionalSkipper::emit_header_name(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_header_name(data);
+}
+
+void ConditionalSkipper::emit_identifier(const string& data)
+{
+    if (token(CT_IDENTIFIER, data))
+        mOutput.emit_identifier(data);
+}
+
+void ConditionalSkipper::emit_pp_number(const string& data)
+{
+    if (token(CT_NUMBER, data))
+        mOutput.emit_pp_number(data);
+}
+
+void ConditionalSkipper::emit_character_literal(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_character_literal(data);
+}
+
+void ConditionalSkipper::emit_user_defined_character_literal(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_user_defined_character_literal(data);
+}
+
+void ConditionalSkipper::emit_string_literal(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_string_literal(data);
+}
+
+void ConditionalSkipper::emit_user_defined_string_literal(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_user_defined_string_literal(data);
+}
+
+void ConditionalSkipper::emit_preprocessing_op_or_punc(const string& data)
+{
+    if (token(CT_PUNCTUATOR, data))
+        mOutput.emit_preprocessing_op_or_punc(data);
+}
+
+void ConditionalSkipper::emit_non_whitespace_char(const string& data)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_non_whitespace_char(data);
+}
+
+void ConditionalSkipper::emit_error(const string& data, const string& message)
+{
+    if (token(CT_OTHER, data))
+        mOutput.emit_error(data, message);
+}
+
+void ConditionalSkipper::emit_eof()
+{
+    // Groups left open are the preprocessor's to diagnose
+    reset();
+
+    if (mTokenizer)
+        mTokenizer->setSkipping(false);
+
+    mOutput.emit_eof();
+}
@@ -0,0 +1,122 @@
+/// Evaluation of conditional groups and skipping of the inactive ones
+///
+/// @file conditional.h
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pp.h"
+#include "macrotable.h"
+
+using namespace std;
+
+// ConditionalSkipper: follows the #if, #ifdef, #ifndef, #elif, #else and
+// #endif directives in the tokens it is given and only passes on the lines
+// of the groups that are active, along with the conditional directives
+// outside skipped groups.  The tokenizer producing the tokens, if set, is
+// switched to skip mode for the inactive groups.
+//
+// Conditions are only evaluated as far as defined, integers, !, && and ||
+// go, with identifiers that aren't macros as 0.  A group whose condition
+// can't be evaluated is taken to be active, and so are the groups after it
+// unless one of them is known to be.  Whether a macro is defined is unknown
+// when the macro table isn't certain of it.
+class ConditionalSkipper : public IPPTokenStream
+{
+public:
+    ConditionalSkipper(IPPTokenStream& output, const IMacroTable& macros);
+
+    void setTokenizer(PPTokenizer* tokenizer);
+
+    void emit_whitespace_sequence();
+    void emit_new_line();
+    void emit_header_name(const string& data);
+    void emit_identifier(const string& data);
+    void emit_pp_number(const string& data);
+    void emit_character_literal(const string& data);
+    void emit_user_defined_character_literal(const string& data);
+    void emit_string_literal(const string& data);
+    void emit_user_defined_string_literal(const string& data);
+    void emit_preprocessing_op_or_punc(const string& data);
+    void emit_non_whitespace_char(const string& data);
+    void emit_error(const string& data, const string& message);
+    void emit_eof();
+
+    // Whether the current line is in an active group
+    bool active() const { return mGroups.empty() || mGroups.back().active; }
+
+    // Whether the current line is known to be in an active group, rather
+    // than taken to be
+    bool certain() const { return mGroups.empty() || mGroups.back().certain; }
+
+    // Number of groups skipped
+    size_t skipped() const { return mSkipped; }
+
+    // Forget the groups open, for the start of another file
+    void reset();
+
+protected:
+    enum Truth
+    {
+        CE_FALSE,
+        CE_TRUE,
+        CE_UNKNOWN
+    };
+
+    // Group: an #if and its #elif and #else
+    struct Group
+    {
+        bool enclosed;      // the enclosing group is active
+        bool active;        // the current branch is
+        bool known;         // the enclosing group is known to be active
+        bool certain;       // and so is the current branch
+        Truth taken;        // whether an earlier branch was
+    };
+
+    enum LineState
+    {
+        CL_START,           // nothing on the line yet
+        CL_HASH,            // a conditional directive in a skipped group
+        CL_DIRECTIVE,       // a conditional directive that is passed on
+        CL_TEXT             // anything else
+    };
+
+    enum TokenKind
+    {
+        CT_IDENTIFIER,
+        CT_NUMBER,
+        CT_PUNCTUATOR,
+        CT_OTHER
+    };
+
+    struct LineToken
+    {
+        TokenKind kind;
+        string data;
+    };
+
+    bool token(TokenKind kind, const string& data);
+    void endLine();
+    void branch(Truth truth);
+    Truth defined(bool negate);
+    Truth defined(const string& name);
+
+    Truth evaluate();
+    Truth evaluateOr();
+    Truth evaluateAnd();
+    Truth evaluateUnary();
+    bool accept(const char* punctuator);
+
+    IPPTokenStream& mOutput;
+    const IMacroTable& mMacros;
+    PPTokenizer* mTokenizer;
+    vector<Group> mGroups;
+    LineState mLine;
+    bool mPass;                     // the line is passed on
+    vector<LineToken> mTokens;      // first tokens of a directive
+    size_t mCount;                  // tokens of the directive
+    size_t mCur;                    // next token to evaluate
+    size_t mSkipped;
+};
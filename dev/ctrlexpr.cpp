@@ -5,6 +5,11 @@
 #include <map>
 #include <string>
 #include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <exception>
 
 #include "token.h"
 #include "pp.h"
@@ -14,6 +19,12 @@
 class DebugCtrlExprOutputStream : public IPPTokenStream
 {
 public:
+    // eof goes to results if given, or else to cout
+    DebugCtrlExprOutputStream(string* results = nullptr)
+        : mResults(results)
+    {
+    }
+
     void emit_whitespace_sequence()
     {
     }
@@ -58,18 +69,236 @@ public:
     {
     }
 
+    void emit_error(const string& data, const string& message)
+    {
+    }
+
     void emit_eof()
     {
-        cout << "eof" << endl;
+        if (mResults)
+            mResults->append("eof\n");
+        else
+            cout << "eof" << endl;
     }
+
+protected:
+    string* mResults;
 };
 
-int main()
+// BatchChunk: a range of input lines evaluated by their own tokenizer and
+// CtrlExpr into buffered output
+struct BatchChunk
 {
+    BatchChunk(const IMacroTable& macros, const char* data, size_t length)
+        : data(data), length(length), output(&results),
+          exparser(output, macros), tokenizer(exparser)
+    {
+        exparser.setOutput(&results, &errors);
+    }
+
+    void process(const char* data, size_t length)
+    {
+        try
+        {
+            tokenizer.process(data, length);
+        }
+        catch (exception& e)
+        {
+            error = current_exception();
+        }
+    }
+
+    const char* data;
+    size_t length;
+
+    string results;
+    string errors;
+    exception_ptr error;
+
     DebugCtrlExprOutputStream output;
-    CtrlExpr exparser(output);
+    CtrlExpr exparser;
+    PPTokenizer tokenizer;
+};
+
+// Whether all the tokenizer has left of its input is the new-line ending
+// the last line.  A fresh tokenizer given only a new-line is in the same
+// state, and both go on the same way once the new-line is emitted.
+static bool AtLineEnd(const PPTokenizer& tokenizer,
+    const PPTokenizer::Checkpoint& lineEnd)
+{
+    PPTokenizer::Checkpoint cp;
+
+    return tokenizer.checkpoint(cp) && cp.state == lineEnd.state &&
+        cp.returnState == lineEnd.returnState &&
+        cp.forward == lineEnd.forward && cp.translate == lineEnd.translate &&
+        cp.cpStream == lineEnd.cpStream && cp.rawDelim == lineEnd.rawDelim;
+}
+
+static void AddStats(CtrlExprStats& total, const CtrlExprStats& s)
+{
+    total.expressions += s.expressions;
+    total.hits += s.hits;
+    total.constantHits += s.constantHits;
+    total.programs += s.programs;
+    total.compileSeconds += s.compileSeconds;
+    total.savedSeconds += s.savedSeconds;
+}
+
+// Evaluate input as chunks of whole lines on separate threads.  A chunk
+// after the first starts with a fresh tokenizer, which is only right if
+// the chunk before it ended at the end of a line.  Otherwise (a comment or
+// line splice crossing the boundary) that chunk is tokenized again by the
+// tokenizer of the chunk before it.  Output is written in input order.
+static int EvaluateBatch(const string& input, unsigned threads,
+    const IMacroTable& macros, CtrlExprStats& stats)
+{
+    vector<unique_ptr<BatchChunk>> chunks;
+    size_t start = 0;
+
+    for (unsigned i = 0; i < threads && start < input.length(); i++)
+    {
+        size_t end = input.find('\n',
+            max(start, input.length() * (i + 1) / threads));
+
+        if (i + 1 == threads || end == string::npos)
+            end = input.length();
+        else
+            end++;
+
+        chunks.emplace_back(new BatchChunk(macros, input.data() + start,
+            end - start));
+        start = end;
+    }
+
+    if (chunks.empty())
+        chunks.emplace_back(new BatchChunk(macros, input.data(), 0));
+
+    vector<thread> workers;
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        BatchChunk* chunk = chunks[i].get();
+
+        workers.emplace_back([chunk, i]()
+        {
+            if (i > 0)
+                chunk->process("\n", 1);
+
+            chunk->process(chunk->data, chunk->length);
+        });
+    }
+
+    for (thread& worker : workers)
+        worker.join();
+
+    DebugCtrlExprOutputStream none;
+    PPTokenizer::Checkpoint lineEnd;
+    PPTokenizer fresh(none);
+
+    fresh.process('\n');
+    fresh.checkpoint(lineEnd);
+
+    // Chain the chunks whose output stands, the owner of each chunk is the
+    // one whose tokenizer got to the end of it
+    vector<BatchChunk*> owners(1, chunks[0].get());
+
+    for (size_t i = 1; i < chunks.size() && !owners.back()->error; i++)
+    {
+        BatchChunk* owner = owners.back();
+
+        if (AtLineEnd(owner->tokenizer, lineEnd))
+        {
+            // The new-line the tokenizer still holds ends the last line
+            owner->exparser.emit_new_line();
+            owners.push_back(chunks[i].get());
+        }
+        else
+            owner->process(chunks[i]->data, chunks[i]->length);
+    }
+
+    BatchChunk* last = owners.back();
+
+    if (!last->error)
+    {
+        try
+        {
+            last->tokenizer.process(EndOfFile);
+        }
+        catch (exception& e)
+        {
+            last->error = current_exception();
+        }
+    }
+
+    for (BatchChunk* chunk : owners)
+    {
+        cout.write(chunk->results.data(), chunk->results.length());
+        cerr.write(chunk->errors.data(), chunk->errors.length());
+
+        AddStats(stats, chunk->exparser.stats());
+
+        if (chunk->error)
+        {
+            try
+            {
+                rethrow_exception(chunk->error);
+            }
+            catch (exception& e)
+            {
+                cout.flush();
+                cerr << "ERROR: " << e.what() << endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    cout.flush();
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    DebugCtrlExprOutputStream output;
+    PA3MockMacroTable macros;
+    CtrlExpr exparser(output, macros);
     PPTokenizer tokenizer(exparser);
 
+    // ctrlexpr --stats reports how well the compiled programs were reused.
+    // --batch buffers all output and --threads <n> also spreads the lines
+    // over n threads.
+    bool stats = false;
+    bool batch = false;
+    unsigned threads = 1;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--stats")
+            stats = true;
+        else if (arg == "--batch")
+            batch = true;
+        else if (arg == "--threads" && i + 1 < argc &&
+                atoi(argv[i + 1]) > 0)
+        {
+            batch = true;
+            threads = atoi(argv[++i]);
+        }
+        else
+            usage = true;
+    }
+
+    if (usage)
+    {
+        cerr << "usage: ctrlexpr [--stats] [--batch] [--threads <n>] < input"
+            << endl;
+        return EXIT_FAILURE;
+    }
+
+    CtrlExprStats s;
+    memset(&s, 0, sizeof(s));
+
     try
     {
         ostringstream oss;
@@ -77,17 +306,35 @@ int main()
 
         string input = oss.str();
 
-        for (char c : input)
+        if (batch)
         {
-            unsigned char code_unit = c;
-            tokenizer.process(code_unit);
+            int result = EvaluateBatch(input, threads, macros, s);
+
+            if (result != EXIT_SUCCESS)
+                return result;
         }
+        else
+        {
+            tokenizer.process(input.data(), input.size());
 
-        tokenizer.process(EndOfFile);
+            tokenizer.process(EndOfFile);
+
+            s = exparser.stats();
+        }
     }
     catch (exception& e)
     {
         cerr << "ERROR: " << e.what() << endl;
         return EXIT_FAILURE;
     }
+
+    if (stats)
+    {
+        cerr << "expressions: " << s.expressions << endl;
+        cerr << "hits: " << s.hits << " (" << s.constantHits << " constant)"
+            << endl;
+        cerr << "programs: " << s.programs << endl;
+        cerr << "compile time: " << s.compileSeconds * 1000 << " ms" << endl;
+        cerr << "time saved (at most): " << s.savedSeconds * 1000 << " ms" << endl;
+    }
 }
@@ -0,0 +1,673 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <unordered_set>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "macrotable.h"
+#include "includeguard.h"
+#include "headercache.h"
+#include "conditional.h"
+
+// Directive: an #include with its header name, or the macro name of a
+// #define or #undef
+struct Directive
+{
+	enum Kind
+	{
+		INCLUDE,
+		DEFINE,
+		UNDEF
+	};
+
+	Directive(Kind kind, const string& name)
+		: kind(kind), name(name)
+	{}
+
+	Kind kind;
+	string name;
+};
+
+// DependencyCollector: picks the header names out of the #include
+// directives emitted by a tokenizer in directives-only mode, along with the
+// macros defined and undefined in between
+struct DependencyCollector : IPPTokenStream
+{
+	DependencyCollector()
+		: position(DEP_LINE_START)
+	{}
+
+	// Called for each directive as it is found
+	virtual void directive(Directive::Kind kind, const string& name)
+	{
+		directives.emplace_back(kind, name);
+	}
+
+	void emit_whitespace_sequence()
+	{
+		if (position == DEP_ANGLED)
+			header.push_back(' ');
+	}
+
+	void emit_new_line()
+	{
+		position = DEP_LINE_START;
+	}
+
+	void emit_header_name(const string& data)
+	{
+		if (position == DEP_INCLUDE)
+			directive(Directive::INCLUDE, data);
+
+		next_token(data);
+	}
+
+	void emit_identifier(const string& data)
+	{
+		if (position == DEP_HASH && data == "include")
+			position = DEP_INCLUDE;
+		else if (position == DEP_HASH && data == "define")
+			position = DEP_DEFINE;
+		else if (position == DEP_HASH && data == "undef")
+			position = DEP_UNDEF;
+		else if (position == DEP_DEFINE || position == DEP_UNDEF)
+		{
+			directive(position == DEP_DEFINE ?
+				Directive::DEFINE : Directive::UNDEF, data);
+			position = DEP_NONE;
+		}
+		else
+			next_token(data);
+	}
+
+	void emit_pp_number(const string& data)
+	{
+		next_token(data);
+	}
+
+	void emit_character_literal(const string& data)
+	{
+		next_token(data);
+	}
+
+	void emit_user_defined_character_literal(const string& data)
+	{
+		next_token(data);
+	}
+
+	void emit_string_literal(const string& data)
+	{
+		// Only a line-initial #include followed by a single space gets a
+		// header-name token so catch the other spellings here
+		if (position == DEP_INCLUDE)
+			directive(Directive::INCLUDE, data);
+
+		next_token(data);
+	}
+
+	void emit_user_defined_string_literal(const string& data)
+	{
+		next_token(data);
+	}
+
+	void emit_preprocessing_op_or_punc(const string& data)
+	{
+		if (position == DEP_LINE_START && (data == "#" || data == "%:"))
+			position = DEP_HASH;
+		else if (position == DEP_INCLUDE && data == "<")
+		{
+			position = DEP_ANGLED;
+			header = data;
+		}
+		else if (position == DEP_ANGLED && data == ">")
+		{
+			directive(Directive::INCLUDE, header + data);
+			position = DEP_NONE;
+		}
+		else
+			next_token(data);
+	}
+
+	void emit_non_whitespace_char(const string& data)
+	{
+		next_token(data);
+	}
+
+	void emit_error(const string& data, const string& message)
+	{
+		errors.push_back(message);
+		position = DEP_NONE;
+	}
+
+	void emit_eof()
+	{
+		position = DEP_LINE_START;
+	}
+
+	vector<Directive> directives;
+	vector<string> errors;
+
+private:
+
+	enum Position
+	{
+		DEP_LINE_START,
+		DEP_HASH,
+		DEP_INCLUDE,
+		DEP_ANGLED,
+		DEP_DEFINE,
+		DEP_UNDEF,
+		DEP_NONE
+	};
+
+	void next_token(const string& data)
+	{
+		if (position == DEP_ANGLED)
+			header += data;
+		else
+			position = DEP_NONE;
+	}
+
+	Position position;
+	string header;
+};
+
+// Read the whole file into input, reusing its storage between files
+static bool read_file(const char* path, string& input)
+{
+	ifstream in(path, ios::binary);
+	if (!in)
+		return false;
+
+	in.seekg(0, ios::end);
+	streamoff size = in.tellg();
+	in.seekg(0, ios::beg);
+
+	if (size < 0)
+		return false;
+
+	input.resize(size);
+	in.read(&input[0], size);
+
+	return (bool)in || size == 0;
+}
+
+// Deeper than any sane include chain, stops unguarded recursive includes
+static const size_t MaxIncludeDepth = 200;
+
+// ScanMacros: the macros defined so far in a translation unit, along with
+// those defined or undefined in groups that may have been skipped, which
+// may or may not be defined from then on
+struct ScanMacros : IMacroTable
+{
+	bool isDefined(const string& name) const
+	{
+		return defined.isDefined(name);
+	}
+
+	bool isUncertain(const string& name) const
+	{
+		return uncertain.count(name) != 0;
+	}
+
+	// A #define or #undef, known to be reached or not
+	void define(const string& name, bool certain)
+	{
+		if (!certain)
+			uncertain.insert(name);
+		else
+		{
+			defined.define(name);
+			uncertain.erase(name);
+		}
+	}
+
+	void undefine(const string& name, bool certain)
+	{
+		if (!certain)
+			uncertain.insert(name);
+		else
+		{
+			defined.undefine(name);
+			uncertain.erase(name);
+		}
+	}
+
+	MacroTable defined;
+	unordered_set<string> uncertain;
+};
+
+// IncludeScanner: follows the #includes of a translation unit through the
+// files they resolve to.  Conditionals are evaluated as far as the
+// ConditionalSkipper can, with the macros given predefined, and the
+// directives of the groups skipped don't count.  A macro defined or
+// undefined where a conditional couldn't be evaluated is uncertain from
+// then on, so it neither skips groups nor guarded headers.  Headers are
+// replayed from cache when one is given.
+struct IncludeScanner
+{
+	IncludeScanner(const vector<string>& includeDirs,
+			const vector<string>& defines,
+			HeaderTokenCache* cache = nullptr)
+		: files(0), bytes(0), groupsSkipped(0), includeDirs(includeDirs),
+		  defines(defines), cache(cache)
+	{}
+
+	void scan_unit(const string& path)
+	{
+		dependencies.clear();
+		errors.clear();
+		seen.clear();
+		macros = ScanMacros();
+		guards.startTranslationUnit();
+
+		for (const string& name : defines)
+			macros.define(name, true);
+
+		scan(path, 0, true);
+	}
+
+	vector<string> dependencies;
+	vector<string> errors;
+	IncludeGuardTable guards;
+	size_t files;
+	size_t bytes;
+	size_t groupsSkipped;
+
+private:
+
+	// FileCollector: handles the directives of a file as they are found, so
+	// a conditional sees the macros of the headers included before it.  A
+	// directive is certain to be reached if the #include of the file is and
+	// the groups it is in are known to be active.
+	struct FileCollector : DependencyCollector
+	{
+		FileCollector(IncludeScanner& scanner, const string& path,
+				size_t depth, bool certain)
+			: scanner(scanner), path(path), depth(depth), certain(certain),
+			  identified(false), detector(nullptr), skipper(nullptr)
+		{}
+
+		void directive(Directive::Kind kind, const string& name)
+		{
+			// A #pragma once counts from the line it is on, so headers
+			// that include each other stop at it
+			if (identified && detector->pragmaOnce())
+				scanner.guards.includedOnce(id);
+
+			scanner.handle(kind, name, path, depth,
+				certain && skipper->certain());
+		}
+
+		void emit_error(const string& data, const string& message)
+		{
+			DependencyCollector::emit_error(data, message);
+			scanner.errors.push_back(path + ": " + message);
+		}
+
+		IncludeScanner& scanner;
+		const string& path;
+		size_t depth;
+		bool certain;
+		FileId id;
+		bool identified;
+		const IncludeGuardDetector* detector;
+		const ConditionalSkipper* skipper;
+	};
+
+	void scan(const string& path, size_t depth, bool certain)
+	{
+		string input;
+
+		if (depth > MaxIncludeDepth)
+			throw runtime_error("#include nested too deeply");
+
+		// A unit given as - is standard input, whose quoted includes are
+		// looked for in the current directory
+		if (depth == 0 && path == "-")
+		{
+			ostringstream oss;
+			oss << cin.rdbuf();
+			input = oss.str();
+		}
+		else if (!read_file(path.c_str(), input))
+			throw runtime_error("unable to read " + path);
+
+		files++;
+		bytes += input.size();
+
+		// The detector needs the lines outside directives too, but only
+		// those of active groups
+		FileCollector output(*this, path, depth, certain);
+		IncludeGuardDetector detector(&output);
+		ConditionalSkipper skipper(detector, macros);
+		FileId& id = output.id;
+		bool identified = guards.identify(path, id);
+
+		output.identified = identified;
+		output.detector = &detector;
+		output.skipper = &skipper;
+
+		if (cache && identified && depth > 0)
+		{
+			uint64_t hash = HeaderTokenCache::hash(input);
+			HeaderTokenCache::Tokens tokens = cache->find(id, hash);
+
+			if (!tokens)
+			{
+				shared_ptr<PackedPPTokenBuffer> buffer(new PackedPPTokenBuffer);
+
+				tokenize(input, *buffer);
+				buffer->shrink();
+				cache->insert(id, hash, buffer);
+				tokens = buffer;
+			}
+
+			tokens->replay(skipper);
+		}
+		else
+			tokenize(input, skipper);
+
+		groupsSkipped += skipper.skipped();
+
+		if (identified)
+			guards.record(id, detector);
+	}
+
+	void handle(Directive::Kind kind, const string& name, const string& path,
+		size_t depth, bool certain)
+	{
+		string header;
+
+		switch (kind)
+		{
+		case Directive::DEFINE:
+			macros.define(name, certain);
+			break;
+
+		case Directive::UNDEF:
+			macros.undefine(name, certain);
+			break;
+
+		case Directive::INCLUDE:
+			if (!resolve(name, path, header))
+			{
+				add(name);
+				break;
+			}
+
+			add(header);
+
+			if (!guards.skip(header, macros))
+				scan(header, depth + 1, certain);
+			break;
+		}
+	}
+
+	static void tokenize(const string& input, IPPTokenStream& output)
+	{
+		PPTokenizer tokenizer(output);
+		tokenizer.setRecovery(true);
+
+		tokenizer.process(input.data(), input.size());
+
+		tokenizer.process(EndOfFile);
+	}
+
+	// Tokenize with the skipper switching the tokenizer to skip mode in
+	// inactive groups.  Cached tokens can't be skipped since they don't
+	// depend on the macros defined.
+	static void tokenize(const string& input, ConditionalSkipper& skipper)
+	{
+		PPTokenizer tokenizer(skipper);
+		tokenizer.setRecovery(true);
+		skipper.setTokenizer(&tokenizer);
+
+		tokenizer.process(input.data(), input.size());
+
+		tokenizer.process(EndOfFile);
+		skipper.setTokenizer(nullptr);
+	}
+
+	// Find the file a header name refers to.  A "q-char" name is looked
+	// for next to the file including it first.
+	bool resolve(const string& name, const string& from, string& path)
+	{
+		FileId id;
+
+		if (name.length() < 2)
+			return false;
+
+		string file = name.substr(1, name.length() - 2);
+
+		if (name[0] == '"')
+		{
+			size_t slash = from.rfind('/');
+
+			path = slash == string::npos ? file : from.substr(0, slash + 1) + file;
+			if (guards.identify(path, id))
+				return true;
+		}
+		else if (name[0] != '<')
+			return false;
+
+		for (const string& dir : includeDirs)
+		{
+			path = dir + "/" + file;
+			if (guards.identify(path, id))
+				return true;
+		}
+
+		return false;
+	}
+
+	void add(const string& dependency)
+	{
+		if (seen.insert(dependency).second)
+			dependencies.push_back(dependency);
+	}
+
+	const vector<string>& includeDirs;
+	const vector<string>& defines;
+	HeaderTokenCache* cache;
+	unordered_set<string> seen;
+	ScanMacros macros;
+};
+
+// UnitResult: what scanning one translation unit printed
+struct UnitResult
+{
+	string output;
+	string errors;
+};
+
+// Scan every threads'th translation unit starting with the first'th
+static void ScanUnits(const vector<const char*>& paths, size_t first,
+	size_t threads, IncludeScanner& scanner, vector<UnitResult>& results)
+{
+	for (size_t i = first; i < paths.size(); i += threads)
+	{
+		UnitResult& result = results[i];
+
+		try
+		{
+			scanner.scan_unit(paths[i]);
+
+			result.output = paths[i];
+			result.output += ":";
+			for (const string& dependency : scanner.dependencies)
+				result.output += " " + dependency;
+			result.output += "\n";
+
+			for (const string& error : scanner.errors)
+				result.errors += "ERROR: " + error + "\n";
+		}
+		catch (exception& e)
+		{
+			result.errors += string("ERROR: ") + paths[i] + ": " + e.what() +
+				"\n";
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// depscan --follow also scans the files included, found next to the
+	// including file or in the -I directories, and lists every file
+	// reached, skipping the conditional groups known to be inactive with
+	// the -D <name> macros defined.  It spreads the files given over
+	// --threads <n> threads, which share the tokens of headers in a cache
+	// of --cache-size <MB>.
+	// --stats reports how much reading and tokenizing was saved.
+	vector<const char*> paths;
+	vector<string> includeDirs;
+	vector<string> defines;
+	bool follow = false;
+	bool stats = false;
+	unsigned threads = 1;
+	size_t cacheSize = 64;
+	string input;
+	int result = EXIT_SUCCESS;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "--follow")
+			follow = true;
+		else if (arg == "--stats")
+			stats = true;
+		else if (arg == "--threads" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			threads = atoi(argv[++i]);
+		else if (arg == "--cache-size" && i + 1 < argc)
+			cacheSize = atol(argv[++i]);
+		else if (arg == "-I" && i + 1 < argc)
+			includeDirs.push_back(argv[++i]);
+		else if (arg.compare(0, 2, "-I") == 0 && arg.length() > 2)
+			includeDirs.push_back(arg.substr(2));
+		else if (arg.compare(0, 2, "-D") == 0 &&
+				(arg.length() > 2 || i + 1 < argc))
+		{
+			// Only whether a macro is defined matters, not its value
+			string define = arg.length() > 2 ? arg.substr(2) : argv[++i];
+			defines.push_back(define.substr(0, define.find('=')));
+		}
+		else
+			paths.push_back(argv[i]);
+	}
+
+	// Read standard input when no files are given
+	if (paths.empty())
+		paths.push_back("-");
+
+	if (follow)
+	{
+		HeaderTokenCache cache(cacheSize << 20);
+		vector<unique_ptr<IncludeScanner>> scanners;
+		vector<UnitResult> results(paths.size());
+		vector<thread> workers;
+
+		threads = min<size_t>(threads, paths.size());
+
+		for (unsigned i = 0; i < threads; i++)
+			scanners.emplace_back(new IncludeScanner(includeDirs, defines,
+				cacheSize > 0 ? &cache : nullptr));
+
+		for (unsigned i = 1; i < threads; i++)
+			workers.emplace_back(ScanUnits, cref(paths), i, threads,
+				ref(*scanners[i]), ref(results));
+
+		ScanUnits(paths, 0, threads, *scanners[0], results);
+
+		for (thread& worker : workers)
+			worker.join();
+
+		for (const UnitResult& unit : results)
+		{
+			cout << unit.output;
+			cerr << unit.errors;
+
+			if (!unit.errors.empty())
+				result = EXIT_FAILURE;
+		}
+
+		if (stats)
+		{
+			size_t files = 0, bytes = 0, skipped = 0, groups = 0;
+
+			for (const unique_ptr<IncludeScanner>& scanner : scanners)
+			{
+				files += scanner->files;
+				bytes += scanner->bytes;
+				skipped += scanner->guards.skipped();
+				groups += scanner->groupsSkipped;
+			}
+
+			HeaderTokenCacheStats s = cache.stats();
+
+			cerr << "files read: " << files << endl;
+			cerr << "bytes read: " << bytes << endl;
+			cerr << "includes skipped: " << skipped << endl;
+			cerr << "conditional groups skipped: " << groups << endl;
+			cerr << "cache hits: " << s.hits << " misses: " << s.misses
+				<< " evictions: " << s.evictions << endl;
+			cerr << "cache entries: " << s.entries << " (" << s.bytes
+				<< " bytes)" << endl;
+		}
+
+		return result;
+	}
+
+	for (const char* path : paths)
+	{
+		try
+		{
+			if (string(path) == "-")
+			{
+				ostringstream oss;
+				oss << cin.rdbuf();
+				input = oss.str();
+			}
+			else if (!read_file(path, input))
+				throw runtime_error("unable to read file");
+
+			DependencyCollector output;
+
+			PPTokenizer tokenizer(output);
+			tokenizer.setDirectivesOnly(true);
+
+			// Keep scanning past malformed lines so one bad file in a large
+			// batch still reports the rest of its dependencies
+			tokenizer.setRecovery(true);
+
+			tokenizer.process(input.data(), input.size());
+
+			tokenizer.process(EndOfFile);
+
+			cout << path << ":";
+			for (const Directive& directive : output.directives)
+				if (directive.kind == Directive::INCLUDE)
+					cout << " " << directive.name;
+			cout << "\n";
+
+			for (const string& error : output.errors)
+				cerr << "ERROR: " << path << ": " << error << endl;
+
+			if (!output.errors.empty())
+				result = EXIT_FAILURE;
+		}
+		catch (exception& e)
+		{
+			cerr << "ERROR: " << path << ": " << e.what() << endl;
+			result = EXIT_FAILURE;
+		}
+	}
+
+	return result;
+}
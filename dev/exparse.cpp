@@ -5,6 +5,12 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <exception>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <chrono>
 
 #include "token.h"
 #include "exparse.h"
@@ -21,31 +27,321 @@ bool PA3Mock_IsDefinedIdentifier(const string& identifier)
 		return identifier[0] % 2;
 }
 
-class TokenElement
+bool PA3MockMacroTable::isDefined(const string& name) const
 {
-public:
-	TokenElement(PPToken t, string v) : type(t), value(v) {}
+	return PA3Mock_IsDefinedIdentifier(name);
+}
+
+// Codes of controlling expression tokens.  The binary operators come first
+// so BinaryPrecedence can be indexed by them.  Unary - is CE_NEG in
+// programs.
+enum ECtrlExprOp : unsigned char
+{
+	CE_MUL,
+	CE_DIV,
+	CE_MOD,
+	CE_ADD,
+	CE_SUB,
+	CE_LSHIFT,
+	CE_RSHIFT,
+	CE_LT,
+	CE_GT,
+	CE_LE,
+	CE_GE,
+	CE_EQ,
+	CE_NE,
+	CE_BAND,
+	CE_XOR,
+	CE_BOR,
+	CE_LAND,
+	CE_LOR,
+	CE_QMARK,
+
+	CE_COLON,
+	CE_LNOT,
+	CE_COMPL,
+	CE_NEG,
+	CE_LPAREN,
+	CE_RPAREN,
+	CE_VALUE,
+	CE_IDENTIFIER,
+	CE_DEFINED,
+	CE_INVALID,
+	CE_PPTOKEN,
+	CE_END
+};
+
+// Precedence of each binary operator, higher binds tighter.  Everything
+// from CE_COLON on ends a binary expression.
+static const int BinaryPrecedence[CE_END + 1] =
+{
+	10, 10, 10,         // * / %
+	9, 9,               // + -
+	8, 8,               // << >>
+	7, 7, 7, 7,         // < > <= >=
+	6, 6,               // == !=
+	5,                  // &
+	4,                  // ^
+	3,                  // |
+	2,                  // &&
+	1,                  // ||
+	0,                  // ?:
+
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+// CtrlExprValue: a value promoted to intmax_t or uintmax_t.  Every
+// operand is evaluated, errors only make the whole expression an error
+// if they reach it through operands that are actually used.
+struct CtrlExprValue
+{
+	unsigned long long value;
+	bool isSigned;
+	bool error;
+};
 
-	PPToken type;
-	string value;
+// CtrlExprToken: a post-token of a controlling expression
+struct CtrlExprToken
+{
+	ECtrlExprOp op;
+	bool identifier;        // true and false are also identifiers
+	unsigned nameOffset;    // identifiers: spelling in the key of the line
+	unsigned nameLength;
+	CtrlExprValue value;    // CE_VALUE
+};
+
+// CtrlExprInstr: an instruction of a compiled controlling expression.
+// Programs are postfix: CE_VALUE and CE_DEFINED push a value, the unary
+// operators replace the top one and the binary operators and CE_QMARK
+// replace the top two or three.
+struct CtrlExprInstr
+{
+	ECtrlExprOp op;
+	unsigned operand;       // index into values or names
+};
+
+struct CtrlExprProgram
+{
+	vector<CtrlExprInstr> code;
+	vector<CtrlExprValue> values;
+	vector<string> names;   // identifiers given to defined
+
+	exception_ptr error;    // syntax error, the program is empty
+	bool constant;          // no defined, result is the value of the line
+	CtrlExprValue result;
+	string diagnostics;     // TokenStream's, printed on every evaluation
+
+	double compileSeconds;
 };
 
-class CtrlExprParser
+// Maximum number of programs kept before the cache starts over
+static const size_t MaxCtrlExprPrograms = 65536;
+
+// Thrown by every line that divides by zero, overflows dividing or shifts
+// out of range.  Copies share the message so throwing it doesn't allocate
+// one.
+static const runtime_error CtrlExprRangeError(
+	"division by zero, overflow or shift out of range");
+
+// Convert a simple token to its code, CE_INVALID if it can't appear in a
+// controlling expression
+static ECtrlExprOp CtrlExprOpOf(ETokenType type)
+{
+	switch (type)
+	{
+	case OP_STAR: return CE_MUL;
+	case OP_DIV: return CE_DIV;
+	case OP_MOD: return CE_MOD;
+	case OP_PLUS: return CE_ADD;
+	case OP_MINUS: return CE_SUB;
+	case OP_LSHIFT: return CE_LSHIFT;
+	case OP_RSHIFT: return CE_RSHIFT;
+	case OP_LT: return CE_LT;
+	case OP_GT: return CE_GT;
+	case OP_LE: return CE_LE;
+	case OP_GE: return CE_GE;
+	case OP_EQ: return CE_EQ;
+	case OP_NE: return CE_NE;
+	case OP_AMP: return CE_BAND;
+	case OP_XOR: return CE_XOR;
+	case OP_BOR: return CE_BOR;
+	case OP_LAND: return CE_LAND;
+	case OP_LOR: return CE_LOR;
+	case OP_QMARK: return CE_QMARK;
+	case OP_COLON: return CE_COLON;
+	case OP_LNOT: return CE_LNOT;
+	case OP_COMPL: return CE_COMPL;
+	case OP_LPAREN: return CE_LPAREN;
+	case OP_RPAREN: return CE_RPAREN;
+	default: return CE_INVALID;
+	}
+}
+
+// Promote an integral literal of type T.  bool counts as signed.
+template<typename T>
+static CtrlExprValue promote(const void* data)
+{
+	T value;
+	memcpy(&value, data, sizeof(value));
+
+	CtrlExprValue result;
+	result.error = false;
+	result.isSigned = numeric_limits<T>::is_signed || is_same<T, bool>::value;
+	result.value = result.isSigned ? (unsigned long long)(long long)value :
+		(unsigned long long)value;
+
+	return result;
+}
+
+// Decode an integer literal without a ud-suffix, returns false if data
+// isn't one or it is a decimal literal too big for long long.  This is all
+// most pp-numbers in controlling expressions are, so they don't need to go
+// through TokenStream.
+static bool CtrlExprInteger(const string& data, unsigned long long& value,
+	bool& isSigned)
+{
+	const char* p = data.data();
+	const char* end = p + data.length();
+	unsigned base = 10;
+
+	if (p < end && *p == '0')
+	{
+		base = 8;
+
+		if (end - p > 2 && (p[1] == 'x' || p[1] == 'X'))
+		{
+			base = 16;
+			p += 2;
+		}
+	}
+
+	const char* digits = p;
+	value = 0;
+
+	for (; p < end; p++)
+	{
+		unsigned digit;
+
+		if (*p >= '0' && *p <= '9')
+			digit = *p - '0';
+		else if (*p >= 'a' && *p <= 'f')
+			digit = *p - 'a' + 10;
+		else if (*p >= 'A' && *p <= 'F')
+			digit = *p - 'A' + 10;
+		else
+			break;
+
+		if (digit >= base)
+			break;
+
+		if (value > (numeric_limits<unsigned long long>::max() - digit) / base)
+			return false;
+
+		value = value * base + digit;
+	}
+
+	if (p == digits)
+		return false;
+
+	// integer-suffix: u, l or ll in either order
+	bool isUnsigned = false;
+	bool isLong = false;
+
+	if (p < end && (*p == 'u' || *p == 'U'))
+	{
+		isUnsigned = true;
+		p++;
+	}
+
+	if (p < end && (*p == 'l' || *p == 'L'))
+	{
+		isLong = true;
+		p += p + 1 < end && p[1] == p[0] ? 2 : 1;
+	}
+
+	if (!isUnsigned && p < end && (*p == 'u' || *p == 'U'))
+	{
+		isUnsigned = true;
+		p++;
+	}
+
+	if (p != end)
+		return false;
+
+	bool fits = value <= (unsigned long long)numeric_limits<long long>::max();
+
+	if (base == 10 && !isUnsigned && !fits)
+		return false;
+
+	// The signedness is that of the literal's type.  An octal or hex
+	// literal without l that doesn't fit int can be unsigned int.
+	isSigned = !isUnsigned && fits;
+
+	if (base != 10 && !isLong &&
+			value > (unsigned long long)numeric_limits<int>::max() &&
+			value <= numeric_limits<unsigned int>::max())
+		isSigned = false;
+
+	return true;
+}
+
+// CtrlExprParser: collects the tokens of one controlling expression and
+// evaluates it.  Tokens are kept as their codes, with integers already
+// decoded, in a key reused by every line.  Each distinct key is compiled
+// once, by precedence climbing, into a postfix program that later lines
+// with the same key just run.
+class CtrlExprParser : public IPostTokenOutputStream
 {
 public:
-	CtrlExprParser() {}
-	typedef vector<TokenElement> TokenList;
+	CtrlExprParser(const IMacroTable& macros)
+		: mPost(*this), mMacros(macros), mErrorOutput(nullptr)
+	{
+		memset(&mStats, 0, sizeof(mStats));
+	}
 
-	void addToken(PPToken tokenType, string value)
+	void addToken(PPToken tokenType, const string& value)
 	{
-		mTokens.push_back(TokenElement(tokenType, value));
+		switch (tokenType)
+		{
+		case TK_IDENTIFIER:
+			addIdentifier(value);
+			break;
+		case TK_PPNUMBER:
+			{
+				unsigned long long integer;
+				bool isSigned;
+
+				if (CtrlExprInteger(value, integer, isSigned))
+					addValue(integer, isSigned);
+				else
+					addPPToken(tokenType, value);
+			}
+			break;
+		case TK_CHARLITERAL:
+			addPPToken(tokenType, value);
+			break;
+		case TK_PREPROC:
+			{
+				ETokenType type;
+
+				addOp(SimpleTokenType(value, type) ? CtrlExprOpOf(type) :
+					CE_INVALID);
+			}
+			break;
+		default:
+			addOp(CE_INVALID);
+			break;
+		}
 	}
 
-	bool isEmpty() { return mTokens.empty(); }
+	bool isEmpty() { return mKey.empty(); }
 
+	// Rewind the key for the next line.  It keeps its capacity, like the
+	// token list and the stack, so once they have grown to the longest
+	// line a line whose program is cached allocates nothing.
 	void reset()
 	{
-		mTokens.clear();
+		mKey.clear();
 	}
 
 	bool evaluate(unsigned long long *result, bool *isSigned)
@@ -54,142 +350,558 @@ public:
 		*isSigned = true;
 
 		// Verify there are tokens
-		if (mTokens.size() == 0)
+		if (mKey.empty())
 			return false;
 
-		// Append the sentinal for the end of the stream
-		mTokens.push_back(TokenElement(TK_END, ""));
+		mStats.expressions++;
+
+		auto it = mPrograms.find(mKey);
+
+		if (it == mPrograms.end())
+		{
+			if (mPrograms.size() >= MaxCtrlExprPrograms)
+				mPrograms.clear();
 
-		// Start parsing
-		mCur = 0;
-		return parseControllingExpr(result, isSigned);
+			it = mPrograms.insert(make_pair(mKey, CtrlExprProgram())).first;
+			compile(it->first, it->second);
+		}
+		else
+		{
+			mStats.hits++;
+			mStats.savedSeconds += it->second.compileSeconds;
+
+			if (it->second.constant)
+				mStats.constantHits++;
+		}
+
+		const CtrlExprProgram& program = it->second;
+
+		printDiagnostics(program);
+
+		if (program.error)
+			rethrow_exception(program.error);
+
+		CtrlExprValue value = program.constant ? program.result : run(program);
+
+		if (value.error)
+			throw CtrlExprRangeError;
+
+		*result = value.value;
+		*isSigned = value.isSigned;
+		return true;
 	}
 
-protected:
-	bool parseControllingExpr(unsigned long long *result, bool *isSigned)
+	const CtrlExprStats& stats() const { return mStats; }
+
+	void setErrorOutput(string* errors) { mErrorOutput = errors; }
+
+	// IPostTokenOutputStream: anything but an integral literal or an
+	// operator is an invalid token in a controlling expression
+	void emit_invalid(const string&) { addOp(CE_INVALID); }
+	void emit_simple(const string&, ETokenType type) { addOp(CtrlExprOpOf(type)); }
+	void emit_identifier(const string&) { addOp(CE_INVALID); }
+
+	void emit_literal(const string&, EFundamentalType type, const void* data, size_t)
 	{
-		if (parseLogicalOrExpr(result, isSigned))
-			return true;
+		CtrlExprValue value;
 
-		return false;
+		switch (type)
+		{
+		case FT_SIGNED_CHAR: value = promote<signed char>(data); break;
+		case FT_SHORT_INT: value = promote<short int>(data); break;
+		case FT_INT: value = promote<int>(data); break;
+		case FT_LONG_INT: value = promote<long int>(data); break;
+		case FT_LONG_LONG_INT: value = promote<long long int>(data); break;
+		case FT_UNSIGNED_CHAR: value = promote<unsigned char>(data); break;
+		case FT_UNSIGNED_SHORT_INT: value = promote<unsigned short int>(data); break;
+		case FT_UNSIGNED_INT: value = promote<unsigned int>(data); break;
+		case FT_UNSIGNED_LONG_INT: value = promote<unsigned long int>(data); break;
+		case FT_UNSIGNED_LONG_LONG_INT: value = promote<unsigned long long int>(data); break;
+		case FT_WCHAR_T: value = promote<wchar_t>(data); break;
+		case FT_CHAR: value = promote<char>(data); break;
+		case FT_CHAR16_T: value = promote<char16_t>(data); break;
+		case FT_CHAR32_T: value = promote<char32_t>(data); break;
+		case FT_BOOL: value = promote<bool>(data); break;
+		default:
+			addOp(CE_INVALID);
+			return;
+		}
+
+		addValue(value.value, value.isSigned);
 	}
 
-	bool parseLogicalOrExpr(unsigned long long *result, bool *isSigned)
+	void emit_literal_array(const string&, size_t, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_character(const string&, const string&, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_string_array(const string&, const string&, size_t, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_integer(const string&, const string&, const string&) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_floating(const string&, const string&, const string&) { addOp(CE_INVALID); }
+	void emit_eof() {}
+
+protected:
+	// Compile a key into program.  A program that doesn't use defined is
+	// run here once and for all.
+	void compile(const string& key, CtrlExprProgram& program)
 	{
-		if (parseLogicalAndExpr(result, isSigned))
-			return true;
+		auto start = chrono::steady_clock::now();
 
-		return false;
+		program.constant = false;
+		mProgram = &program;
+		mTokens.clear();
+
+		// Keep the diagnostics with the program so a line that hits it
+		// prints them too
+		mPost.setErrorOutput(&program.diagnostics);
+
+		// Rebuild the key in mKey with its CE_PPTOKEN records replaced by
+		// the post-tokens they give
+		mKey.clear();
+
+		for (size_t i = 0; i < key.length(); )
+		{
+			size_t length = 1;
+			unsigned spelling;
+
+			switch ((ECtrlExprOp)key[i])
+			{
+			case CE_VALUE:
+				length += sizeof(unsigned long long) + 1;
+				break;
+			case CE_IDENTIFIER:
+				memcpy(&spelling, &key[i + 1], sizeof(spelling));
+				length += sizeof(spelling) + spelling;
+				break;
+			case CE_PPTOKEN:
+				memcpy(&spelling, &key[i + 2], sizeof(spelling));
+				length += 1 + sizeof(spelling) + spelling;
+
+				if (key[i + 1] == TK_PPNUMBER)
+					mPost.emit_pp_number(key.substr(i + 2 + sizeof(spelling), spelling));
+				else
+					mPost.emit_character_literal(key.substr(i + 2 + sizeof(spelling), spelling));
+
+				i += length;
+				continue;
+			default:
+				break;
+			}
+
+			mKey.append(key, i, length);
+			i += length;
+		}
+
+		for (size_t i = 0; i < mKey.length(); )
+		{
+			CtrlExprToken& token = pushToken((ECtrlExprOp)mKey[i++]);
+
+			if (token.op == CE_VALUE)
+			{
+				memcpy(&token.value.value, &mKey[i], sizeof(token.value.value));
+				i += sizeof(token.value.value);
+				token.value.isSigned = mKey[i++];
+			}
+			else if (token.op == CE_IDENTIFIER)
+			{
+				memcpy(&token.nameLength, &mKey[i], sizeof(token.nameLength));
+				i += sizeof(token.nameLength);
+				token.nameOffset = i;
+				token.identifier = true;
+				i += token.nameLength;
+
+				// Keywords are identifiers here so these don't go through
+				// post-tokenization
+				if (isName(token, "true") || isName(token, "false"))
+				{
+					token.op = CE_VALUE;
+					token.value.value = isName(token, "true");
+				}
+				else if (isName(token, "defined"))
+					token.op = CE_DEFINED;
+			}
+		}
+
+		// Append the sentinal for the end of the stream
+		pushToken(CE_END);
+
+		try
+		{
+			mCur = 0;
+			parseExpr(0);
+
+			if (mTokens[mCur].op != CE_END)
+				throw runtime_error("syntax error");
+		}
+		catch (exception& e)
+		{
+			program.code.clear();
+			program.error = current_exception();
+		}
+
+		if (!program.error && program.names.empty())
+		{
+			program.result = run(program);
+			program.constant = true;
+		}
+
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		program.compileSeconds = elapsed.count();
+
+		mStats.programs++;
+		mStats.compileSeconds += program.compileSeconds;
 	}
 
-	bool parseLogicalAndExpr(unsigned long long *result, bool *isSigned)
+	void printDiagnostics(const CtrlExprProgram& program)
 	{
-		if (parseInclusiveOrExpr(result, isSigned))
-			return true;
+		if (program.diagnostics.empty())
+			return;
 
-		return false;
+		if (mErrorOutput)
+			mErrorOutput->append(program.diagnostics);
+		else
+			cerr << program.diagnostics << flush;
 	}
 
-	bool parseInclusiveOrExpr(unsigned long long *result, bool *isSigned)
+	// Add a token to the key of the line: its code, followed by the value
+	// of a CE_VALUE or the length and spelling of a CE_IDENTIFIER.  Tokens
+	// that need TokenStream are CE_PPTOKEN records with their PPToken type
+	// too, and are only post-tokenized when the line is compiled.
+	void addOp(ECtrlExprOp op)
 	{
-		if (parseExclusiveOrExpr(result, isSigned))
-			return true;
+		mKey += (char)op;
+	}
 
-		return false;
+	void addValue(unsigned long long value, bool isSigned)
+	{
+		addOp(CE_VALUE);
+		mKey.append((const char*)&value, sizeof(value));
+		mKey += (char)isSigned;
 	}
 
-	bool parseExclusiveOrExpr(unsigned long long *result, bool *isSigned)
+	void addIdentifier(const string& name)
 	{
-		if (parseAndExpr(result, isSigned))
-			return true;
+		unsigned length = name.length();
 
-		return false;
+		addOp(CE_IDENTIFIER);
+		mKey.append((const char*)&length, sizeof(length));
+		mKey += name;
 	}
 
-	bool parseAndExpr(unsigned long long *result, bool *isSigned)
+	void addPPToken(PPToken tokenType, const string& spelling)
 	{
-		if (parseEqualityExpr(result, isSigned))
-			return true;
+		unsigned length = spelling.length();
 
-		return false;
+		addOp(CE_PPTOKEN);
+		mKey += (char)tokenType;
+		mKey.append((const char*)&length, sizeof(length));
+		mKey += spelling;
 	}
 
-	bool parseEqualityExpr(unsigned long long *result, bool *isSigned)
+	CtrlExprToken& pushToken(ECtrlExprOp op)
 	{
-		if (parseRelationalExpr(result, isSigned))
-			return true;
+		CtrlExprToken token;
+		token.op = op;
+		token.identifier = false;
+		token.nameOffset = 0;
+		token.nameLength = 0;
+		token.value.value = 0;
+		token.value.isSigned = true;
+		token.value.error = false;
 
-		return false;
+		mTokens.push_back(token);
+
+		return mTokens.back();
 	}
 
-	bool parseRelationalExpr(unsigned long long *result, bool *isSigned)
+	bool isName(const CtrlExprToken& token, const char* name) const
 	{
-		if (parseShiftExpr(result, isSigned))
-			return true;
-
-		return false;
+		return mKey.compare(token.nameOffset, token.nameLength, name) == 0;
 	}
 
-	bool parseShiftExpr(unsigned long long *result, bool *isSigned)
+	void emit(ECtrlExprOp op, unsigned operand = 0)
 	{
-		if (parseAdditiveExpr(result, isSigned))
-			return true;
+		CtrlExprInstr instr;
+		instr.op = op;
+		instr.operand = operand;
 
-		return false;
+		mProgram->code.push_back(instr);
 	}
 
-	bool parseAdditiveExpr(unsigned long long *result, bool *isSigned)
+	void emitValue(const CtrlExprValue& value)
 	{
-		if (parseMultiplicativeExpr(result, isSigned))
-			return true;
+		emit(CE_VALUE, mProgram->values.size());
+		mProgram->values.push_back(value);
+	}
 
-		return false;
+	// Compile operators binding at least as tight as minPrecedence
+	void parseExpr(int minPrecedence)
+	{
+		parseUnaryExpr();
+
+		for (;;)
+		{
+			ECtrlExprOp op = mTokens[mCur].op;
+			int precedence = BinaryPrecedence[op];
+
+			if (precedence < minPrecedence)
+				return;
+
+			mCur++;
+
+			if (op == CE_QMARK)
+			{
+				parseExpr(0);
+
+				if (mTokens[mCur++].op != CE_COLON)
+					throw runtime_error("expected : in conditional expression");
+
+				parseExpr(0);
+			}
+			else
+				parseExpr(precedence + 1);
+
+			emit(op);
+		}
 	}
 
-	bool parseMultiplicativeExpr(unsigned long long *result, bool *isSigned)
+	void parseUnaryExpr()
 	{
-		if (parseUnaryExpr(result, isSigned))
-			return true;
+		switch (mTokens[mCur].op)
+		{
+		case CE_ADD:
+			mCur++;
+			parseUnaryExpr();
+			break;
+		case CE_SUB:
+			mCur++;
+			parseUnaryExpr();
+			emit(CE_NEG);
+			break;
+		case CE_LNOT:
+		case CE_COMPL:
+			{
+				ECtrlExprOp op = mTokens[mCur++].op;
+				parseUnaryExpr();
+				emit(op);
+			}
+			break;
+		default:
+			parsePrimaryExpr();
+			break;
+		}
+	}
 
-		return false;
+	void parsePrimaryExpr()
+	{
+		const CtrlExprToken& token = mTokens[mCur++];
+		CtrlExprValue zero;
+
+		zero.value = 0;
+		zero.isSigned = true;
+		zero.error = false;
+
+		switch (token.op)
+		{
+		case CE_VALUE:
+			emitValue(token.value);
+			break;
+		case CE_IDENTIFIER:
+			emitValue(zero);
+			break;
+		case CE_LPAREN:
+			parseExpr(0);
+
+			if (mTokens[mCur++].op != CE_RPAREN)
+				throw runtime_error("expected )");
+			break;
+		case CE_DEFINED:
+			{
+				bool paren = mTokens[mCur].op == CE_LPAREN;
+				if (paren)
+					mCur++;
+
+				const CtrlExprToken& identifier = mTokens[mCur++];
+				if (!identifier.identifier)
+					throw runtime_error("expected identifier after defined");
+
+				if (paren && mTokens[mCur++].op != CE_RPAREN)
+					throw runtime_error("expected ) after defined");
+
+				emit(CE_DEFINED, mProgram->names.size());
+				mProgram->names.push_back(
+					mKey.substr(identifier.nameOffset, identifier.nameLength));
+			}
+			break;
+		default:
+			throw runtime_error("syntax error");
+		}
 	}
 
-	bool parseUnaryExpr(unsigned long long *result, bool *isSigned)
+	CtrlExprValue run(const CtrlExprProgram& program)
 	{
-		if (parsePrimaryExpr(result, isSigned))
-			return true;
+		mStack.clear();
 
-		return false;
+		for (const CtrlExprInstr& instr : program.code)
+		{
+			CtrlExprValue value;
+
+			switch (instr.op)
+			{
+			case CE_VALUE:
+				mStack.push_back(program.values[instr.operand]);
+				break;
+			case CE_DEFINED:
+				value.value = mMacros.isDefined(program.names[instr.operand]);
+				value.isSigned = true;
+				value.error = false;
+				mStack.push_back(value);
+				break;
+			case CE_NEG:
+				mStack.back().value = 0 - mStack.back().value;
+				break;
+			case CE_LNOT:
+				mStack.back().value = mStack.back().value == 0;
+				mStack.back().isSigned = true;
+				break;
+			case CE_COMPL:
+				mStack.back().value = ~mStack.back().value;
+				break;
+			case CE_QMARK:
+				{
+					CtrlExprValue third = mStack.back();
+					mStack.pop_back();
+					CtrlExprValue second = mStack.back();
+					mStack.pop_back();
+					CtrlExprValue& condition = mStack.back();
+
+					// The type comes from both operands even though only
+					// one is used, unless the condition is already an error
+					if (!condition.error)
+					{
+						const CtrlExprValue& chosen = condition.value ? second : third;
+
+						condition.value = chosen.value;
+						condition.error = chosen.error;
+						condition.isSigned = second.isSigned && third.isSigned;
+					}
+				}
+				break;
+			default:
+				value = mStack.back();
+				mStack.pop_back();
+				mStack.back() = applyBinary(instr.op, mStack.back(), value);
+				break;
+			}
+		}
+
+		return mStack.back();
 	}
 
-	bool parsePrimaryExpr(unsigned long long *result, bool *isSigned)
+	static CtrlExprValue applyBinary(ECtrlExprOp op, CtrlExprValue left,
+		CtrlExprValue right)
 	{
-		char *endPtr = nullptr;
+		// Usual arithmetic conversions: unsigned if either operand is
+		bool common = left.isSigned && right.isSigned;
+
+		unsigned long long a = left.value, b = right.value;
+		long long sa = (long long)a, sb = (long long)b;
+
+		// The most negative value divided by -1 overflows, which is as much
+		// an error as dividing by zero
+		bool overflow = common && sa == numeric_limits<long long>::min() &&
+			sb == -1;
+
+		CtrlExprValue result;
+		result.value = 0;
+		result.isSigned = common;
+		result.error = left.error || right.error;
 
-		// Check if this is a integral-literal
-		if (mTokens[mCur].type == TK_PPNUMBER)
+		switch (op)
 		{
-			// Try and convert to an unsigned long long
-			errno = 0;
-			*result = strtoull(mTokens[mCur].value.c_str(), &endPtr, 0);
-
-			// Check for failure
-			if ((*result == 0 && errno != 0) ||
-					(endPtr - mTokens[mCur].value.c_str()) < mTokens[mCur].value.length())
-				throw runtime_error("malformed number");
+		case CE_MUL: result.value = a * b; break;
+		case CE_DIV:
+			if (b == 0 || overflow)
+				result.error = true;
+			else if (!common)
+				result.value = a / b;
+			else
+				result.value = sa / sb;
+			break;
+		case CE_MOD:
+			if (b == 0 || overflow)
+				result.error = true;
+			else if (!common)
+				result.value = a % b;
+			else
+				result.value = sa % sb;
+			break;
+		case CE_ADD: result.value = a + b; break;
+		case CE_SUB: result.value = a - b; break;
+		case CE_LSHIFT:
+		case CE_RSHIFT:
+			// The type of a shift is that of its left operand
+			result.isSigned = left.isSigned;
+
+			if ((right.isSigned && sb < 0) || b >= 64)
+				result.error = true;
+			else if (op == CE_LSHIFT)
+				result.value = a << b;
+			else
+				result.value = left.isSigned ?
+					(unsigned long long)(sa >> b) : a >> b;
+			break;
+		case CE_LT: result.value = common ? sa < sb : a < b; break;
+		case CE_GT: result.value = common ? sa > sb : a > b; break;
+		case CE_LE: result.value = common ? sa <= sb : a <= b; break;
+		case CE_GE: result.value = common ? sa >= sb : a >= b; break;
+		case CE_EQ: result.value = a == b; break;
+		case CE_NE: result.value = a != b; break;
+		case CE_BAND: result.value = a & b; break;
+		case CE_XOR: result.value = a ^ b; break;
+		case CE_BOR: result.value = a | b; break;
+		case CE_LAND:
+			// The right operand only counts if the left one is true
+			result.error = left.error || (a != 0 && right.error);
+			result.value = a && b;
+			break;
+		case CE_LOR:
+			result.error = left.error || (a == 0 && right.error);
+			result.value = a || b;
+			break;
+		default:
+			break;
 		}
-		return false;
+
+		// Comparisons and logical operators give a bool
+		if (op >= CE_LT && op <= CE_NE)
+			result.isSigned = true;
+		else if (op == CE_LAND || op == CE_LOR)
+			result.isSigned = true;
+
+		return result;
 	}
 
-	TokenList mTokens;
+	TokenStream mPost;
+	const IMacroTable& mMacros;
+	string mKey;                        // codes of the tokens of the line
+	vector<CtrlExprToken> mTokens;
 	unsigned int mCur;
+
+	unordered_map<string, CtrlExprProgram> mPrograms;
+	CtrlExprProgram* mProgram;          // program being compiled
+	string* mErrorOutput;               // diagnostics, cerr if null
+	vector<CtrlExprValue> mStack;
+	CtrlExprStats mStats;
 };
 
 
-CtrlExpr::CtrlExpr(IPPTokenStream& output)
-	: mOutput(output)
+CtrlExpr::CtrlExpr(IPPTokenStream& output, const IMacroTable& macros)
+	: mOutput(output), mParser(new CtrlExprParser(macros)),
+	  mResults(nullptr), mErrors(nullptr)
+{
+}
+
+// Out of line so unique_ptr sees the whole CtrlExprParser
+CtrlExpr::~CtrlExpr()
 {
-	mParser = new CtrlExprParser();
 }
 
 void CtrlExpr::emit_whitespace_sequence()
@@ -244,7 +956,14 @@ void CtrlExpr::emit_preprocessing_op_or_punc(const string& data)
 
 void CtrlExpr::emit_non_whitespace_char(const string& data)
 {
+	mParser->addToken(TK_NON_WHITESPACE_CHAR, data);
+}
 
+void CtrlExpr::emit_error(const string& data, const string& message)
+{
+	// Remember the first error so the whole line evaluates to an error
+	if (mError.empty())
+		mError = message;
 }
 
 void CtrlExpr::emit_eof()
@@ -253,28 +972,95 @@ void CtrlExpr::emit_eof()
 	mOutput.emit_eof();
 }
 
+void CtrlExpr::setOutput(string* results, string* errors)
+{
+	mResults = results;
+	mErrors = errors;
+
+	mParser->setErrorOutput(errors);
+}
+
+const CtrlExprStats& CtrlExpr::stats() const
+{
+	return mParser->stats();
+}
+
 void CtrlExpr::eval_expr()
 {
 	unsigned long long result;
 	bool isSigned;
 
+	if (!mError.empty())
+	{
+		printError(mError.c_str());
+
+		mError.clear();
+		mParser->reset();
+		return;
+	}
+
 	if (mParser->isEmpty())
 		return;
 
 	try
 	{
 		mParser->evaluate(&result, &isSigned);
-
-		cout << result;
-		if (!isSigned)
-			cout << "u";
-		cout << endl;
+		printResult(result, isSigned);
 	}
 	catch (exception& e)
 	{
-		cerr << "ERROR: " << e.what() << endl;
-		cout << "error" << endl;
+		printError(e.what());
 	}
 
 	mParser->reset();
 }
+
+void CtrlExpr::printResult(unsigned long long result, bool isSigned)
+{
+	if (!mResults)
+	{
+		if (isSigned)
+			cout << (long long)result << endl;
+		else
+			cout << result << "u" << endl;
+		return;
+	}
+
+	// Format the digits backwards from the end of the buffer
+	char buffer[24];
+	char* end = buffer + sizeof(buffer);
+	char* p = end;
+
+	bool negative = isSigned && (long long)result < 0;
+	unsigned long long magnitude = negative ? 0 - result : result;
+
+	*--p = '\n';
+	if (!isSigned)
+		*--p = 'u';
+
+	do
+	{
+		*--p = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (negative)
+		*--p = '-';
+
+	mResults->append(p, end - p);
+}
+
+void CtrlExpr::printError(const char* message)
+{
+	if (!mResults)
+	{
+		cerr << "ERROR: " << message << endl;
+		cout << "error" << endl;
+		return;
+	}
+
+	mErrors->append("ERROR: ");
+	mErrors->append(message);
+	*mErrors += '\n';
+	mResults->append("error\n");
+}
@@ -2,12 +2,14 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "token.h"
 #include "pp.h"
 #include "post.h"
+#include "macrotable.h"
 
 using namespace std;
 
@@ -19,16 +21,38 @@ enum PPToken {
 	TK_STRINGLITERAL,
 	TK_USER_STRINGLITERAL,
 	TK_PREPROC,
+	TK_NON_WHITESPACE_CHAR,
 	
 	TK_END,
 };
 
 class CtrlExprParser;
 
+// PA3MockMacroTable: the macro table mocked for PA3, a name is defined iff
+// its first code point is odd
+class PA3MockMacroTable : public IMacroTable
+{
+public:
+	bool isDefined(const string& name) const;
+};
+
+// CtrlExprStats: how often a line was found among the compiled programs
+struct CtrlExprStats
+{
+	size_t expressions;     // lines evaluated
+	size_t hits;            // lines whose program was already compiled
+	size_t constantHits;    // hits that don't use defined, so weren't run
+	size_t programs;        // programs compiled
+	double compileSeconds;  // time spent compiling them
+	double savedSeconds;    // compile time of the programs of the hits, as
+	                        // measured the first time, so an upper bound
+};
+
 class CtrlExpr : public IPPTokenStream
 {
 public:
-	CtrlExpr(IPPTokenStream& output);
+	CtrlExpr(IPPTokenStream& output, const IMacroTable& macros);
+	~CtrlExpr();
 
 	void emit_whitespace_sequence();
 	void emit_new_line();
@@ -41,11 +65,24 @@ public:
 	void emit_user_defined_string_literal(const string& data);
 	void emit_preprocessing_op_or_punc(const string& data);
 	void emit_non_whitespace_char(const string& data);
+	void emit_error(const string& data, const string& message);
 	void emit_eof();
 
 	void eval_expr();
 
+	// Append results and diagnostics to these strings instead of writing
+	// them to cout and cerr, so nothing is flushed per line
+	void setOutput(string* results, string* errors);
+
+	const CtrlExprStats& stats() const;
+
 private:
 	IPPTokenStream& mOutput;
-	CtrlExprParser *mParser;
+	void printResult(unsigned long long result, bool isSigned);
+	void printError(const char* message);
+
+	unique_ptr<CtrlExprParser> mParser;
+	string mError;
+	string* mResults;
+	string* mErrors;
 };
\ No newline at end of file
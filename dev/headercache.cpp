@@ -0,0 +1,85 @@
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ppbuffer.h"
+#include "includeguard.h"
+#include "headercache.h"
+#include "wordhash.h"
+
+using namespace std;
+
+HeaderTokenCache::HeaderTokenCache(size_t capacity)
+    : mCapacity(capacity), mBytes(0), mHits(0), mMisses(0), mEvictions(0)
+{}
+
+uint64_t HeaderTokenCache::hash(const string& input)
+{
+    return WordHash(input.data(), input.length());
+}
+
+HeaderTokenCache::Tokens HeaderTokenCache::find(const FileId& id,
+    uint64_t hash)
+{
+    Key key = { id, hash };
+    lock_guard<mutex> lock(mMutex);
+    auto it = mIndex.find(key);
+
+    if (it == mIndex.end())
+    {
+        mMisses++;
+        return Tokens();
+    }
+
+    mHits++;
+    mLru.splice(mLru.begin(), mLru, it->second);
+
+    return it->second->tokens;
+}
+
+void HeaderTokenCache::insert(const FileId& id, uint64_t hash,
+    const Tokens& tokens)
+{
+    Key key = { id, hash };
+    size_t bytes = tokens->footprint();
+
+    if (bytes > mCapacity)
+        return;
+
+    lock_guard<mutex> lock(mMutex);
+
+    // Another thread may have tokenized the same file meanwhile
+    if (mIndex.count(key))
+        return;
+
+    while (mBytes + bytes > mCapacity)
+    {
+        const Entry& last = mLru.back();
+
+        mBytes -= last.bytes;
+        mIndex.erase(last.key);
+        mLru.pop_back();
+        mEvictions++;
+    }
+
+    Entry entry = { key, tokens, bytes };
+
+    mLru.push_front(entry);
+    mIndex[key] = mLru.begin();
+    mBytes += bytes;
+}
+
+HeaderTokenCacheStats HeaderTokenCache::stats() const
+{
+    lock_guard<mutex> lock(mMutex);
+    HeaderTokenCacheStats stats;
+
+    stats.hits = mHits;
+    stats.misses = mMisses;
+    stats.evictions = mEvictions;
+    stats.entries = mLru.size();
+    stats.bytes = mBytes;
+
+    return stats;
+}
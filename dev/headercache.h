@@ -0,0 +1,92 @@
+/// In-memory cache of tokenized headers shared between threads
+///
+/// @file headercache.h
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ppbuffer.h"
+#include "includeguard.h"
+
+using namespace std;
+
+struct HeaderTokenCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+};
+
+// HeaderTokenCache: the pp-tokens of files, found by file identity and a
+// hash of the contents, so a header included by many translation units is
+// tokenized once.  Buffers are immutable once cached and shared, so any
+// thread can replay one while it is evicted.  Total size is bounded by
+// dropping the least recently used files.
+//
+// Everyone sharing a cache must tokenize files the same way.
+class HeaderTokenCache
+{
+public:
+    typedef shared_ptr<const PackedPPTokenBuffer> Tokens;
+
+    // Capacity in bytes of token buffers
+    HeaderTokenCache(size_t capacity);
+
+    static uint64_t hash(const string& input);
+
+    // Tokens of the file with identity id whose contents hash to hash,
+    // nullptr on a miss
+    Tokens find(const FileId& id, uint64_t hash);
+
+    // Keep tokens for later.  Buffers bigger than the whole cache are not
+    // kept.
+    void insert(const FileId& id, uint64_t hash, const Tokens& tokens);
+
+    HeaderTokenCacheStats stats() const;
+
+protected:
+    struct Key
+    {
+        FileId id;
+        uint64_t hash;
+
+        bool operator==(const Key& other) const
+        {
+            return id == other.id && hash == other.hash;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return FileIdHash()(key.id) ^ key.hash;
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        Tokens tokens;
+        size_t bytes;
+    };
+
+    typedef list<Entry> Lru;
+
+    mutable mutex mMutex;
+    Lru mLru;       // most recently used first
+    unordered_map<Key, Lru::iterator, KeyHash> mIndex;
+    size_t mCapacity;
+    size_t mBytes;
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mEvictions;
+};
@@ -0,0 +1,289 @@
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "pp.h"
+#include "macrotable.h"
+#include "includeguard.h"
+
+using namespace std;
+
+// Enough for #if !defined ( X )
+static const size_t MaxLineTokens = 7;
+
+bool GetFileId(const string& path, FileId& id)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    id.device = st.st_dev;
+    id.inode = st.st_ino;
+
+    return true;
+}
+
+static bool IsIdentifier(const string& s)
+{
+    unsigned char c = s.empty() ? 0 : s[0];
+
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        c >= 0x80;
+}
+
+IncludeGuardDetector::IncludeGuardDetector(IPPTokenStream* output)
+    : mOutput(output)
+{
+    reset();
+}
+
+void IncludeGuardDetector::reset()
+{
+    mState = MI_START;
+    mDepth = 0;
+    mTokens = 0;
+    mGuard.clear();
+    mPragmaOnce = false;
+}
+
+void IncludeGuardDetector::token(const string& data)
+{
+    // The line keeps its strings so steady state lines don't allocate
+    if (mTokens < MaxLineTokens)
+    {
+        if (mTokens < mLine.size())
+            mLine[mTokens] = data;
+        else
+            mLine.push_back(data);
+    }
+
+    mTokens++;
+}
+
+void IncludeGuardDetector::endLine()
+{
+    if (mTokens == 0)
+        return;
+
+    size_t tokens = mTokens;
+    mTokens = 0;
+
+    if (mLine[0] != "#" && mLine[0] != "%:")
+    {
+        if (mState != MI_INSIDE)
+            mState = MI_NONE;
+
+        return;
+    }
+
+    const string* name = tokens > 1 ? &mLine[1] : nullptr;
+    bool opens = name && (*name == "if" || *name == "ifdef" ||
+        *name == "ifndef");
+    bool closes = name && *name == "endif";
+    bool once = name && tokens == 3 && *name == "pragma" && mLine[2] == "once";
+
+    // #pragma once counts unless a conditional may have skipped it
+    if (once && (mDepth == 0 || (mState == MI_INSIDE && mDepth == 1)))
+        mPragmaOnce = true;
+
+    switch (mState)
+    {
+    case MI_START:
+        if (tokens == 3 && *name == "ifndef" && IsIdentifier(mLine[2]))
+            mGuard = mLine[2];
+        else if (tokens == 5 && *name == "if" && mLine[2] == "!" &&
+                mLine[3] == "defined" && IsIdentifier(mLine[4]))
+            mGuard = mLine[4];
+        else if (tokens == 7 && *name == "if" && mLine[2] == "!" &&
+                mLine[3] == "defined" && mLine[4] == "(" &&
+                IsIdentifier(mLine[5]) && mLine[6] == ")")
+            mGuard = mLine[5];
+
+        if (!mGuard.empty())
+            mState = MI_INSIDE;
+        else if (!once)
+            mState = MI_NONE;
+        break;
+
+    case MI_INSIDE:
+        if (mDepth == 1 && name && (*name == "else" || *name == "elif"))
+            mState = MI_NONE;
+        else if (mDepth == 1 && closes)
+            mState = MI_AFTER;
+        break;
+
+    case MI_AFTER:
+        if (!once)
+            mState = MI_NONE;
+        break;
+
+    case MI_NONE:
+        break;
+    }
+
+    if (opens)
+        mDepth++;
+    else if (closes && mDepth > 0)
+        mDepth--;
+}
+
+void IncludeGuardDetector::emit_whitespace_sequence()
+{
+    if (mOutput)
+        mOutput->emit_whitespace_sequence();
+}
+
+void IncludeGuardDetector::emit_new_line()
+{
+    endLine();
+
+    if (mOutput)
+        mOutput->emit_new_line();
+}
+
+void IncludeGuardDetector::emit_header_name(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_header_name(data);
+}
+
+void IncludeGuardDetector::emit_identifier(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_identifier(data);
+}
+
+void IncludeGuardDetector::emit_pp_number(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_pp_number(data);
+}
+
+void IncludeGuardDetector::emit_character_literal(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_character_literal(data);
+}
+
+void IncludeGuardDetector::emit_user_defined_character_literal(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_user_defined_character_literal(data);
+}
+
+void IncludeGuardDetector::emit_string_literal(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_string_literal(data);
+}
+
+void IncludeGuardDetector::emit_user_defined_string_literal(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_user_defined_string_literal(data);
+}
+
+void IncludeGuardDetector::emit_preprocessing_op_or_punc(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_preprocessing_op_or_punc(data);
+}
+
+void IncludeGuardDetector::emit_non_whitespace_char(const string& data)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_non_whitespace_char(data);
+}
+
+void IncludeGuardDetector::emit_error(const string& data, const string& message)
+{
+    token(data);
+
+    if (mOutput)
+        mOutput->emit_error(data, message);
+}
+
+void IncludeGuardDetector::emit_eof()
+{
+    endLine();
+
+    // An unterminated guard or anything after it spoils the guard
+    if (mState != MI_AFTER)
+        mGuard.clear();
+
+    if (mOutput)
+        mOutput->emit_eof();
+}
+
+IncludeGuardTable::IncludeGuardTable()
+    : mSkipped(0)
+{}
+
+bool IncludeGuardTable::identify(const string& path, FileId& id)
+{
+    auto it = mIds.find(path);
+
+    if (it != mIds.end())
+    {
+        id = it->second;
+        return true;
+    }
+
+    if (!GetFileId(path, id))
+        return false;
+
+    mIds[path] = id;
+
+    return true;
+}
+
+void IncludeGuardTable::record(const FileId& id,
+    const IncludeGuardDetector& detector)
+{
+    if (detector.pragmaOnce())
+        mOnce.insert(id);
+
+    if (detector.guard().empty())
+        mGuards.erase(id);
+    else
+        mGuards[id] = detector.guard();
+}
+
+bool IncludeGuardTable::skip(const string& path, const IMacroTable& macros)
+{
+    FileId id;
+
+    if (!identify(path, id))
+        return false;
+
+    auto it = mGuards.find(id);
+
+    if (mOnce.count(id) || (it != mGuards.end() &&
+            macros.isDefined(it->second) && !macros.isUncertain(it->second)))
+    {
+        mSkipped++;
+        return true;
+    }
+
+    return false;
+}
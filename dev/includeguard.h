@@ -0,0 +1,131 @@
+/// Include guard detection and the multiple-include optimization
+///
+/// @file includeguard.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "pp.h"
+#include "macrotable.h"
+
+using namespace std;
+
+// FileId: identity of a file however it is named, as device and inode
+struct FileId
+{
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator==(const FileId& other) const
+    {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct FileIdHash
+{
+    size_t operator()(const FileId& id) const
+    {
+        return (id.device * 0x9e3779b97f4a7c15ULL) ^ id.inode;
+    }
+};
+
+// Identity of the file at path, false if it can't be stat'ed
+bool GetFileId(const string& path, FileId& id);
+
+// IncludeGuardDetector: watches the tokens of a whole header for
+//
+//     #ifndef X / #if !defined X / #if !defined(X)
+//     ...
+//     #endif
+//
+// with nothing but whitespace and comments around it, and for #pragma once
+// outside any conditional group.  Every token is passed on to output, if
+// there is one.
+class IncludeGuardDetector : public IPPTokenStream
+{
+public:
+    IncludeGuardDetector(IPPTokenStream* output = nullptr);
+
+    void emit_whitespace_sequence();
+    void emit_new_line();
+    void emit_header_name(const string& data);
+    void emit_identifier(const string& data);
+    void emit_pp_number(const string& data);
+    void emit_character_literal(const string& data);
+    void emit_user_defined_character_literal(const string& data);
+    void emit_string_literal(const string& data);
+    void emit_user_defined_string_literal(const string& data);
+    void emit_preprocessing_op_or_punc(const string& data);
+    void emit_non_whitespace_char(const string& data);
+    void emit_error(const string& data, const string& message);
+    void emit_eof();
+
+    // Guard macro of the header, empty if it has none.  Only meaningful
+    // once the end of file was seen.
+    const string& guard() const { return mGuard; }
+    bool pragmaOnce() const { return mPragmaOnce; }
+
+    void reset();
+
+protected:
+    enum State
+    {
+        MI_START,       // nothing but whitespace so far
+        MI_INSIDE,      // in the group of the guard
+        MI_AFTER,       // after the #endif of the guard
+        MI_NONE         // not guarded
+    };
+
+    void token(const string& data);
+    void endLine();
+
+    IPPTokenStream* mOutput;
+    State mState;
+    size_t mDepth;          // conditional groups open
+    vector<string> mLine;   // first tokens of the current line
+    size_t mTokens;         // tokens on the current line
+    string mGuard;
+    bool mPragmaOnce;
+};
+
+// IncludeGuardTable: what the detector found for each file, by identity, so
+// an #include of a file already seen can be skipped when it is guarded by
+// a macro that is certainly still defined or, in the same translation unit,
+// uses #pragma once.  Paths are resolved to identities once, so a skipped
+// #include costs no I/O at all.
+class IncludeGuardTable
+{
+public:
+    IncludeGuardTable();
+
+    // Identity of the file at path, stat'ed on the first lookup only
+    bool identify(const string& path, FileId& id);
+
+    // Record what the detector found in a file just read in full
+    void record(const FileId& id, const IncludeGuardDetector& detector);
+
+    // Note a #pragma once that counts in a file still being read, so an
+    // #include of the file in it or in the headers it includes is skipped
+    void includedOnce(const FileId& id) { mOnce.insert(id); }
+
+    // Forget which files were included, guards found are kept
+    void startTranslationUnit() { mOnce.clear(); }
+
+    // Whether including the file at path again would add nothing
+    bool skip(const string& path, const IMacroTable& macros);
+
+    // Number of #includes skipped
+    size_t skipped() const { return mSkipped; }
+
+protected:
+    unordered_map<string, FileId> mIds;
+    unordered_map<FileId, string, FileIdHash> mGuards;
+    unordered_set<FileId, FileIdHash> mOnce;    // this translation unit
+    size_t mSkipped;
+};
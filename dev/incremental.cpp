@@ -0,0 +1,178 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <iterator>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "incremental.h"
+
+using namespace std;
+
+IncrementalTokenizer::IncrementalTokenizer(unsigned int interval)
+    : mTokenizer(mFresh),
+      mInterval(interval > 0 ? interval : 1),
+      mLexed(0)
+{
+    mTokenizer.checkpoint(mInitial);
+
+    reset();
+}
+
+void IncrementalTokenizer::reset()
+{
+    Segment segment;
+    segment.offset = 0;
+    segment.state = mInitial;
+
+    mSegments.clear();
+    mSegments.push_back(segment);
+}
+
+void IncrementalTokenizer::tokenize(const string& source)
+{
+    mSource = source;
+    reset();
+
+    relex(0, 0, 0, mSource.length());
+}
+
+void IncrementalTokenizer::edit(size_t offset, size_t removed,
+    const string& inserted)
+{
+    if (offset > mSource.length() || removed > mSource.length() - offset)
+        throw out_of_range("edit outside of source buffer");
+
+    // Find the last checkpoint at or before the edit.  Everything the
+    // tokenizer did up to that point can't depend on the edited text.
+    size_t low = 0, high = mSegments.size();
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (mSegments[middle].offset <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    mSource.replace(offset, removed, inserted);
+
+    relex(low, offset, removed, inserted.length());
+}
+
+void IncrementalTokenizer::relex(size_t first, size_t offset, size_t removed,
+    size_t inserted)
+{
+    vector<Segment> added(1);
+    size_t pos = mSegments[first].offset;
+    size_t end = offset + inserted;
+    size_t next = first + 1;
+    size_t resync = mSegments.size();
+    unsigned int lines = 0;
+
+    added.back().offset = pos;
+    added.back().state = mSegments[first].state;
+
+    mFresh.tokens().clear();
+    mTokenizer.resume(added.back().state);
+
+    try
+    {
+        while (pos < mSource.length())
+        {
+            const char* data = mSource.data() + pos;
+            const char* newline = (const char*)memchr(data, '\n',
+                mSource.length() - pos);
+            size_t length = newline ? (newline - data) + 1 :
+                mSource.length() - pos;
+
+            mTokenizer.process(data, length);
+            pos += length;
+
+            if (newline == nullptr)
+                break;
+
+            PPTokenizer::Checkpoint state;
+
+            // Past the edit the old checkpoints are still valid once they are
+            // shifted by the size of the edit.  If the tokenizer is in the
+            // same state at one of them the rest of the old tokens are too.
+            if (pos >= end)
+            {
+                while (next < mSegments.size() &&
+                        mSegments[next].offset + inserted < pos + removed)
+                    next++;
+
+                if (next < mSegments.size() &&
+                        mSegments[next].offset + inserted == pos + removed &&
+                        mTokenizer.checkpoint(state) &&
+                        state == mSegments[next].state)
+                {
+                    resync = next;
+                    break;
+                }
+            }
+
+            if (++lines % mInterval == 0 && mTokenizer.checkpoint(state))
+            {
+                added.back().tokens.swap(mFresh.tokens());
+                mFresh.tokens().clear();
+
+                added.push_back(Segment());
+                added.back().offset = pos;
+                added.back().state = state;
+            }
+        }
+
+        if (resync == mSegments.size())
+            mTokenizer.process(EndOfFile);
+    }
+    catch (...)
+    {
+        // The old tokens no longer match the source so start over on the
+        // next edit
+        mLexed = pos - added.front().offset;
+        reset();
+        throw;
+    }
+
+    mLexed = pos - added.front().offset;
+    added.back().tokens.swap(mFresh.tokens());
+
+    // Replace the segments up to where the tokenizer synchronized with the
+    // new ones and shift the rest by the size of the edit
+    if (resync - first == added.size())
+        move(added.begin(), added.end(), mSegments.begin() + first);
+    else
+    {
+        mSegments.erase(mSegments.begin() + first, mSegments.begin() + resync);
+        mSegments.insert(mSegments.begin() + first,
+            make_move_iterator(added.begin()),
+            make_move_iterator(added.end()));
+    }
+
+    for (size_t i = first + added.size(); i < mSegments.size(); i++)
+        mSegments[i].offset = mSegments[i].offset + inserted - removed;
+}
+
+PPTokenBuffer::TokenList IncrementalTokenizer::tokens() const
+{
+    PPTokenBuffer::TokenList tokens;
+
+    for (const Segment& segment : mSegments)
+        tokens.insert(tokens.end(), segment.tokens.begin(),
+            segment.tokens.end());
+
+    return tokens;
+}
+
+void IncrementalTokenizer::replay(IPPTokenStream& output) const
+{
+    for (const Segment& segment : mSegments)
+    {
+        for (const PPTokenRecord& token : segment.tokens)
+            PPTokenBuffer::replay(token, output);
+    }
+}
@@ -0,0 +1,56 @@
+/// Incremental re-tokenization of an edited buffer
+///
+/// @file incremental.h
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "pp.h"
+#include "ppbuffer.h"
+
+using namespace std;
+
+// IncrementalTokenizer: keeps the preprocessing tokens of a source buffer
+// split into segments, each starting with a tokenizer checkpoint taken at
+// the start of a line.  After an edit only the text from the last
+// checkpoint before the edit is tokenized again, stopping as soon as the
+// tokenizer reaches a checkpoint of the previous run in the same state.
+class IncrementalTokenizer
+{
+public:
+    IncrementalTokenizer(unsigned int interval = 16);
+
+    void tokenize(const string& source);
+    void edit(size_t offset, size_t removed, const string& inserted);
+
+    void replay(IPPTokenStream& output) const;
+
+    const string& source() const { return mSource; }
+    PPTokenBuffer::TokenList tokens() const;
+
+    // Number of bytes tokenized by the last call to tokenize or edit
+    size_t lexed() const { return mLexed; }
+
+protected:
+    // Segment: tokens emitted from a checkpoint up to the next one
+    struct Segment
+    {
+        size_t offset;
+        PPTokenizer::Checkpoint state;
+        PPTokenBuffer::TokenList tokens;
+    };
+
+    void relex(size_t first, size_t offset, size_t removed, size_t inserted);
+    void reset();
+
+    string mSource;
+    vector<Segment> mSegments;
+    PPTokenBuffer mFresh;
+    PPTokenizer mTokenizer;
+    PPTokenizer::Checkpoint mInitial;
+    unsigned int mInterval;
+    size_t mLexed;
+};
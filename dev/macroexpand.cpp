@@ -0,0 +1,685 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "macrotable.h"
+#include "macroexpand.h"
+
+using namespace std;
+
+HideSets::HideSets()
+{
+    intern(nullptr, 0);
+}
+
+static uint64_t hashIds(const uint32_t* ids, size_t count)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < count; i++)
+        h = (h ^ ids[i]) * 0x100000001b3ULL;
+
+    return h;
+}
+
+uint32_t HideSets::intern(const uint32_t* ids, size_t count)
+{
+    uint64_t h = hashIds(ids, count);
+    auto range = mByHash.equal_range(h);
+
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const Span& set = mSets[it->second];
+
+        if (set.length == count &&
+                equal(ids, ids + count, mIds.data() + set.offset))
+            return it->second;
+    }
+
+    if (mIds.size() + count > UINT32_MAX || mSets.size() >= UINT32_MAX)
+        throw length_error("hide-set arena is full");
+
+    Span set;
+
+    set.offset = mIds.size();
+    set.length = count;
+
+    mIds.insert(mIds.end(), ids, ids + count);
+    mSets.push_back(set);
+    mByHash.insert(make_pair(h, mSets.size() - 1));
+
+    return mSets.size() - 1;
+}
+
+bool HideSets::contains(uint32_t set, uint32_t name) const
+{
+    const uint32_t* ids = mIds.data() + mSets[set].offset;
+
+    return binary_search(ids, ids + mSets[set].length, name);
+}
+
+uint32_t HideSets::add(uint32_t set, uint32_t name)
+{
+    auto it = mAdded.find(key(set, name));
+
+    if (it != mAdded.end())
+        return it->second;
+
+    const Span& members = mSets[set];
+    const uint32_t* ids = mIds.data() + members.offset;
+    const uint32_t* end = ids + members.length;
+    const uint32_t* at = lower_bound(ids, end, name);
+    uint32_t result = set;
+
+    if (at == end || *at != name)
+    {
+        mScratch.assign(ids, at);
+        mScratch.push_back(name);
+        mScratch.insert(mScratch.end(), at, end);
+        result = intern(mScratch.data(), mScratch.size());
+    }
+
+    mAdded[key(set, name)] = result;
+
+    return result;
+}
+
+uint32_t HideSets::unite(uint32_t a, uint32_t b)
+{
+    if (a == b || b == 0)
+        return a;
+
+    if (a == 0)
+        return b;
+
+    if (a > b)
+        swap(a, b);
+
+    auto it = mUnited.find(key(a, b));
+
+    if (it != mUnited.end())
+        return it->second;
+
+    const uint32_t* ids = mIds.data();
+
+    mScratch.clear();
+    set_union(ids + mSets[a].offset, ids + mSets[a].offset + mSets[a].length,
+        ids + mSets[b].offset, ids + mSets[b].offset + mSets[b].length,
+        back_inserter(mScratch));
+
+    uint32_t result = intern(mScratch.data(), mScratch.size());
+    mUnited[key(a, b)] = result;
+
+    return result;
+}
+
+uint32_t HideSets::intersect(uint32_t a, uint32_t b)
+{
+    if (a == b)
+        return a;
+
+    if (a == 0 || b == 0)
+        return 0;
+
+    if (a > b)
+        swap(a, b);
+
+    auto it = mIntersected.find(key(a, b));
+
+    if (it != mIntersected.end())
+        return it->second;
+
+    const uint32_t* ids = mIds.data();
+
+    mScratch.clear();
+    set_intersection(ids + mSets[a].offset,
+        ids + mSets[a].offset + mSets[a].length,
+        ids + mSets[b].offset, ids + mSets[b].offset + mSets[b].length,
+        back_inserter(mScratch));
+
+    uint32_t result = intern(mScratch.data(), mScratch.size());
+    mIntersected[key(a, b)] = result;
+
+    return result;
+}
+
+MacroTokenBuffer::MacroTokenBuffer(SpellingTable& spellings)
+    : mSpellings(spellings), mFlags(0)
+{}
+
+void MacroTokenBuffer::push(EPPTokenKind kind, const string& data)
+{
+    MacroToken token;
+
+    token.kind = kind;
+    token.flags = mFlags;
+    token.spelling = mSpellings.intern(data);
+    token.hideSet = 0;
+
+    mTokens.push_back(token);
+    mFlags = 0;
+}
+
+void MacroTokenBuffer::emit_whitespace_sequence()
+{
+    mFlags |= MT_SPACE_BEFORE;
+}
+
+void MacroTokenBuffer::emit_new_line()
+{
+    push(PPT_NEW_LINE, "\n");
+}
+
+void MacroTokenBuffer::emit_header_name(const string& data)
+{
+    push(PPT_HEADER_NAME, data);
+}
+
+void MacroTokenBuffer::emit_identifier(const string& data)
+{
+    push(PPT_IDENTIFIER, data);
+}
+
+void MacroTokenBuffer::emit_pp_number(const string& data)
+{
+    push(PPT_PP_NUMBER, data);
+}
+
+void MacroTokenBuffer::emit_character_literal(const string& data)
+{
+    push(PPT_CHARACTER_LITERAL, data);
+}
+
+void MacroTokenBuffer::emit_user_defined_character_literal(const string& data)
+{
+    push(PPT_USER_DEFINED_CHARACTER_LITERAL, data);
+}
+
+void MacroTokenBuffer::emit_string_literal(const string& data)
+{
+    push(PPT_STRING_LITERAL, data);
+}
+
+void MacroTokenBuffer::emit_user_defined_string_literal(const string& data)
+{
+    push(PPT_USER_DEFINED_STRING_LITERAL, data);
+}
+
+void MacroTokenBuffer::emit_preprocessing_op_or_punc(const string& data)
+{
+    push(PPT_PREPROCESSING_OP_OR_PUNC, data);
+}
+
+void MacroTokenBuffer::emit_non_whitespace_char(const string& data)
+{
+    push(PPT_NON_WHITESPACE_CHAR, data);
+}
+
+void MacroTokenBuffer::emit_error(const string& data, const string& message)
+{
+    throw runtime_error(message);
+}
+
+void MacroTokenBuffer::emit_eof()
+{}
+
+// Scratch: the buffers of one nesting of argument expansion
+struct MacroExpander::Scratch
+{
+    vector<MacroToken> pending;     // reversed, the next token is last
+    vector<MacroToken> arguments;   // tokens of the current invocation
+    vector<Span> spans;             // each argument in arguments
+    vector<MacroToken> expanded;    // arguments once macro-replaced
+    vector<Span> expandedSpans;     // offset UINT32_MAX until replaced
+    vector<MacroToken> result;
+};
+
+MacroExpander::MacroExpander(MacroTable& macros)
+    : mMacros(macros), mSpellings(macros.spellings())
+{
+    mLeftParen = mSpellings.intern("(");
+    mRightParen = mSpellings.intern(")");
+    mComma = mSpellings.intern(",");
+}
+
+MacroExpander::~MacroExpander()
+{}
+
+void MacroExpander::expand(const MacroToken* tokens, size_t count,
+    vector<MacroToken>& output)
+{
+    expand(tokens, count, output, 0);
+}
+
+void MacroExpander::expand(const MacroToken* tokens, size_t count,
+    vector<MacroToken>& output, size_t depth)
+{
+    while (mScratch.size() <= depth)
+        mScratch.emplace_back(new Scratch);
+
+    Scratch& scratch = *mScratch[depth];
+    vector<MacroToken>& pending = scratch.pending;
+
+    pending.clear();
+    for (size_t i = count; i-- > 0; )
+        pending.push_back(tokens[i]);
+
+    while (!pending.empty())
+    {
+        MacroToken token = pending.back();
+        pending.pop_back();
+
+        const MacroDefinition* macro = token.kind == PPT_IDENTIFIER ?
+            mMacros.find(token.spelling) : nullptr;
+
+        if (!macro || mHideSets.contains(token.hideSet, token.spelling))
+        {
+            output.push_back(token);
+            continue;
+        }
+
+        uint32_t hideSet;
+
+        if (macro->functionLike)
+        {
+            // The ( of an invocation may come after new-lines
+            size_t i = pending.size();
+
+            while (i > 0 && pending[i - 1].kind == PPT_NEW_LINE)
+                i--;
+
+            if (i == 0 || !isPunctuator(pending[i - 1], mLeftParen))
+            {
+                output.push_back(token);
+                continue;
+            }
+
+            pending.resize(i - 1);
+
+            MacroToken rightParen;
+
+            if (!collectArguments(scratch, *macro, token.spelling, rightParen))
+                throw runtime_error("macro " +
+                    mSpellings.spelling(token.spelling) +
+                    " given the wrong number of arguments");
+
+            hideSet = mHideSets.add(
+                mHideSets.intersect(token.hideSet, rightParen.hideSet),
+                token.spelling);
+        }
+        else
+            hideSet = mHideSets.add(token.hideSet, token.spelling);
+
+        substitute(scratch, *macro, token, hideSet, depth);
+    }
+}
+
+// Take the arguments of an invocation off the pending stack, up to and
+// including its ).  Returns false if their number doesn't match.
+bool MacroExpander::collectArguments(Scratch& scratch,
+    const MacroDefinition& macro, uint32_t name, MacroToken& rightParen)
+{
+    vector<MacroToken>& pending = scratch.pending;
+    Span argument;
+    size_t nesting = 0;
+    bool space = false;
+
+    scratch.arguments.clear();
+    scratch.spans.clear();
+    argument.offset = 0;
+
+    while (true)
+    {
+        if (pending.empty())
+            throw runtime_error("unterminated invocation of macro " +
+                mSpellings.spelling(name));
+
+        MacroToken token = pending.back();
+        pending.pop_back();
+
+        if (token.kind == PPT_NEW_LINE)
+        {
+            space = true;
+            continue;
+        }
+
+        if (space)
+        {
+            token.flags |= MT_SPACE_BEFORE;
+            space = false;
+        }
+
+        if (isPunctuator(token, mLeftParen))
+            nesting++;
+        else if (isPunctuator(token, mRightParen))
+        {
+            if (nesting == 0)
+            {
+                rightParen = token;
+                break;
+            }
+
+            nesting--;
+        }
+        else if (isPunctuator(token, mComma) && nesting == 0 &&
+                !(macro.variadic && scratch.spans.size() + 1 == macro.parameters))
+        {
+            argument.length = scratch.arguments.size() - argument.offset;
+            scratch.spans.push_back(argument);
+            argument.offset = scratch.arguments.size();
+            continue;
+        }
+
+        scratch.arguments.push_back(token);
+    }
+
+    argument.length = scratch.arguments.size() - argument.offset;
+    scratch.spans.push_back(argument);
+
+    // f() passes one empty argument, which is none at all for a macro
+    // without parameters
+    if (macro.parameters == 0 && scratch.spans.size() == 1 &&
+            argument.length == 0)
+        scratch.spans.clear();
+
+    // The variable arguments may be left out entirely
+    if (macro.variadic && scratch.spans.size() + 1 == macro.parameters)
+    {
+        argument.offset = scratch.arguments.size();
+        argument.length = 0;
+        scratch.spans.push_back(argument);
+    }
+
+    return scratch.spans.size() == macro.parameters;
+}
+
+// Replace an invocation by its replacement list with the arguments
+// substituted, and push the result back for rescanning
+void MacroExpander::substitute(Scratch& scratch, const MacroDefinition& macro,
+    const MacroToken& name, uint32_t hideSet, size_t depth)
+{
+    const MacroToken* replacement = mMacros.replacement(macro);
+    size_t length = macro.replacement.length;
+    vector<MacroToken>& result = scratch.result;
+    Span unexpanded;
+
+    unexpanded.offset = UINT32_MAX;
+    unexpanded.length = 0;
+
+    result.clear();
+    scratch.expanded.clear();
+    scratch.expandedSpans.assign(scratch.spans.size(), unexpanded);
+
+    MacroToken placemarker;
+
+    placemarker.kind = MT_PLACEMARKER;
+    placemarker.flags = 0;
+    placemarker.spelling = NoSpelling;
+    placemarker.hideSet = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        const MacroToken& token = replacement[i];
+        bool pasteNext = i + 1 < length && replacement[i + 1].kind == MT_PASTE;
+
+        if (token.kind == MT_STRINGIZE)
+        {
+            const Span& argument = scratch.spans[replacement[++i].spelling];
+            MacroToken literal = stringize(
+                scratch.arguments.data() + argument.offset, argument.length);
+
+            literal.flags = token.flags;
+            result.push_back(literal);
+        }
+        else if (token.kind == MT_PARAMETER && pasteNext)
+        {
+            // An operand of ## is substituted without being replaced
+            const Span& argument = scratch.spans[token.spelling];
+            const MacroToken* tokens = scratch.arguments.data() + argument.offset;
+
+            if (argument.length == 0)
+                result.push_back(placemarker);
+            else
+            {
+                result.insert(result.end(), tokens, tokens + argument.length);
+                result[result.size() - argument.length].flags = token.flags;
+            }
+        }
+        else if (token.kind == MT_PARAMETER)
+        {
+            const Span& argument = scratch.spans[token.spelling];
+            Span& expanded = scratch.expandedSpans[token.spelling];
+
+            // Each argument is replaced once however often it is used
+            if (expanded.offset == UINT32_MAX)
+            {
+                expanded.offset = scratch.expanded.size();
+                expand(scratch.arguments.data() + argument.offset,
+                    argument.length, scratch.expanded, depth + 1);
+                expanded.length = scratch.expanded.size() - expanded.offset;
+            }
+
+            const MacroToken* tokens = scratch.expanded.data() + expanded.offset;
+
+            if (expanded.length > 0)
+            {
+                result.insert(result.end(), tokens, tokens + expanded.length);
+                result[result.size() - expanded.length].flags = token.flags;
+            }
+        }
+        else if (token.kind == MT_PASTE)
+        {
+            // The left operand is already the last token of the result
+            MacroToken left = result.back();
+            const MacroToken& right = replacement[++i];
+            const MacroToken* rest = nullptr;
+            size_t restLength = 0;
+            MacroToken first = right;
+
+            result.pop_back();
+
+            if (right.kind == MT_PARAMETER)
+            {
+                const Span& argument = scratch.spans[right.spelling];
+
+                if (argument.length == 0)
+                    first = placemarker;
+                else
+                {
+                    first = scratch.arguments[argument.offset];
+                    rest = scratch.arguments.data() + argument.offset + 1;
+                    restLength = argument.length - 1;
+                }
+            }
+            else if (right.kind == MT_STRINGIZE)
+            {
+                const Span& argument = scratch.spans[replacement[++i].spelling];
+
+                first = stringize(scratch.arguments.data() + argument.offset,
+                    argument.length);
+            }
+
+            result.push_back(paste(left, first));
+            result.insert(result.end(), rest, rest + restLength);
+        }
+        else
+            result.push_back(token);
+    }
+
+    // Rescan the result with the rest of the input, every token hidden
+    // from the macros that produced it
+    vector<MacroToken>& pending = scratch.pending;
+    size_t end = pending.size();
+
+    for (size_t i = result.size(); i-- > 0; )
+    {
+        MacroToken token = result[i];
+
+        if (token.kind == MT_PLACEMARKER)
+            continue;
+
+        token.hideSet = mHideSets.unite(token.hideSet, hideSet);
+        pending.push_back(token);
+    }
+
+    // The first token takes the place of the macro name
+    if (pending.size() > end)
+    {
+        MacroToken& leading = pending.back();
+
+        leading.flags = (leading.flags & ~MT_SPACE_BEFORE) |
+            (name.flags & MT_SPACE_BEFORE);
+    }
+}
+
+MacroToken MacroExpander::stringize(const MacroToken* tokens, size_t count)
+{
+    mText.assign(1, '"');
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* data = mSpellings.data(tokens[i].spelling);
+        size_t length = mSpellings.length(tokens[i].spelling);
+        bool literal = tokens[i].kind == PPT_CHARACTER_LITERAL ||
+            tokens[i].kind == PPT_USER_DEFINED_CHARACTER_LITERAL ||
+            tokens[i].kind == PPT_STRING_LITERAL ||
+            tokens[i].kind == PPT_USER_DEFINED_STRING_LITERAL;
+
+        if (i > 0 && (tokens[i].flags & MT_SPACE_BEFORE))
+            mText += ' ';
+
+        for (size_t j = 0; j < length; j++)
+        {
+            if (literal && (data[j] == '"' || data[j] == '\\'))
+                mText += '\\';
+
+            mText += data[j];
+        }
+    }
+
+    mText += '"';
+
+    MacroToken token;
+
+    token.kind = PPT_STRING_LITERAL;
+    token.flags = 0;
+    token.spelling = mSpellings.intern(mText);
+    token.hideSet = 0;
+
+    return token;
+}
+
+static bool IsIdentifierChars(const char* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        if (!isalnum((unsigned char)data[i]) && data[i] != '_')
+            return false;
+
+    return true;
+}
+
+// Paste two tokens into one.  Identifiers and pp-numbers, which most
+// pastes are made of, are classified directly, anything else is lexed
+// again.
+MacroToken MacroExpander::paste(const MacroToken& left, const MacroToken& right)
+{
+    if (left.kind == MT_PLACEMARKER)
+    {
+        MacroToken token = right;
+
+        token.flags = left.flags;
+        return token;
+    }
+
+    if (right.kind == MT_PLACEMARKER)
+        return left;
+
+    const char* data = mSpellings.data(right.spelling);
+    size_t length = mSpellings.length(right.spelling);
+    MacroToken token;
+
+    mText.assign(mSpellings.data(left.spelling), mSpellings.length(left.spelling));
+    mText.append(data, length);
+
+    token.flags = left.flags;
+    token.hideSet = mHideSets.intersect(left.hideSet, right.hideSet);
+
+    if (left.kind == PPT_IDENTIFIER && (right.kind == PPT_IDENTIFIER ||
+            (right.kind == PPT_PP_NUMBER && IsIdentifierChars(data, length))))
+        token.kind = PPT_IDENTIFIER;
+    else if (left.kind == PPT_PP_NUMBER && (right.kind == PPT_IDENTIFIER ||
+            right.kind == PPT_PP_NUMBER))
+        token.kind = PPT_PP_NUMBER;
+    else
+    {
+        PPTokenBuffer buffer;
+        size_t tokens = 0;
+
+        try
+        {
+            PPTokenizer tokenizer(buffer);
+
+            tokenizer.process(mText.data(), mText.length());
+            tokenizer.process(EndOfFile);
+        }
+        catch (exception&)
+        {
+            buffer.tokens().clear();
+        }
+
+        for (const PPTokenRecord& record : buffer.tokens())
+        {
+            if (record.kind == PPT_NEW_LINE || record.kind == PPT_EOF)
+                continue;
+
+            token.kind = record.kind;
+            tokens++;
+
+            if (record.kind == PPT_WHITESPACE_SEQUENCE ||
+                    record.kind == PPT_ERROR || record.data != mText)
+                tokens = 2;
+        }
+
+        if (tokens != 1)
+            throw runtime_error("pasting " +
+                mSpellings.spelling(left.spelling) + " and " +
+                mSpellings.spelling(right.spelling) +
+                " does not give a valid preprocessing token");
+    }
+
+    token.spelling = mSpellings.intern(mText);
+
+    return token;
+}
+
+string MacroExpander::spell(const MacroToken* tokens, size_t count) const
+{
+    string text;
+    bool lineStart = true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (tokens[i].kind == MT_PLACEMARKER)
+            continue;
+
+        if (tokens[i].kind == PPT_NEW_LINE)
+        {
+            text += '\n';
+            lineStart = true;
+            continue;
+        }
+
+        if (!lineStart && (tokens[i].flags & MT_SPACE_BEFORE))
+            text += ' ';
+
+        text.append(mSpellings.data(tokens[i].spelling),
+            mSpellings.length(tokens[i].spelling));
+        lineStart = false;
+    }
+
+    return text;
+}
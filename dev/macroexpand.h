@@ -0,0 +1,127 @@
+/// Macro replacement over interned tokens
+///
+/// @file macroexpand.h
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "pp.h"
+#include "macrotable.h"
+
+using namespace std;
+
+// HideSets: the sets of macro names a token may no longer be expanded by.
+// Each set is interned as a sorted vector of spelling IDs and known by its
+// index, 0 being the empty set.  Results of the set operations are
+// memoized, so expansions that repeat earlier ones allocate nothing.
+class HideSets
+{
+public:
+    HideSets();
+
+    bool contains(uint32_t set, uint32_t name) const;
+
+    uint32_t add(uint32_t set, uint32_t name);
+    uint32_t unite(uint32_t a, uint32_t b);
+    uint32_t intersect(uint32_t a, uint32_t b);
+
+    // Number of different sets seen
+    size_t size() const { return mSets.size(); }
+
+protected:
+    uint32_t intern(const uint32_t* ids, size_t count);
+
+    static uint64_t key(uint32_t a, uint32_t b)
+    {
+        return (uint64_t)a << 32 | b;
+    }
+
+    vector<uint32_t> mIds;      // members of every set back to back
+    vector<Span> mSets;         // offset and length count IDs
+    unordered_multimap<uint64_t, uint32_t> mByHash;
+    unordered_map<uint64_t, uint32_t> mAdded, mUnited, mIntersected;
+    vector<uint32_t> mScratch;
+};
+
+// MacroTokenBuffer: collects emitted pp-tokens as MacroTokens, interning
+// their spellings.  Whitespace sets MT_SPACE_BEFORE on the next token and
+// new-lines are kept as PPT_NEW_LINE tokens.
+class MacroTokenBuffer : public IPPTokenStream
+{
+public:
+    MacroTokenBuffer(SpellingTable& spellings);
+
+    void emit_whitespace_sequence();
+    void emit_new_line();
+    void emit_header_name(const string& data);
+    void emit_identifier(const string& data);
+    void emit_pp_number(const string& data);
+    void emit_character_literal(const string& data);
+    void emit_user_defined_character_literal(const string& data);
+    void emit_string_literal(const string& data);
+    void emit_user_defined_string_literal(const string& data);
+    void emit_preprocessing_op_or_punc(const string& data);
+    void emit_non_whitespace_char(const string& data);
+    void emit_error(const string& data, const string& message);
+    void emit_eof();
+
+    vector<MacroToken>& tokens() { return mTokens; }
+    const vector<MacroToken>& tokens() const { return mTokens; }
+
+protected:
+    void push(EPPTokenKind kind, const string& data);
+
+    SpellingTable& mSpellings;
+    vector<MacroToken> mTokens;
+    uint8_t mFlags;
+};
+
+// MacroExpander: macro replacement of token sequences against a MacroTable
+// by the hide-set algorithm.  Tokens waiting to be rescanned sit reversed
+// on a stack, and each nesting of argument expansion has scratch buffers
+// of its own that keep their capacity between calls.
+class MacroExpander
+{
+public:
+    MacroExpander(MacroTable& macros);
+    ~MacroExpander();
+
+    // Macro-replace tokens and append the result to output.  New-line
+    // tokens count as whitespace inside macro arguments.
+    void expand(const MacroToken* tokens, size_t count,
+        vector<MacroToken>& output);
+
+    // Spelling of a token sequence as it would be written out
+    string spell(const MacroToken* tokens, size_t count) const;
+
+    HideSets& hideSets() { return mHideSets; }
+
+protected:
+    struct Scratch;
+
+    void expand(const MacroToken* tokens, size_t count,
+        vector<MacroToken>& output, size_t depth);
+    bool collectArguments(Scratch& scratch, const MacroDefinition& macro,
+        uint32_t name, MacroToken& rightParen);
+    void substitute(Scratch& scratch, const MacroDefinition& macro,
+        const MacroToken& name, uint32_t hideSet, size_t depth);
+    MacroToken stringize(const MacroToken* tokens, size_t count);
+    MacroToken paste(const MacroToken& left, const MacroToken& right);
+    bool isPunctuator(const MacroToken& token, uint32_t spelling) const
+    {
+        return token.kind == PPT_PREPROCESSING_OP_OR_PUNC &&
+            token.spelling == spelling;
+    }
+
+    MacroTable& mMacros;
+    SpellingTable& mSpellings;
+    HideSets mHideSets;
+    vector<unique_ptr<Scratch>> mScratch;   // one for each depth
+    string mText;                           // for # and ##
+    uint32_t mLeftParen, mRightParen, mComma;
+};
@@ -0,0 +1,392 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "macrotable.h"
+
+using namespace std;
+
+static const size_t InitialSpellingSlots = 256;
+static const size_t InitialFilterMacros = 256;
+
+SpellingTable::SpellingTable()
+    : mSlots(InitialSpellingSlots)
+{
+    for (Slot& slot : mSlots)
+        slot.id = NoSpelling;
+}
+
+// FNV-1a, identifiers are too short for anything wider to pay off
+uint64_t SpellingTable::hash(const char* data, size_t length)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+
+    return h;
+}
+
+// The filter sets two bits taken from the high half of the hash, the slot
+// comes from the low half
+static void filterBits(uint64_t h, size_t bits, size_t& a, size_t& b)
+{
+    a = (h >> 32) & (bits - 1);
+    b = ((h >> 32) * 0x9e3779b97f4a7c15ULL >> 32) & (bits - 1);
+}
+
+// Find the slot of a spelling, or the empty slot where it belongs
+const SpellingTable::Slot* SpellingTable::find(const char* data,
+    size_t length, uint64_t h) const
+{
+    size_t mask = mSlots.size() - 1;
+
+    for (size_t i = h & mask; ; i = (i + 1) & mask)
+    {
+        const Slot& slot = mSlots[i];
+
+        if (slot.id == NoSpelling)
+            return &slot;
+
+        if (slot.hash == (uint32_t)h && mSpans[slot.id].length == length &&
+                memcmp(mArena.data() + mSpans[slot.id].offset, data,
+                    length) == 0)
+            return &slot;
+    }
+}
+
+void SpellingTable::grow()
+{
+    vector<Slot> slots(mSlots.size() * 2);
+
+    for (Slot& slot : slots)
+        slot.id = NoSpelling;
+
+    mSlots.swap(slots);
+
+    size_t mask = mSlots.size() - 1;
+
+    // Every spelling is different so each one just takes the first empty
+    // slot
+    for (const Slot& slot : slots)
+    {
+        if (slot.id == NoSpelling)
+            continue;
+
+        size_t i = slot.hash & mask;
+        while (mSlots[i].id != NoSpelling)
+            i = (i + 1) & mask;
+
+        mSlots[i] = slot;
+    }
+}
+
+uint32_t SpellingTable::intern(const char* data, size_t length)
+{
+    uint64_t h = hash(data, length);
+    const Slot* found = find(data, length, h);
+
+    if (found->id != NoSpelling)
+        return found->id;
+
+    if ((mSpans.size() + 1) * 2 > mSlots.size())
+        grow();
+
+    if (mArena.length() + length > UINT32_MAX)
+        throw length_error("spelling arena is full");
+
+    Slot* slot = const_cast<Slot*>(find(data, length, h));
+    Span span;
+
+    span.offset = mArena.length();
+    span.length = length;
+
+    slot->hash = h;
+    slot->id = mSpans.size();
+
+    mArena.append(data, length);
+    mSpans.push_back(span);
+
+    return slot->id;
+}
+
+uint32_t SpellingTable::find(const char* data, size_t length) const
+{
+    return find(data, length, hash(data, length))->id;
+}
+
+MacroTable::MacroTable()
+    : mFilter(InitialFilterMacros / 8), mDefined(0)
+{
+    mLeftParen = mSpellings.intern("(");
+    mRightParen = mSpellings.intern(")");
+    mComma = mSpellings.intern(",");
+    mEllipsis = mSpellings.intern("...");
+    mHash = mSpellings.intern("#");
+    mHashAlt = mSpellings.intern("%:");
+    mHashHash = mSpellings.intern("##");
+    mHashHashAlt = mSpellings.intern("%:%:");
+    mVaArgs = mSpellings.intern("__VA_ARGS__");
+}
+
+MacroDefinition& MacroTable::slot(uint32_t name)
+{
+    if (name >= mMacros.size())
+        mMacros.resize(mSpellings.size(), MacroDefinition());
+
+    return mMacros[name];
+}
+
+void MacroTable::addToFilter(uint64_t h)
+{
+    size_t a, b;
+
+    filterBits(h, mFilter.size() * 64, a, b);
+
+    mFilter[a / 64] |= 1ULL << (a % 64);
+    mFilter[b / 64] |= 1ULL << (b % 64);
+}
+
+bool MacroTable::inFilter(uint64_t h) const
+{
+    size_t a, b;
+
+    filterBits(h, mFilter.size() * 64, a, b);
+
+    return (mFilter[a / 64] >> (a % 64) & 1) &&
+        (mFilter[b / 64] >> (b % 64) & 1);
+}
+
+// Count a macro that was just defined and add its name to the filter.
+// undefine leaves the bits of a name set, so when the filter runs out of
+// room it is rebuilt twice as large from the names still defined.
+void MacroTable::markDefined(uint32_t name)
+{
+    mDefined++;
+
+    if (mDefined * 8 <= mFilter.size() * 64)
+    {
+        addToFilter(SpellingTable::hash(mSpellings.data(name),
+            mSpellings.length(name)));
+        return;
+    }
+
+    mFilter.assign(mFilter.size() * 2, 0);
+
+    for (uint32_t id = 0; id < mMacros.size(); id++)
+    {
+        if (mMacros[id].defined)
+            addToFilter(SpellingTable::hash(mSpellings.data(id),
+                mSpellings.length(id)));
+    }
+}
+
+void MacroTable::define(const string& name)
+{
+    uint32_t id = mSpellings.intern(name);
+    MacroDefinition& macro = slot(id);
+
+    if (macro.defined && (macro.functionLike ||
+            macro.replacement.length != 0))
+        throw runtime_error("macro redefined differently: " + name);
+
+    if (!macro.defined)
+    {
+        macro = MacroDefinition();
+        macro.defined = true;
+        markDefined(id);
+    }
+}
+
+void MacroTable::define(const MacroToken* tokens, size_t count)
+{
+    if (count == 0 || tokens[0].kind != PPT_IDENTIFIER)
+        throw runtime_error("expected macro name after #define");
+
+    uint32_t name = tokens[0].spelling;
+    MacroDefinition macro = MacroDefinition();
+    vector<uint32_t> parameters;
+    size_t i = 1;
+
+    macro.defined = true;
+
+    // A function-like macro has its ( right after the name
+    if (i < count && tokens[i].spelling == mLeftParen &&
+            tokens[i].kind == PPT_PREPROCESSING_OP_OR_PUNC &&
+            !(tokens[i].flags & MT_SPACE_BEFORE))
+    {
+        macro.functionLike = true;
+        i++;
+
+        while (true)
+        {
+            if (i >= count)
+                throw runtime_error("unterminated macro parameter list");
+
+            const MacroToken& token = tokens[i++];
+
+            if (token.kind == PPT_PREPROCESSING_OP_OR_PUNC &&
+                    token.spelling == mRightParen && parameters.empty())
+                break;
+
+            if (token.kind == PPT_PREPROCESSING_OP_OR_PUNC &&
+                    token.spelling == mEllipsis)
+            {
+                macro.variadic = true;
+                parameters.push_back(mVaArgs);
+            }
+            else if (token.kind == PPT_IDENTIFIER && token.spelling != mVaArgs)
+            {
+                for (uint32_t parameter : parameters)
+                    if (parameter == token.spelling)
+                        throw runtime_error("duplicate macro parameter " +
+                            mSpellings.spelling(token.spelling));
+
+                parameters.push_back(token.spelling);
+            }
+            else
+                throw runtime_error("expected macro parameter");
+
+            if (i < count && isPunctuator(tokens[i], mRightParen, mRightParen))
+            {
+                i++;
+                break;
+            }
+
+            if (macro.variadic || i >= count ||
+                    !isPunctuator(tokens[i], mComma, mComma))
+                throw runtime_error("expected , or ) in macro parameter list");
+
+            i++;
+        }
+
+        macro.parameters = parameters.size();
+    }
+
+    size_t start = mTokens.size();
+    size_t offset = start + parameters.size();
+
+    if (offset + (count - i) > UINT32_MAX)
+        throw length_error("macro replacement arena is full");
+
+    // A bad replacement list leaves nothing behind in the arena
+    try
+    {
+        // The parameter names go right before the replacement list, only a
+        // redefinition looks at them
+        for (uint32_t parameter : parameters)
+        {
+            MacroToken token = MacroToken();
+
+            token.kind = PPT_IDENTIFIER;
+            token.spelling = parameter;
+            mTokens.push_back(token);
+        }
+
+        for (; i < count; i++)
+        {
+            MacroToken token = tokens[i];
+
+            token.hideSet = 0;
+
+            if (token.kind == PPT_IDENTIFIER)
+            {
+                if (token.spelling == mVaArgs && !macro.variadic)
+                    throw runtime_error("__VA_ARGS__ outside a variadic macro");
+
+                for (size_t p = 0; p < parameters.size(); p++)
+                    if (parameters[p] == token.spelling)
+                    {
+                        token.kind = MT_PARAMETER;
+                        token.spelling = p;
+                        break;
+                    }
+            }
+            else if (isPunctuator(token, mHashHash, mHashHashAlt))
+                token.kind = MT_PASTE;
+            else if (macro.functionLike && isPunctuator(token, mHash, mHashAlt))
+                token.kind = MT_STRINGIZE;
+
+            mTokens.push_back(token);
+        }
+
+        size_t length = mTokens.size() - offset;
+        const MacroToken* replacement = mTokens.data() + offset;
+
+        if (length > 0 && (replacement[0].kind == MT_PASTE ||
+                replacement[length - 1].kind == MT_PASTE))
+            throw runtime_error("## at either end of a replacement list");
+
+        for (size_t j = 0; j < length; j++)
+            if (replacement[j].kind == MT_STRINGIZE && (j + 1 == length ||
+                    replacement[j + 1].kind != MT_PARAMETER))
+                throw runtime_error("# is not followed by a macro parameter");
+    }
+    catch (...)
+    {
+        mTokens.resize(start);
+        throw;
+    }
+
+    macro.replacement.offset = offset;
+    macro.replacement.length = mTokens.size() - offset;
+
+    MacroToken* replacement = mTokens.data() + offset;
+    size_t length = macro.replacement.length;
+
+    // Leading whitespace is not part of the replacement list
+    if (length > 0)
+        replacement[0].flags &= ~MT_SPACE_BEFORE;
+
+    MacroDefinition& current = slot(name);
+
+    if (current.defined)
+    {
+        // A redefinition must spell the same, down to the parameter names
+        // and where whitespace is
+        bool same = current.functionLike == macro.functionLike &&
+            current.variadic == macro.variadic &&
+            current.parameters == macro.parameters &&
+            current.replacement.length == macro.replacement.length;
+
+        const MacroToken* old = mTokens.data() + current.replacement.offset -
+            current.parameters;
+        const MacroToken* now = replacement - macro.parameters;
+
+        for (size_t j = 0; same && j < macro.parameters + length; j++)
+            same = old[j].kind == now[j].kind &&
+                old[j].spelling == now[j].spelling &&
+                old[j].flags == now[j].flags;
+
+        mTokens.resize(start);
+
+        if (!same)
+            throw runtime_error("macro redefined differently: " +
+                mSpellings.spelling(name));
+
+        return;
+    }
+
+    current = macro;
+    markDefined(name);
+}
+
+void MacroTable::undefine(const string& name)
+{
+    uint32_t id = mSpellings.find(name);
+
+    if (id < mMacros.size() && mMacros[id].defined)
+    {
+        mMacros[id].defined = false;
+        mDefined--;
+    }
+}
+
+bool MacroTable::isDefined(const string& name) const
+{
+    if (!inFilter(SpellingTable::hash(name.data(), name.length())))
+        return false;
+
+    return find(mSpellings.find(name)) != nullptr;
+}
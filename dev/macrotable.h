@@ -0,0 +1,167 @@
+/// Macro definitions keyed by interned identifiers
+///
+/// @file macrotable.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ppbuffer.h"
+#include "postbuffer.h"
+
+using namespace std;
+
+class IMacroTable
+{
+public:
+    virtual ~IMacroTable() {}
+
+    // Whether a macro called name is defined
+    virtual bool isDefined(const string& name) const = 0;
+
+    // Whether it isn't known if a macro called name is defined, as when it
+    // was defined or undefined in a group that may have been skipped
+    virtual bool isUncertain(const string& name) const { return false; }
+};
+
+// ID of a spelling that was never interned
+static const uint32_t NoSpelling = UINT32_MAX;
+
+// SpellingTable: the spellings of pp-tokens interned in one arena, each
+// known by a dense ID in the order they were first seen.  Spellings are
+// found through an open-addressing hash table.
+class SpellingTable
+{
+public:
+    SpellingTable();
+
+    uint32_t intern(const char* data, size_t length);
+    uint32_t intern(const string& s) { return intern(s.data(), s.length()); }
+
+    // ID of a spelling, NoSpelling if it was never interned
+    uint32_t find(const char* data, size_t length) const;
+    uint32_t find(const string& s) const { return find(s.data(), s.length()); }
+
+    const char* data(uint32_t id) const { return mArena.data() + mSpans[id].offset; }
+    size_t length(uint32_t id) const { return mSpans[id].length; }
+    string spelling(uint32_t id) const { return string(data(id), length(id)); }
+
+    // Number of spellings interned
+    size_t size() const { return mSpans.size(); }
+
+    static uint64_t hash(const char* data, size_t length);
+
+protected:
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t id;        // NoSpelling when the slot is empty
+    };
+
+    const Slot* find(const char* data, size_t length, uint64_t h) const;
+    void grow();
+
+    vector<Slot> mSlots;        // power of two, at most half used
+    vector<Span> mSpans;        // spelling of each ID in mArena
+    string mArena;
+};
+
+// Kinds of tokens in replacement lists besides the EPPTokenKind ones
+enum EMacroTokenKind
+{
+    MT_PARAMETER = PPT_EOF + 1,     // spelling is the parameter index
+    MT_STRINGIZE,                   // # applied to the parameter after it
+    MT_PASTE,                       // ## between its neighbours
+    MT_PLACEMARKER                  // an empty argument while pasting
+};
+
+// Flags of a MacroToken
+enum
+{
+    MT_SPACE_BEFORE = 1     // whitespace came before the token
+};
+
+// MacroToken: a pp-token as macro expansion sees it.  Whitespace is only
+// kept as a flag on the token after it.
+struct MacroToken
+{
+    uint8_t kind;           // EPPTokenKind or EMacroTokenKind
+    uint8_t flags;
+    uint32_t spelling;      // SpellingTable ID
+    uint32_t hideSet;       // HideSets ID, 0 is the empty set
+};
+
+// MacroDefinition: replacement is a range of tokens in the arena of the
+// table that holds the definition
+struct MacroDefinition
+{
+    bool defined;
+    bool functionLike;
+    bool variadic;          // the last parameter is __VA_ARGS__
+    uint32_t parameters;
+    Span replacement;       // offset and length count tokens
+};
+
+// MacroTable: macro definitions indexed by the spelling ID of their name.
+// Replacement lists are stored back to back in one token arena, with
+// parameters already replaced by their index.  Every identifier expansion
+// sees is interned, so a Bloom filter over the names of the defined macros
+// answers most isDefined lookups of other names without probing.
+class MacroTable : public IMacroTable
+{
+public:
+    MacroTable();
+
+    // Define name as an empty object-like macro
+    void define(const string& name);
+
+    // Define a macro from the tokens of a #define directive after `define`.
+    // Redefining a macro differently is an error.
+    void define(const MacroToken* tokens, size_t count);
+
+    void undefine(const string& name);
+    bool isDefined(const string& name) const;
+
+    // Definition of the macro called name, nullptr if there is none
+    const MacroDefinition* find(uint32_t name) const
+    {
+        return name < mMacros.size() && mMacros[name].defined ?
+            &mMacros[name] : nullptr;
+    }
+
+    const MacroToken* replacement(const MacroDefinition& macro) const
+    {
+        return mTokens.data() + macro.replacement.offset;
+    }
+
+    SpellingTable& spellings() { return mSpellings; }
+    const SpellingTable& spellings() const { return mSpellings; }
+
+    // Number of macros defined
+    size_t size() const { return mDefined; }
+
+protected:
+    bool isPunctuator(const MacroToken& token, uint32_t a, uint32_t b) const
+    {
+        return token.kind == PPT_PREPROCESSING_OP_OR_PUNC &&
+            (token.spelling == a || token.spelling == b);
+    }
+
+    MacroDefinition& slot(uint32_t name);
+    void markDefined(uint32_t name);
+    void addToFilter(uint64_t h);
+    bool inFilter(uint64_t h) const;
+
+    SpellingTable mSpellings;
+    vector<uint64_t> mFilter;   // 8 bits for every macro there is room for
+    vector<MacroDefinition> mMacros;
+    vector<MacroToken> mTokens;
+    size_t mDefined;
+
+    // Spellings define() looks for
+    uint32_t mLeftParen, mRightParen, mComma, mEllipsis;
+    uint32_t mHash, mHashAlt, mHashHash, mHashHashAlt;
+    uint32_t mVaArgs;
+};
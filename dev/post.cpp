@@ -13,6 +13,8 @@
 #include <cstdint>
 #include <climits>
 #include <cfloat>
+#include <cmath>
+#include <limits>
 #include <map>
 
 #include "token.h"
@@ -45,176 +47,267 @@ template<> constexpr EFundamentalType FundamentalTypeOf<long double>() { return
 template<> constexpr EFundamentalType FundamentalTypeOf<void>() { return FT_VOID; }
 template<> constexpr EFundamentalType FundamentalTypeOf<nullptr_t>() { return FT_NULLPTR_T; }
 
-// StringToETokenTypeMap map of `simple` `preprocessing-tokens` to ETokenType
-const unordered_map<string, ETokenType> StringToTokenTypeMap =
+// Simple tokens are found through a perfect hash of their length and their
+// first, middle and last characters.  The multiplier was searched for so
+// that no two spellings share a slot, which is checked below.
+constexpr uint32_t SimpleTokenHashMultiplier = 0xa4a75a93;
+constexpr unsigned int SimpleTokenHashBits = 10;
+
+constexpr unsigned int simpleTokenHash(const char* s, size_t length)
+{
+    return (uint32_t)(((uint32_t)(unsigned char)s[0] |
+        (uint32_t)(unsigned char)s[length / 2] << 8 |
+        (uint32_t)(unsigned char)s[length - 1] << 16 |
+        (uint32_t)length << 24) * SimpleTokenHashMultiplier) >>
+        (32 - SimpleTokenHashBits);
+}
+
+// SimpleToken: spelling of a `simple` `preprocessing-token` and its ETokenType
+struct SimpleToken
+{
+    const char* spelling;
+    size_t length;
+    ETokenType type;
+    unsigned int hash;
+};
+
+#define SIMPLE_TOKEN(spelling, type) {spelling, sizeof(spelling) - 1, type, \
+    simpleTokenHash(spelling, sizeof(spelling) - 1)}
+
+// SimpleTokens: table of `simple` `preprocessing-tokens` and their ETokenType
+constexpr SimpleToken SimpleTokens[] =
 {
     // keywords
-    {"alignas", KW_ALIGNAS},
-    {"alignof", KW_ALIGNOF},
-    {"asm", KW_ASM},
-    {"auto", KW_AUTO},
-    {"bool", KW_BOOL},
-    {"break", KW_BREAK},
-    {"case", KW_CASE},
-    {"catch", KW_CATCH},
-    {"char", KW_CHAR},
-    {"char16_t", KW_CHAR16_T},
-    {"char32_t", KW_CHAR32_T},
-    {"class", KW_CLASS},
-    {"const", KW_CONST},
-    {"constexpr", KW_CONSTEXPR},
-    {"const_cast", KW_CONST_CAST},
-    {"continue", KW_CONTINUE},
-    {"decltype", KW_DECLTYPE},
-    {"default", KW_DEFAULT},
-    {"delete", KW_DELETE},
-    {"do", KW_DO},
-    {"double", KW_DOUBLE},
-    {"dynamic_cast", KW_DYNAMIC_CAST},
-    {"else", KW_ELSE},
-    {"enum", KW_ENUM},
-    {"explicit", KW_EXPLICIT},
-    {"export", KW_EXPORT},
-    {"extern", KW_EXTERN},
-    {"false", KW_FALSE},
-    {"float", KW_FLOAT},
-    {"for", KW_FOR},
-    {"friend", KW_FRIEND},
-    {"goto", KW_GOTO},
-    {"if", KW_IF},
-    {"inline", KW_INLINE},
-    {"int", KW_INT},
-    {"long", KW_LONG},
-    {"mutable", KW_MUTABLE},
-    {"namespace", KW_NAMESPACE},
-    {"new", KW_NEW},
-    {"noexcept", KW_NOEXCEPT},
-    {"nullptr", KW_NULLPTR},
-    {"operator", KW_OPERATOR},
-    {"private", KW_PRIVATE},
-    {"protected", KW_PROTECTED},
-    {"public", KW_PUBLIC},
-    {"register", KW_REGISTER},
-    {"reinterpret_cast", KW_REINTERPET_CAST},
-    {"return", KW_RETURN},
-    {"short", KW_SHORT},
-    {"signed", KW_SIGNED},
-    {"sizeof", KW_SIZEOF},
-    {"static", KW_STATIC},
-    {"static_assert", KW_STATIC_ASSERT},
-    {"static_cast", KW_STATIC_CAST},
-    {"struct", KW_STRUCT},
-    {"switch", KW_SWITCH},
-    {"template", KW_TEMPLATE},
-    {"this", KW_THIS},
-    {"thread_local", KW_THREAD_LOCAL},
-    {"throw", KW_THROW},
-    {"true", KW_TRUE},
-    {"try", KW_TRY},
-    {"typedef", KW_TYPEDEF},
-    {"typeid", KW_TYPEID},
-    {"typename", KW_TYPENAME},
-    {"union", KW_UNION},
-    {"unsigned", KW_UNSIGNED},
-    {"using", KW_USING},
-    {"virtual", KW_VIRTUAL},
-    {"void", KW_VOID},
-    {"volatile", KW_VOLATILE},
-    {"wchar_t", KW_WCHAR_T},
-    {"while", KW_WHILE},
+    SIMPLE_TOKEN("alignas", KW_ALIGNAS),
+    SIMPLE_TOKEN("alignof", KW_ALIGNOF),
+    SIMPLE_TOKEN("asm", KW_ASM),
+    SIMPLE_TOKEN("auto", KW_AUTO),
+    SIMPLE_TOKEN("bool", KW_BOOL),
+    SIMPLE_TOKEN("break", KW_BREAK),
+    SIMPLE_TOKEN("case", KW_CASE),
+    SIMPLE_TOKEN("catch", KW_CATCH),
+    SIMPLE_TOKEN("char", KW_CHAR),
+    SIMPLE_TOKEN("char16_t", KW_CHAR16_T),
+    SIMPLE_TOKEN("char32_t", KW_CHAR32_T),
+    SIMPLE_TOKEN("class", KW_CLASS),
+    SIMPLE_TOKEN("const", KW_CONST),
+    SIMPLE_TOKEN("constexpr", KW_CONSTEXPR),
+    SIMPLE_TOKEN("const_cast", KW_CONST_CAST),
+    SIMPLE_TOKEN("continue", KW_CONTINUE),
+    SIMPLE_TOKEN("decltype", KW_DECLTYPE),
+    SIMPLE_TOKEN("default", KW_DEFAULT),
+    SIMPLE_TOKEN("delete", KW_DELETE),
+    SIMPLE_TOKEN("do", KW_DO),
+    SIMPLE_TOKEN("double", KW_DOUBLE),
+    SIMPLE_TOKEN("dynamic_cast", KW_DYNAMIC_CAST),
+    SIMPLE_TOKEN("else", KW_ELSE),
+    SIMPLE_TOKEN("enum", KW_ENUM),
+    SIMPLE_TOKEN("explicit", KW_EXPLICIT),
+    SIMPLE_TOKEN("export", KW_EXPORT),
+    SIMPLE_TOKEN("extern", KW_EXTERN),
+    SIMPLE_TOKEN("false", KW_FALSE),
+    SIMPLE_TOKEN("float", KW_FLOAT),
+    SIMPLE_TOKEN("for", KW_FOR),
+    SIMPLE_TOKEN("friend", KW_FRIEND),
+    SIMPLE_TOKEN("goto", KW_GOTO),
+    SIMPLE_TOKEN("if", KW_IF),
+    SIMPLE_TOKEN("inline", KW_INLINE),
+    SIMPLE_TOKEN("int", KW_INT),
+    SIMPLE_TOKEN("long", KW_LONG),
+    SIMPLE_TOKEN("mutable", KW_MUTABLE),
+    SIMPLE_TOKEN("namespace", KW_NAMESPACE),
+    SIMPLE_TOKEN("new", KW_NEW),
+    SIMPLE_TOKEN("noexcept", KW_NOEXCEPT),
+    SIMPLE_TOKEN("nullptr", KW_NULLPTR),
+    SIMPLE_TOKEN("operator", KW_OPERATOR),
+    SIMPLE_TOKEN("private", KW_PRIVATE),
+    SIMPLE_TOKEN("protected", KW_PROTECTED),
+    SIMPLE_TOKEN("public", KW_PUBLIC),
+    SIMPLE_TOKEN("register", KW_REGISTER),
+    SIMPLE_TOKEN("reinterpret_cast", KW_REINTERPET_CAST),
+    SIMPLE_TOKEN("return", KW_RETURN),
+    SIMPLE_TOKEN("short", KW_SHORT),
+    SIMPLE_TOKEN("signed", KW_SIGNED),
+    SIMPLE_TOKEN("sizeof", KW_SIZEOF),
+    SIMPLE_TOKEN("static", KW_STATIC),
+    SIMPLE_TOKEN("static_assert", KW_STATIC_ASSERT),
+    SIMPLE_TOKEN("static_cast", KW_STATIC_CAST),
+    SIMPLE_TOKEN("struct", KW_STRUCT),
+    SIMPLE_TOKEN("switch", KW_SWITCH),
+    SIMPLE_TOKEN("template", KW_TEMPLATE),
+    SIMPLE_TOKEN("this", KW_THIS),
+    SIMPLE_TOKEN("thread_local", KW_THREAD_LOCAL),
+    SIMPLE_TOKEN("throw", KW_THROW),
+    SIMPLE_TOKEN("true", KW_TRUE),
+    SIMPLE_TOKEN("try", KW_TRY),
+    SIMPLE_TOKEN("typedef", KW_TYPEDEF),
+    SIMPLE_TOKEN("typeid", KW_TYPEID),
+    SIMPLE_TOKEN("typename", KW_TYPENAME),
+    SIMPLE_TOKEN("union", KW_UNION),
+    SIMPLE_TOKEN("unsigned", KW_UNSIGNED),
+    SIMPLE_TOKEN("using", KW_USING),
+    SIMPLE_TOKEN("virtual", KW_VIRTUAL),
+    SIMPLE_TOKEN("void", KW_VOID),
+    SIMPLE_TOKEN("volatile", KW_VOLATILE),
+    SIMPLE_TOKEN("wchar_t", KW_WCHAR_T),
+    SIMPLE_TOKEN("while", KW_WHILE),
 
     // operators/punctuation
-    {"{", OP_LBRACE},
-    {"<%", OP_LBRACE},
-    {"}", OP_RBRACE},
-    {"%>", OP_RBRACE},
-    {"[", OP_LSQUARE},
-    {"<:", OP_LSQUARE},
-    {"]", OP_RSQUARE},
-    {":>", OP_RSQUARE},
-    {"(", OP_LPAREN},
-    {")", OP_RPAREN},
-    {"|", OP_BOR},
-    {"bitor", OP_BOR},
-    {"^", OP_XOR},
-    {"xor", OP_XOR},
-    {"~", OP_COMPL},
-    {"compl", OP_COMPL},
-    {"&", OP_AMP},
-    {"bitand", OP_AMP},
-    {"!", OP_LNOT},
-    {"not", OP_LNOT},
-    {";", OP_SEMICOLON},
-    {":", OP_COLON},
-    {"...", OP_DOTS},
-    {"?", OP_QMARK},
-    {"::", OP_COLON2},
-    {".", OP_DOT},
-    {".*", OP_DOTSTAR},
-    {"+", OP_PLUS},
-    {"-", OP_MINUS},
-    {"*", OP_STAR},
-    {"/", OP_DIV},
-    {"%", OP_MOD},
-    {"=", OP_ASS},
-    {"<", OP_LT},
-    {">", OP_GT},
-    {"+=", OP_PLUSASS},
-    {"-=", OP_MINUSASS},
-    {"*=", OP_STARASS},
-    {"/=", OP_DIVASS},
-    {"%=", OP_MODASS},
-    {"^=", OP_XORASS},
-    {"xor_eq", OP_XORASS},
-    {"&=", OP_BANDASS},
-    {"and_eq", OP_BANDASS},
-    {"|=", OP_BORASS},
-    {"or_eq", OP_BORASS},
-    {"<<", OP_LSHIFT},
-    {">>", OP_RSHIFT},
-    {">>=", OP_RSHIFTASS},
-    {"<<=", OP_LSHIFTASS},
-    {"==", OP_EQ},
-    {"!=", OP_NE},
-    {"not_eq", OP_NE},
-    {"<=", OP_LE},
-    {">=", OP_GE},
-    {"&&", OP_LAND},
-    {"and", OP_LAND},
-    {"||", OP_LOR},
-    {"or", OP_LOR},
-    {"++", OP_INC},
-    {"--", OP_DEC},
-    {",", OP_COMMA},
-    {"->*", OP_ARROWSTAR},
-    {"->", OP_ARROW}
+    SIMPLE_TOKEN("{", OP_LBRACE),
+    SIMPLE_TOKEN("<%", OP_LBRACE),
+    SIMPLE_TOKEN("}", OP_RBRACE),
+    SIMPLE_TOKEN("%>", OP_RBRACE),
+    SIMPLE_TOKEN("[", OP_LSQUARE),
+    SIMPLE_TOKEN("<:", OP_LSQUARE),
+    SIMPLE_TOKEN("]", OP_RSQUARE),
+    SIMPLE_TOKEN(":>", OP_RSQUARE),
+    SIMPLE_TOKEN("(", OP_LPAREN),
+    SIMPLE_TOKEN(")", OP_RPAREN),
+    SIMPLE_TOKEN("|", OP_BOR),
+    SIMPLE_TOKEN("bitor", OP_BOR),
+    SIMPLE_TOKEN("^", OP_XOR),
+    SIMPLE_TOKEN("xor", OP_XOR),
+    SIMPLE_TOKEN("~", OP_COMPL),
+    SIMPLE_TOKEN("compl", OP_COMPL),
+    SIMPLE_TOKEN("&", OP_AMP),
+    SIMPLE_TOKEN("bitand", OP_AMP),
+    SIMPLE_TOKEN("!", OP_LNOT),
+    SIMPLE_TOKEN("not", OP_LNOT),
+    SIMPLE_TOKEN(";", OP_SEMICOLON),
+    SIMPLE_TOKEN(":", OP_COLON),
+    SIMPLE_TOKEN("...", OP_DOTS),
+    SIMPLE_TOKEN("?", OP_QMARK),
+    SIMPLE_TOKEN("::", OP_COLON2),
+    SIMPLE_TOKEN(".", OP_DOT),
+    SIMPLE_TOKEN(".*", OP_DOTSTAR),
+    SIMPLE_TOKEN("+", OP_PLUS),
+    SIMPLE_TOKEN("-", OP_MINUS),
+    SIMPLE_TOKEN("*", OP_STAR),
+    SIMPLE_TOKEN("/", OP_DIV),
+    SIMPLE_TOKEN("%", OP_MOD),
+    SIMPLE_TOKEN("=", OP_ASS),
+    SIMPLE_TOKEN("<", OP_LT),
+    SIMPLE_TOKEN(">", OP_GT),
+    SIMPLE_TOKEN("+=", OP_PLUSASS),
+    SIMPLE_TOKEN("-=", OP_MINUSASS),
+    SIMPLE_TOKEN("*=", OP_STARASS),
+    SIMPLE_TOKEN("/=", OP_DIVASS),
+    SIMPLE_TOKEN("%=", OP_MODASS),
+    SIMPLE_TOKEN("^=", OP_XORASS),
+    SIMPLE_TOKEN("xor_eq", OP_XORASS),
+    SIMPLE_TOKEN("&=", OP_BANDASS),
+    SIMPLE_TOKEN("and_eq", OP_BANDASS),
+    SIMPLE_TOKEN("|=", OP_BORASS),
+    SIMPLE_TOKEN("or_eq", OP_BORASS),
+    SIMPLE_TOKEN("<<", OP_LSHIFT),
+    SIMPLE_TOKEN(">>", OP_RSHIFT),
+    SIMPLE_TOKEN(">>=", OP_RSHIFTASS),
+    SIMPLE_TOKEN("<<=", OP_LSHIFTASS),
+    SIMPLE_TOKEN("==", OP_EQ),
+    SIMPLE_TOKEN("!=", OP_NE),
+    SIMPLE_TOKEN("not_eq", OP_NE),
+    SIMPLE_TOKEN("<=", OP_LE),
+    SIMPLE_TOKEN(">=", OP_GE),
+    SIMPLE_TOKEN("&&", OP_LAND),
+    SIMPLE_TOKEN("and", OP_LAND),
+    SIMPLE_TOKEN("||", OP_LOR),
+    SIMPLE_TOKEN("or", OP_LOR),
+    SIMPLE_TOKEN("++", OP_INC),
+    SIMPLE_TOKEN("--", OP_DEC),
+    SIMPLE_TOKEN(",", OP_COMMA),
+    SIMPLE_TOKEN("->*", OP_ARROWSTAR),
+    SIMPLE_TOKEN("->", OP_ARROW)
 };
 
+constexpr size_t NumSimpleTokens =
+    sizeof(SimpleTokens) / sizeof(SimpleTokens[0]);
+
+// Length of the longest `simple` `preprocessing-token`
+constexpr size_t maxSimpleTokenLength(size_t i = 0, size_t longest = 0)
+{
+    return i == NumSimpleTokens ? longest : maxSimpleTokenLength(i + 1,
+        SimpleTokens[i].length > longest ? SimpleTokens[i].length : longest);
+}
+
+constexpr size_t MaxSimpleTokenLength = maxSimpleTokenLength();
+
+// Index of the first simple token that hashes to slot, or NumSimpleTokens
+constexpr size_t simpleTokenInSlot(unsigned int slot, size_t i = 0)
+{
+    return i == NumSimpleTokens || SimpleTokens[i].hash == slot ? i :
+        simpleTokenInSlot(slot, i + 1);
+}
+
+// Check that every simple token is the first one in its slot
+constexpr bool simpleTokenHashIsPerfect(size_t i = 0)
+{
+    return i == NumSimpleTokens ||
+        (simpleTokenInSlot(SimpleTokens[i].hash) == i &&
+        simpleTokenHashIsPerfect(i + 1));
+}
+
+static_assert(simpleTokenHashIsPerfect(),
+    "simple tokens collide, search for another SimpleTokenHashMultiplier");
+static_assert(NumSimpleTokens < 256, "too many simple tokens for the slots");
+
+#define SIMPLE_SLOTS_4(n) \
+    simpleTokenInSlot(n), simpleTokenInSlot(n + 1), \
+    simpleTokenInSlot(n + 2), simpleTokenInSlot(n + 3)
+#define SIMPLE_SLOTS_16(n) \
+    SIMPLE_SLOTS_4(n), SIMPLE_SLOTS_4(n + 4), \
+    SIMPLE_SLOTS_4(n + 8), SIMPLE_SLOTS_4(n + 12)
+#define SIMPLE_SLOTS_64(n) \
+    SIMPLE_SLOTS_16(n), SIMPLE_SLOTS_16(n + 16), \
+    SIMPLE_SLOTS_16(n + 32), SIMPLE_SLOTS_16(n + 48)
+#define SIMPLE_SLOTS_256(n) \
+    SIMPLE_SLOTS_64(n), SIMPLE_SLOTS_64(n + 64), \
+    SIMPLE_SLOTS_64(n + 128), SIMPLE_SLOTS_64(n + 192)
+
+// SimpleTokenSlots: index into SimpleTokens for every hash value
+constexpr unsigned char SimpleTokenSlots[1 << SimpleTokenHashBits] =
+{
+    SIMPLE_SLOTS_256(0), SIMPLE_SLOTS_256(256),
+    SIMPLE_SLOTS_256(512), SIMPLE_SLOTS_256(768)
+};
+
+// SimpleTokenType: look up the ETokenType of a `simple` `preprocessing-token`,
+// returns false if data isn't one
+bool SimpleTokenType(const string& data, ETokenType& type)
+{
+    size_t length = data.length();
+
+    if (length == 0 || length > MaxSimpleTokenLength)
+        return false;
+
+    unsigned int slot = SimpleTokenSlots[simpleTokenHash(data.data(), length)];
+    if (slot == NumSimpleTokens)
+        return false;
+
+    const SimpleToken& token = SimpleTokens[slot];
+    if (token.length != length ||
+            memcmp(token.spelling, data.data(), length) != 0)
+        return false;
+
+    type = token.type;
+    return true;
+}
+
 
 // use these 3 functions to scan `floating-literals` (see PA2)
 // for example PA2Decode_float("12.34") returns "12.34" as a `float` type
 float PA2Decode_float(const string& s)
 {
-    istringstream iss(s);
-    float x;
-    iss >> x;
-    return x;
+    return strtof(s.c_str(), nullptr);
 }
 
 double PA2Decode_double(const string& s)
 {
-    istringstream iss(s);
-    double x;
-    iss >> x;
-    return x;
+    return strtod(s.c_str(), nullptr);
 }
 
 long double PA2Decode_long_double(const string& s)
 {
-    istringstream iss(s);
-    long double x;
-    iss >> x;
-    return x;
+    return strtold(s.c_str(), nullptr);
 }
 
 unsigned int utf8Length(const string& s, unsigned int index = 0)
@@ -278,54 +371,6 @@ unsigned int utf8Decode(const string& s, unsigned long *result,
     return length;
 }
 
-static string utf8Encode(const unsigned long c)
-{
-    string str;
-
-    if (c < 0x7f)
-        str.push_back((char)c);
-    else if (c < 0x800)
-    {
-        str.push_back(0xc0 | (c >> 6));
-        str.push_back(0x80 | (c & 0x3f));
-    }
-    else if (c < 0x10000)
-    {
-        str.push_back(0xe0 | (c >> 12));
-        str.push_back(0x80 | ((c >> 6) & 0x3f));
-        str.push_back(0x80 | (c & 0x3f));
-    }
-    else if (c < 0x110000)
-    {
-        str.push_back(0xf0 | (c >> 18));
-        str.push_back(0x80 | ((c >> 12) & 0x3f));
-        str.push_back(0x80 | ((c >> 6) & 0x3f));
-        str.push_back(0x80 | (c & 0x3f));
-    }
-
-    return str;
-}
-
-static string utf16Encode(const unsigned long c)
-{
-    string str;
-    uint16_t w1 = 0xD800;
-    uint16_t w2 = 0xDC00;
-
-    if (c < 0x10000)
-        str.append((char*)&c, 2);
-    else
-    {
-        w1 += (c - 0x10000) >> 10;
-        w2 += (c - 0x10000) & 0x3ff;
-
-        str.append((char*)&w1, 2);
-        str.append((char*)&w2, 2);
-    }
-
-    return str;
-}
-
 static bool isUserSuffix(const string& str)
 {
     // Most of the checking was done in the preprocessing stage, we simply need
@@ -351,7 +396,9 @@ static bool isUserSuffix(const string& str)
 }
 
 TokenStream::TokenStream(IPostTokenOutputStream& output)
-    : mOutput(output)
+    : mOutput(output),
+      mErrors(0),
+      mErrorOutput(nullptr)
 {}
 
 TokenStream::~TokenStream() {}
@@ -380,8 +427,10 @@ void TokenStream::emit_identifier(const string& data)
 
     // If the identifier is in the token type map then emit it as a simple
     // token, otherwise it's an identifier
-    if (StringToTokenTypeMap.find(data) != StringToTokenTypeMap.end())
-        mOutput.emit_simple(data, StringToTokenTypeMap.at(data));
+    ETokenType type;
+
+    if (SimpleTokenType(data, type))
+        mOutput.emit_simple(data, type);
     else
         mOutput.emit_identifier(data);
 }
@@ -398,8 +447,201 @@ EFundamentalType TokenStream::getFloatSuffixSize(const string& suffix)
     return FT_INVALID;
 }
 
+// DecimalFloat: the digits of a decimal floating literal as
+// mantissa * 10^exponent
+struct DecimalFloat
+{
+    unsigned long long mantissa;
+    int exponent;
+    bool exact;     // false if non-zero digits didn't fit in the mantissa
+    size_t length;  // characters making up the number, 0 if there are none
+};
+
+// Scan the number at the start of data the way strtold would
+static DecimalFloat scanDecimalFloat(const string& data)
+{
+    DecimalFloat number = {0, 0, true, 0};
+    unsigned int digits = 0;
+    bool found = false;
+    bool fraction = false;
+    size_t index = 0;
+
+    for (; index < data.length(); index++)
+    {
+        char c = data[index];
+
+        if (c == '.' && !fraction)
+        {
+            fraction = true;
+            continue;
+        }
+
+        if (c < '0' || c > '9')
+            break;
+
+        found = true;
+
+        // Leading zeros are not significant and only 19 digits are sure
+        // to fit
+        if (number.mantissa == 0 && c == '0')
+        {
+            if (fraction)
+                number.exponent--;
+        }
+        else if (digits < 19)
+        {
+            number.mantissa = number.mantissa * 10 + (c - '0');
+            digits++;
+
+            if (fraction)
+                number.exponent--;
+        }
+        else
+        {
+            if (c != '0')
+                number.exact = false;
+
+            if (!fraction)
+                number.exponent++;
+        }
+    }
+
+    if (!found)
+        return number;
+
+    number.length = index;
+
+    // The exponent only counts if it has digits
+    if (index < data.length() && (data[index] == 'e' || data[index] == 'E'))
+    {
+        bool negative = false;
+        int exponent = 0;
+
+        index++;
+        if (index < data.length() && (data[index] == '+' ||
+                data[index] == '-'))
+            negative = data[index++] == '-';
+
+        if (index < data.length() && data[index] >= '0' && data[index] <= '9')
+        {
+            for (; index < data.length() && data[index] >= '0' &&
+                    data[index] <= '9'; index++)
+            {
+                // Anything this large is out of range anyway
+                if (exponent < 100000)
+                    exponent = exponent * 10 + (data[index] - '0');
+            }
+
+            number.exponent += negative ? -exponent : exponent;
+            number.length = index;
+        }
+    }
+
+    return number;
+}
+
+// Powers of ten that are exact in each floating type
+constexpr float FloatPowersOfTen[] =
+{
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+constexpr double DoublePowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+constexpr long double LongDoublePowersOfTen[] =
+{
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L,
+    1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+    1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+// Largest mantissa below which every integer is exact in T
+template<typename T>
+constexpr unsigned long long exactMantissa()
+{
+    return numeric_limits<T>::digits >= 64 ? ULLONG_MAX :
+        1ULL << (numeric_limits<T>::digits & 63);
+}
+
+// Clinger's fast path: when both the mantissa and the power of ten are
+// exact in T a single multiplication or division is correctly rounded.
+// This needs T arithmetic to be done in T, without extra precision.
+template<typename T, size_t Powers>
+static bool clingerConvert(const DecimalFloat& number,
+    const T (&powers)[Powers], T& out)
+{
+    if (number.mantissa > exactMantissa<T>() ||
+            number.exponent <= -(int)Powers ||
+            number.exponent >= (int)Powers)
+        return false;
+
+    T value = (T)number.mantissa;
+
+    if (number.exponent < 0)
+        out = value / powers[-number.exponent];
+    else
+        out = value * powers[number.exponent];
+
+    return true;
+}
+
+// The x87 format only uses 10 of the bytes of a long double, clear the rest
+// so they don't leak whatever was on the stack into the output
+static void clearPadding(long double& value)
+{
+    if (LDBL_MANT_DIG == 64)
+        memset((char*)&value + 10, 0, sizeof(value) - 10);
+}
+
 void TokenStream::processFloat(const string& data)
 {
+    DecimalFloat number = scanDecimalFloat(data);
+
+    // Most literals are converted directly from their digits.  Anything
+    // with a ud-suffix, too many digits or a large exponent goes through
+    // the C library below.
+    if (number.length > 0 && number.exact && FLT_EVAL_METHOD == 0)
+    {
+        size_t rest = data.length() - number.length;
+        char suffix = rest == 1 ? data[number.length] : 0;
+
+        if (rest == 0)
+        {
+            double out;
+
+            if (clingerConvert(number, DoublePowersOfTen, out))
+            {
+                mOutput.emit_literal(data, FT_DOUBLE, &out, sizeof(out));
+                return;
+            }
+        }
+        else if (suffix == 'f' || suffix == 'F')
+        {
+            float out;
+
+            if (clingerConvert(number, FloatPowersOfTen, out))
+            {
+                mOutput.emit_literal(data, FT_FLOAT, &out, sizeof(out));
+                return;
+            }
+        }
+        else if ((suffix == 'l' || suffix == 'L') && LDBL_MANT_DIG == 64)
+        {
+            long double out;
+
+            if (clingerConvert(number, LongDoublePowersOfTen, out))
+            {
+                clearPadding(out);
+                mOutput.emit_literal(data, FT_LONG_DOUBLE, &out,
+                    sizeof(out));
+                return;
+            }
+        }
+    }
 
     string prefix;
     string suffix;
@@ -470,355 +712,269 @@ void TokenStream::processFloat(const string& data)
     else
     {
         long double out = PA2Decode_long_double(data);
+
+        clearPadding(out);
         mOutput.emit_literal(data, type, &out, sizeof(out));
     }
 }
 
-EFundamentalType TokenStream::sizeDecimal(unsigned long long value,
-    EFundamentalType type)
+// Kinds of integer-suffix, see [lex.icon]
+enum EIntegerSuffix
 {
-    switch (type)
-    {
-    case FT_INT:
-        if (value <= INT_MAX) return FT_INT;
-        /* Fall-through */
-    case FT_LONG_INT:
-        if (value <= LONG_MAX) return FT_LONG_INT;
-        /* Fall-through */
-    case FT_LONG_LONG_INT:
-        if (value <= LLONG_MAX) return FT_LONG_LONG_INT;
-
-        return FT_INVALID;
-
-        break;
-    case FT_UNSIGNED_INT:
-        if (value <= UINT_MAX) return FT_UNSIGNED_INT;
-        /* Fall-through */
-    case FT_UNSIGNED_LONG_INT:
-        if (value <= ULONG_MAX) return FT_UNSIGNED_LONG_INT;
-        /* Fall-through */
-    case FT_UNSIGNED_LONG_LONG_INT:
-        if (value <= ULLONG_MAX) return FT_UNSIGNED_LONG_LONG_INT;
-
-        return FT_INVALID;
-
-        break;
-    default:
-        // This is not a valid integer type
-        return FT_INVALID;
-    }
-
-    // This can't be reached
-    return FT_INVALID;
-}
+    IS_NONE,
+    IS_UNSIGNED,
+    IS_LONG,
+    IS_UNSIGNED_LONG,
+    IS_LONG_LONG,
+    IS_UNSIGNED_LONG_LONG,
+    IS_INVALID
+};
 
-EFundamentalType TokenStream::sizeOctOrHex(unsigned long long value,
-    EFundamentalType type)
+// IntegerLiteralType: a type an integer literal can have and its range
+struct IntegerLiteralType
 {
-    switch (type)
-    {
-    case FT_INT:
-        if (value <= INT_MAX) return FT_INT;
-        if (value <= UINT_MAX) return FT_UNSIGNED_INT;
-        /* Fall-through */
-    case FT_LONG_INT:
-        if (value <= LONG_MAX) return FT_LONG_INT;
-        if (value <= ULONG_MAX) return FT_UNSIGNED_LONG_INT;
-        /* Fall-through */
-    case FT_LONG_LONG_INT:
-        if (value <= LLONG_MAX) return FT_LONG_LONG_INT;
-        if (value <= ULLONG_MAX) return FT_UNSIGNED_LONG_LONG_INT;
-
-        return FT_INVALID;
-
-        break;
-    case FT_UNSIGNED_INT:
-        if (value <= UINT_MAX) return FT_UNSIGNED_INT;
-        /* Fall-through */
-    case FT_UNSIGNED_LONG_INT:
-        if (value <= ULONG_MAX) return FT_UNSIGNED_LONG_INT;
-        /* Fall-through */
-    case FT_UNSIGNED_LONG_LONG_INT:
-        if (value <= ULLONG_MAX) return FT_UNSIGNED_LONG_LONG_INT;
-
-        return FT_INVALID;
-
-        break;
-    default:
-        // This is not an integer type
-        return FT_INVALID;
-    }
-}
+    EFundamentalType type;
+    unsigned long long max;
+    unsigned int size;
+};
 
-EFundamentalType TokenStream::getIntSuffixSize(const string& suffix)
-{
-    // Verify this is a valid suffix
-    if (suffix == "")
-        return FT_INT;
+#define INTEGER_LITERAL_TYPE(T) \
+    {FundamentalTypeOf<T>(), numeric_limits<T>::max(), sizeof(T)}
 
-    if (suffix[0] == 'u' || suffix[0] == 'U')
+// IntegerLiteralTypes: the types an integer literal can have in order of
+// preference, by suffix and by whether it is decimal or octal/hexadecimal.
+// A size of zero ends each list.
+constexpr IntegerLiteralType IntegerLiteralTypes[IS_INVALID][2][7] =
+{
+    // IS_NONE
     {
-        if (suffix.length() == 1)
-            return FT_UNSIGNED_INT;
-        else if (suffix[1] == 'l' || suffix[1] == 'L')
         {
-            if (suffix.length() == 2)
-                return FT_UNSIGNED_LONG_INT;
-            else if (suffix[2] == suffix[1])
-                return FT_UNSIGNED_LONG_LONG_INT;
+            INTEGER_LITERAL_TYPE(int),
+            INTEGER_LITERAL_TYPE(long int),
+            INTEGER_LITERAL_TYPE(long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(int),
+            INTEGER_LITERAL_TYPE(unsigned int),
+            INTEGER_LITERAL_TYPE(long int),
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(long long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
         }
-        
-        return FT_INVALID;
-    }
-
-    if (suffix[0] == 'l' || suffix[0] == 'L')
+    },
+    // IS_UNSIGNED
     {
-        if (suffix.length() == 1)
-            return FT_LONG_INT;
-        else if (suffix[1] == suffix[0])
         {
-            if (suffix.length() == 2)
-                return FT_LONG_LONG_INT;
-            else if (suffix[2] == 'u' || suffix[2] == 'U')
-                return FT_UNSIGNED_LONG_LONG_INT;
+            INTEGER_LITERAL_TYPE(unsigned int),
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(unsigned int),
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
         }
-        else if (suffix[1] == 'u' || suffix[1] == 'U')
-            return FT_UNSIGNED_LONG_INT;
-
-        return FT_INVALID;
-    }
-
-    return FT_INVALID;
-}
-
-void TokenStream::processDecimal(const string& data)
-{
-    unsigned int index = 0;
-    unsigned long long value = 0;
-    char *end = nullptr;
-    string prefix;
-    string suffix;
-    EFundamentalType type = FT_INT;
-    unsigned int size = 4;
-
-    // Walk forward as long as we have digits
-    while (index < data.length() && (data[index] >= '0' &&
-            data[index] <= '9'))
-        index++;
-    prefix = data.substr(0, index);
-
-    // Make sure we found some digits
-    if (prefix.length() == 0)
+    },
+    // IS_LONG
     {
-        mOutput.emit_invalid(data);
-        printError("invalid decimal: ", data);
-        return;
-    }
-
-    // Get any suffix
-    suffix = data.substr(index);
-
-    if (isUserSuffix(suffix))
+        {
+            INTEGER_LITERAL_TYPE(long int),
+            INTEGER_LITERAL_TYPE(long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(long int),
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(long long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        }
+    },
+    // IS_UNSIGNED_LONG
     {
-        // This must be a user defined suffix
-        mOutput.emit_user_defined_literal_integer(data, suffix, prefix);
-        return;
-    }
-
-    // Get the value of the integer.
-    errno = 0;
-    value = strtoull(prefix.c_str(), &end, 10);
-    if (value == 0 && prefix.c_str() == end)
+        {
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(unsigned long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        }
+    },
+    // IS_LONG_LONG
     {
-        mOutput.emit_invalid(data);
-        printError("unable to parse decimal: ", data);
-        return;
+        {
+            INTEGER_LITERAL_TYPE(long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(long long int),
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        }
+    },
+    // IS_UNSIGNED_LONG_LONG
+    {
+        {
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        },
+        {
+            INTEGER_LITERAL_TYPE(unsigned long long int)
+        }
     }
+};
+
+// Classify the integer-suffix of length characters at s
+static EIntegerSuffix integerSuffix(const char* s, size_t length)
+{
+    size_t index = 0;
+    unsigned int longs = 0;
+    bool isUnsigned = false;
 
-    // A return value of ULLONG_MAX could mean the value was too large to
-    // fit into an unsigned long long
-    if (value == ULLONG_MAX && errno != 0)
+    // The unsigned-suffix can come before or after the long-suffix
+    if (index < length && (s[index] == 'u' || s[index] == 'U'))
     {
-        mOutput.emit_invalid(data);
-        printError("decimal integer literal out of range: ", data);
-        return;
+        isUnsigned = true;
+        index++;
     }
 
-    // Get the suffix size
-    if ((type = getIntSuffixSize(suffix)) == FT_INVALID &&
-        suffix.length() > 0)
+    // A long-long-suffix can't mix cases
+    if (index < length && (s[index] == 'l' || s[index] == 'L'))
     {
-        // This is invalid
-        mOutput.emit_invalid(data);
-        printError("Invalid integer literal suffix: ", data);
-        return;
+        longs = (index + 1 < length && s[index + 1] == s[index]) ? 2 : 1;
+        index += longs;
     }
 
-    // Verify that the value will fit into a size of the same type
-    if ((type = sizeDecimal(value, type)) == FT_INVALID)
+    if (!isUnsigned && index < length && (s[index] == 'u' || s[index] == 'U'))
     {
-        mOutput.emit_invalid(data);
-        printError("decimal integer literal out of range: ", data);
-        return;
+        isUnsigned = true;
+        index++;
     }
 
-    // Get the size of the output
-    if (type == FT_LONG_INT || type == FT_UNSIGNED_LONG_INT ||
-            type == FT_LONG_LONG_INT || type == FT_UNSIGNED_LONG_LONG_INT)
-        size = 8;
+    if (index != length)
+        return IS_INVALID;
 
-    mOutput.emit_literal(data, type, &value, size);
+    if (longs == 2)
+        return isUnsigned ? IS_UNSIGNED_LONG_LONG : IS_LONG_LONG;
+    else if (longs == 1)
+        return isUnsigned ? IS_UNSIGNED_LONG : IS_LONG;
+
+    return isUnsigned ? IS_UNSIGNED : IS_NONE;
 }
 
-void TokenStream::processHexidecimal(const string& data)
+// Value of the digit c in any base up to 16, or 16 if it isn't one
+static inline unsigned int digitValue(char c)
 {
-    unsigned int index = 2;
-    unsigned long long value;
-    string prefix;
-    string suffix;
-    EFundamentalType type = FT_INT;
-    unsigned int size = 4;
-
-    // Consume as long as we find hexidecimal digits
-    while (index < data.length() && ((data[index] >= '0' &&
-            data[index] <= '9') || (data[index] >= 'a' &&
-            data[index] <= 'f') || (data[index] >= 'A' &&
-            data[index] <= 'F')))
-        index++;
-    prefix = data.substr(0, index);
+    unsigned int digit = (unsigned char)c - '0';
 
-    // Make sure we found some digits
-    if (prefix.length() == 2)
-    {
-        mOutput.emit_invalid(data);
-        printError("invalid hexidecimal: ", data);
-        return;
-    }
+    if (digit < 10)
+        return digit;
 
-    // Get any suffix
-    suffix = data.substr(index);
+    digit = ((unsigned char)c | 0x20) - 'a';
 
-    if (isUserSuffix(suffix))
-    {
-        // This must be a user defined suffix
-        mOutput.emit_user_defined_literal_integer(data, suffix, prefix);
-        return;
-    }
+    return digit < 6 ? digit + 10 : 16;
+}
 
-    // Get the value.  This can be zero
-    errno = 0;
-    value = strtoull(prefix.c_str(), nullptr, 16);
+// Parse the digits starting at index in one pass and return the index after
+// them, setting overflow if the value stops fitting into an unsigned long
+// long.  The base is a template parameter so the limits are constants.
+template<unsigned int Base>
+static size_t parseDigits(const string& data, size_t index,
+    unsigned long long& value, bool& overflow)
+{
+    const unsigned long long limit = ULLONG_MAX / Base;
+    const unsigned int lastDigit = ULLONG_MAX % Base;
 
-    // A value of ULLONG_MAX could mean that the input value was too large
-    // to fit into an unsigned long long.
-    if (value == ULLONG_MAX && errno != 0)
+    for (; index < data.length(); index++)
     {
-        mOutput.emit_invalid(data);
-        printError("hexidecimal literal out of range: ", data);
-        return;
-    }
+        unsigned int digit = digitValue(data[index]);
 
-    // Get the suffix size
-    if ((type = getIntSuffixSize(suffix)) == FT_INVALID)
-    {
-        if (suffix.length() > 0)
-        {
-            // This is invalid
-            mOutput.emit_invalid(data);
-            printError("Invalid integer literal suffix: ", data);
-            return;
-        }
-    }
+        if (digit >= Base)
+            break;
 
-    // Verify that the value will fit into a size of the same type
-    if ((type = sizeOctOrHex(value, type)) == FT_INVALID)
-    {
-        mOutput.emit_invalid(data);
-        printError("hexidecimal integer literal out of range: ", data);
-        return;
-    }
+        if (value > limit || (value == limit && digit > lastDigit))
+            overflow = true;
 
-    // Get the size of the output
-    if (type == FT_LONG_INT || type == FT_UNSIGNED_LONG_INT ||
-            type == FT_LONG_LONG_INT || type == FT_UNSIGNED_LONG_LONG_INT)
-        size = 8;
+        value = value * Base + digit;
+    }
 
-    mOutput.emit_literal(data, type, &value, size);
+    return index;
 }
 
-void TokenStream::processOctal(const string& data)
+void TokenStream::processInteger(const string& data, unsigned int base)
 {
-    unsigned int index = 0;
+    const char* name = base == 16 ? "hexidecimal" :
+        (base == 8 ? "octal" : "decimal");
+    size_t start = base == 16 ? 2 : 0;
+    size_t index;
     unsigned long long value = 0;
-    string prefix;
-    string suffix;
-    EFundamentalType type = FT_INT;
-    unsigned int size = 4;
+    bool overflow = false;
 
-    // Consume as long as we find octal digits
-    while (index < data.length() && (data[index] >= '0' && 
-            data[index] <= '7'))
-        index++;
-    prefix = data.substr(0, index);
+    if (base == 16)
+        index = parseDigits<16>(data, start, value, overflow);
+    else if (base == 8)
+        index = parseDigits<8>(data, start, value, overflow);
+    else
+        index = parseDigits<10>(data, start, value, overflow);
 
     // Make sure we found some digits
-    if (prefix.length() == 0)
+    if (index == start)
     {
         mOutput.emit_invalid(data);
-        printError("invalid octal: ", data);
+        printError(string("invalid ") + name + ": ", data);
         return;
     }
 
-    // Get any suffix
-    suffix = data.substr(index);
-
-    if (isUserSuffix(suffix))
+    // A leading zero makes this octal, so an 8 or 9 can't start a suffix
+    if (base == 8 && index < data.length() &&
+            (data[index] == '8' || data[index] == '9'))
     {
-        // This must be a user defined suffix
-        mOutput.emit_user_defined_literal_integer(data, suffix, prefix);
+        mOutput.emit_invalid(data);
+        printError("invalid digit in octal literal: ", data);
         return;
     }
 
-    // Get the value.  This can be zero.
-    errno = 0;
-    value = strtoull(prefix.c_str(), nullptr, 8);
+    // User defined suffixes start with an underscore
+    if (index < data.length() && data[index] == '_')
+    {
+        string suffix = data.substr(index);
 
-    // We need to check that a value of ULLONG_MAX was specified by the
-    // input, otherwise it means the value cannot fit in an unsigned long
-    // long.
-    if (value == ULLONG_MAX && errno == ERANGE)
+        if (isUserSuffix(suffix))
+        {
+            mOutput.emit_user_defined_literal_integer(data, suffix,
+                data.substr(0, index));
+            return;
+        }
+    }
+
+    // Only a decimal value too large to parse is called an integer literal
+    // here, as it always has been
+    if (overflow)
     {
         mOutput.emit_invalid(data);
-        printError("octal literal out of range: ", data);
+        printError(string(name) + (base == 10 ? " integer" : "") +
+            " literal out of range: ", data);
         return;
     }
 
-    // Get the suffix size
-    if ((type = getIntSuffixSize(suffix)) == FT_INVALID)
+    EIntegerSuffix suffix = integerSuffix(data.data() + index,
+        data.length() - index);
+    if (suffix == IS_INVALID)
     {
-        if (suffix.length() > 0)
-        {
-            // This is invalid
-            mOutput.emit_invalid(data);
-            printError("Invalid integer literal suffix: ", data);
-            return;
-        }
+        mOutput.emit_invalid(data);
+        printError("Invalid integer literal suffix: ", data);
+        return;
     }
 
-    // Verify that the value will fit into a size of the same type
-    if ((type = sizeOctOrHex(value, type)) == FT_INVALID)
+    // The literal gets the first of its candidate types that can hold it
+    const IntegerLiteralType* type = IntegerLiteralTypes[suffix][base != 10];
+    while (type->size != 0 && value > type->max)
+        type++;
+
+    if (type->size == 0)
     {
         mOutput.emit_invalid(data);
-        printError("octal integer literal out of range: ", data);
+        printError(string(name) + " integer literal out of range: ", data);
         return;
     }
 
-    // Get the size of the output
-    if (type == FT_LONG_INT || type == FT_UNSIGNED_LONG_INT ||
-            type == FT_LONG_LONG_INT || type == FT_UNSIGNED_LONG_LONG_INT)
-        size = 8;
-
-    mOutput.emit_literal(data, type, &value, size);
+    mOutput.emit_literal(data, type->type, &value, type->size);
 }
 
 void TokenStream::emit_pp_number(const string& data)
@@ -828,69 +984,42 @@ void TokenStream::emit_pp_number(const string& data)
     if (data.length() > 2 && data[0] == '0' && \
             (data[1] == 'x' || data[1] == 'X'))
     {
-        processHexidecimal(data);
+        processInteger(data, 16);
         return;
     }
 
-    if (data.find(".") != string::npos)
-    {
-        processFloat(data);
-        return;
-    }
+    // Find the characters that decide what kind of literal this is in one
+    // pass
+    size_t dot = string::npos, exponent = string::npos;
+    size_t underscore = string::npos;
 
-    // For this to be an octal number it must start with a zero and be
-    // followed by octal digits
-    if (data.length() >= 1 && data[0] == '0')
+    for (size_t i = 0; i < data.length(); i++)
     {
-        bool valid = true;
-
-        for (char c : data)
-        {
-            // This is still a valid octal if it has a suffix
-            if (c == '_' || c == 'l' || c == 'L' || c == 'u' || c == 'U')
-                break;
-
-            if (c < '0' || c > '7')
-            {
-                valid = false;
-                break;
-            }
-        }
+        char c = data[i];
 
-        if (valid)
-        {
-            processOctal(data);
-            return;
-        }
+        if (c == '.' && dot == string::npos)
+            dot = i;
+        else if ((c == 'e' || c == 'E') && exponent == string::npos)
+            exponent = i;
+        else if (c == '_' && underscore == string::npos)
+            underscore = i;
     }
 
-    // Check if this is a float with an exponent
-    string::size_type underscore = data.find("_");
-    if (underscore != string::npos)
+    if (dot != string::npos)
     {
-        string::size_type exponent = data.find("e");
-
-        if (exponent != string::npos && exponent < underscore)
-        {
-            processFloat(data);
-            return;
-        }
-        else if ((exponent = data.find("E")) != string::npos &&
-                exponent < underscore)
-        {
-            processFloat(data);
-            return;
-        }
+        processFloat(data);
+        return;
     }
-    else if (data.find("e") != string::npos ||
-        data.find("E") != string::npos)
+
+    // Check if this is a float with an exponent before any ud-suffix
+    if (exponent != string::npos && exponent < underscore)
     {
         processFloat(data);
         return;
     }
 
-    // Try processing as a decimal
-    processDecimal(data);
+    // A leading zero makes this octal so an 8 or 9 makes it invalid
+    processInteger(data, data[0] == '0' ? 8 : 10);
 }
 
 bool TokenStream::processCharLiteral(const string& data, EFundamentalType *type,
@@ -1104,319 +1233,473 @@ void TokenStream::emit_user_defined_character_literal(const string& data)
 
 void TokenStream::invalidateStringLiterals(const string& err)
 {
-    cout << "invalid";
-    for (string s : mStrings)
-    {
-        cout << " " << s;
-    }
-    cout << endl;
+    mOutput.emit_invalid(mStringSource);
+
     mStrings.clear();
+    mStringSource.clear();
 
     printError(err, "");
 }
 
-bool TokenStream::appendEncoded(string& output, unsigned long c, EFundamentalType type)
+// Get the code point of the UTF-8 sequence at p, the tokenizer already
+// checked that it is valid
+static const char* utf8Next(const char* p, const char* end, unsigned long& c)
 {
-    if (type == FT_CHAR)
-        output.append(utf8Encode(c));
-    else if (type == FT_CHAR16_T)
-        output.append(utf16Encode(c));
-    else if (type == FT_CHAR32_T || type == FT_WCHAR_T)
-        output.append((char*)&c, 4);
-    else
-        // What is this??
-        return false;
+    unsigned char lead = *p++;
+    unsigned int length = lead >= 0xf0 ? 4 : (lead >= 0xe0 ? 3 :
+        (lead >= 0xc0 ? 2 : 1));
 
-    return true;
+    c = length == 1 ? lead : lead & (0x7f >> length);
+
+    for (unsigned int i = 1; i < length && p < end; i++)
+        c = (c << 6) | (*p++ & 0x3f);
+
+    return p;
 }
 
-void TokenStream::processStringLiterals()
+// Decode the escape sequence at p.  Returns the character after it, or
+// nullptr with an error message.
+static const char* decodeEscape(const char* p, const char* end,
+    unsigned long& c, const char*& error)
 {
-    string prefix, suffix, source, str;
-    bool convert = false, isRaw = false;
-    EFundamentalType type = FT_CHAR;
-    unsigned int size = 1;
+    // Skip the backslash
+    if (++p == end)
+    {
+        error = "invalid escape sequence";
+        return nullptr;
+    }
+
+    switch (*p)
+    {
+    case 'a': c = 0x07; return p + 1;
+    case 'b': c = 0x08; return p + 1;
+    case 't': c = 0x09; return p + 1;
+    case 'n': c = 0x0a; return p + 1;
+    case 'v': c = 0x0b; return p + 1;
+    case 'f': c = 0x0c; return p + 1;
+    case 'r': c = 0x0d; return p + 1;
+    case '\'': c = '\''; return p + 1;
+    case '"': c = '"'; return p + 1;
+    case '?': c = '?'; return p + 1;
+    case '\\': c = '\\'; return p + 1;
+    case 'x':
+        {
+            const char* start = ++p;
+            unsigned int digit;
 
-    // Don't do anything if there are no literals queued up
-    if (mStrings.size() == 0)
-        return;
+            // There is no limit on the number of digits but anything past
+            // the course-defined range is an error anyway
+            for (c = 0; p < end && (digit = digitValue(*p)) < 16; p++)
+            {
+                if (c < 0x110000)
+                    c = (c << 4) | digit;
+            }
 
-    // Loop over the strings to find the code unit type
-    for (string s : mStrings)
-    {
-        string::size_type quote = s.find("\"");
+            // This is already validated in preprocessing but we'll check
+            // here just to be thorough.
+            if (p == start)
+            {
+                error = "invalid hex escape sequence";
+                return nullptr;
+            }
 
-        // Check if there is a prefix
-        if (quote == 0)
-            continue;
-        
-        // Verify the prefixes match
-        if (prefix.length() > 0)
-        {
-            if (s.substr(0, quote) != prefix)
+            // Verify the value is in the valid course-defined range
+            if ((c >= 0xD800 && c < 0xE000) || c >= 0x110000)
             {
-                invalidateStringLiterals("mismatched encoding prefix"
-                    " in string literal sequence");
-                return;
+                error = "hexidecimal value out-of-range";
+                return nullptr;
             }
+
+            return p;
         }
-        else
+    default:
         {
-            prefix = s.substr(0, quote);
+            const char* start = p;
+
+            // An octal escape has at most three digits so it can't overflow
+            for (c = 0; p < end && p - start < 3 && *p >= '0' && *p <= '7';
+                    p++)
+                c = (c << 3) | (*p - '0');
+
+            if (p == start)
+            {
+                error = "invalid escape sequence";
+                return nullptr;
+            }
+
+            return p;
         }
     }
+}
 
-    // Check if this is a valid prefix
-    if (prefix == "u8" || prefix == "u8R" || prefix == "R" || prefix == "")
+// Encode c as code units of type at out and return the end of them
+static char* encodeCodeUnits(char* out, unsigned long c, EFundamentalType type)
+{
+    if (type == FT_CHAR)
     {
-        type = FT_CHAR;
-        size = 1;
+        if (c < 0x80)
+            *out++ = c;
+        else if (c < 0x800)
+        {
+            *out++ = 0xc0 | (c >> 6);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+        else if (c < 0x10000)
+        {
+            *out++ = 0xe0 | (c >> 12);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+        else
+        {
+            *out++ = 0xf0 | (c >> 18);
+            *out++ = 0x80 | ((c >> 12) & 0x3f);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        }
     }
-    else if (prefix == "u" || prefix == "uR")
+    else if (type == FT_CHAR16_T)
     {
-        type = FT_CHAR16_T;
-        size = 2;
+        uint16_t units[2] = {(uint16_t)c, 0};
+        unsigned int count = 1;
+
+        if (c >= 0x10000)
+        {
+            units[0] = 0xD800 + ((c - 0x10000) >> 10);
+            units[1] = 0xDC00 + ((c - 0x10000) & 0x3ff);
+            count = 2;
+        }
+
+        memcpy(out, units, count * 2);
+        out += count * 2;
     }
-    else if (prefix == "U" || prefix == "UR")
+    else
     {
-        type = FT_CHAR32_T;
-        size = 4;
+        uint32_t unit = c;
+
+        memcpy(out, &unit, 4);
+        out += 4;
     }
-    else if (prefix == "L" || prefix == "LR")
+
+    return out;
+}
+
+// Convert UTF-8 text without escapes to the code units of a wide string
+// literal.  ASCII is checked and widened a word at a time, which is most of
+// any string table; other characters are decoded one at a time.
+template<typename Unit>
+static char* transcodeUtf8(const char* p, const char* end, char* out)
+{
+    while (p < end)
     {
-        type = FT_WCHAR_T;
-        size = 4;
+        while (end - p >= (ptrdiff_t)sizeof(uint64_t))
+        {
+            uint64_t word;
+            Unit units[sizeof(uint64_t)];
+
+            memcpy(&word, p, sizeof(word));
+            if (word & 0x8080808080808080ULL)
+                break;
+
+            for (size_t i = 0; i < sizeof(uint64_t); i++)
+                units[i] = (unsigned char)p[i];
+
+            memcpy(out, units, sizeof(units));
+            out += sizeof(units);
+            p += sizeof(uint64_t);
+        }
+
+        if (p == end)
+            break;
+
+        unsigned long c = (unsigned char)*p;
+
+        if (c >= 0x80)
+            p = utf8Next(p, end, c);
+        else
+            p++;
+
+        if (sizeof(Unit) == 2 && c >= 0x10000)
+        {
+            Unit units[2] = {
+                Unit(0xD800 + ((c - 0x10000) >> 10)),
+                Unit(0xDC00 + ((c - 0x10000) & 0x3ff))
+            };
+
+            memcpy(out, units, sizeof(units));
+            out += sizeof(units);
+        }
+        else
+        {
+            Unit unit = c;
+
+            memcpy(out, &unit, sizeof(unit));
+            out += sizeof(unit);
+        }
     }
+
+    return out;
+}
+
+const StringLiteralPool::Entry* StringLiteralPool::find(const string& source,
+    size_t& id) const
+{
+    auto it = mIds.find(source);
+
+    if (it == mIds.end())
+        return nullptr;
+
+    id = it->second;
+    return &mEntries[id];
+}
+
+size_t StringLiteralPool::add(const string& source, EFundamentalType type,
+    size_t count, const string& suffix, const char* data, size_t nbytes)
+{
+    Entry entry;
+    entry.type = type;
+    entry.count = count;
+    entry.suffix = suffix;
+    entry.data.assign(data, nbytes);
+
+    mEntries.push_back(move(entry));
+    mIds.emplace(source, mEntries.size() - 1);
+
+    return mEntries.size() - 1;
+}
+
+// Emit the queued sequence from its pool entry
+void TokenStream::emitStringLiterals(size_t id)
+{
+    const StringLiteralPool::Entry& entry = mPool[id];
+
+    // If there is a suffix, then this is user defined
+    if (!entry.suffix.empty())
+        mOutput.emit_pooled_user_defined_literal_string_array(id,
+            mStringSource, entry.suffix, entry.count, entry.type,
+            entry.data.data(), entry.data.size());
     else
+        mOutput.emit_pooled_literal_array(id, mStringSource, entry.count,
+            entry.type, entry.data.data(), entry.data.size());
+
+    mStrings.clear();
+    mStringSource.clear();
+}
+
+void TokenStream::processStringLiterals()
+{
+    const char* source = mStringSource.data();
+    const StringLiteral* prefixed = nullptr;
+    bool suffixed = false;
+    EFundamentalType type = FT_CHAR;
+    unsigned int size = 1;
+    size_t id;
+
+    // Don't do anything if there are no literals queued up
+    if (mStrings.empty())
+        return;
+
+    // A sequence that was seen before is already decoded.  Invalid ones are
+    // never pooled so they are diagnosed every time.
+    if (mPool.find(mStringSource, id) != nullptr)
     {
-        // This will likely never happen
-        mOutput.emit_invalid(source);
-        printError("invalid string literal prefix: ", prefix);
+        emitStringLiterals(id);
         return;
     }
 
-    // Loop over the strings converting
-    for (string s : mStrings)
+    // Any encoding-prefixes and ud-suffixes in the sequence must match
+    for (const StringLiteral& literal : mStrings)
     {
-        string::size_type startData, endData;
-        string::size_type startQuote = s.find("\"");
-        string::size_type endQuote = s.rfind("\"");
-        isRaw = false;
-
-        // Append this string to the source
-        if (source.length() == 0)
-            source.append(s);
-        else
-        {
-            source.push_back(' ');
-            source.append(s);
-        }
+        size_t prefixLength = literal.quote - literal.start;
+        size_t suffixLength = literal.end - literal.suffix;
 
-        // Check if there is a prefix
-        if (startQuote > 0)
+        if (prefixLength > 0)
         {
-            // Check if this is a raw string
-            if (s.substr(0, startQuote).find("R") != string::npos)
-                isRaw = true;
+            if (prefixed == nullptr)
+                prefixed = &literal;
+            else if (prefixLength != prefixed->quote - prefixed->start ||
+                    memcmp(source + literal.start, source + prefixed->start,
+                        prefixLength) != 0)
+            {
+                invalidateStringLiterals("mismatched encoding prefix"
+                    " in string literal sequence");
+                return;
+            }
         }
 
-        // Check if there is a suffix
-        if (endQuote < s.length()-1)
+        if (suffixLength > 0)
         {
-            // Verify the suffixes match
-            if (suffix.length() > 0)
+            if (!suffixed)
             {
-                if (s.substr(endQuote+1) != suffix)
-                {
-                    invalidateStringLiterals("mismatched ud_suffix in"
-                        "string literal sequence");
-                    return;
-                }
-            }
-            else
-            {
-                suffix = s.substr(endQuote+1);
+                suffixed = true;
+                mStringSuffix.assign(source + literal.suffix, suffixLength);
 
                 // Verify this is a valid suffix
-                if (!isUserSuffix(suffix))
+                if (!isUserSuffix(mStringSuffix))
                 {
                     invalidateStringLiterals("invalid user defined suffix");
                     return;
                 }
             }
+            else if (suffixLength != mStringSuffix.length() ||
+                    memcmp(source + literal.suffix, mStringSuffix.data(),
+                        suffixLength) != 0)
+            {
+                invalidateStringLiterals("mismatched ud_suffix in"
+                    " string literal sequence");
+                return;
+            }
         }
+    }
 
-        if (isRaw)
-        {
-            startData = s.find("(", startQuote) + 1;
-            endData = endQuote - (startData - startQuote) + 1;
-        }
+    // Check if this is a valid prefix, raw or not
+    if (prefixed != nullptr)
+    {
+        const char* prefix = source + prefixed->start;
+        size_t prefixLength = prefixed->quote - prefixed->start -
+            (prefixed->raw ? 1 : 0);
+
+        if (prefixLength == 0 ||
+                (prefixLength == 2 && prefix[0] == 'u' && prefix[1] == '8'))
+            type = FT_CHAR;
+        else if (prefixLength == 1 && prefix[0] == 'u')
+            type = FT_CHAR16_T;
+        else if (prefixLength == 1 && prefix[0] == 'U')
+            type = FT_CHAR32_T;
+        else if (prefixLength == 1 && prefix[0] == 'L')
+            type = FT_WCHAR_T;
         else
         {
-            startData = startQuote + 1;
-            endData = endQuote;
+            // This will likely never happen
+            invalidateStringLiterals("invalid string literal prefix");
+            return;
         }
 
-        for (unsigned int i = startData; i < endData; /* empty */)
-        {
-            unsigned long c;
+        size = type == FT_CHAR ? 1 : (type == FT_CHAR16_T ? 2 : 4);
+    }
+
+    // Every byte of the contents produces at most one code point so this is
+    // enough room for the whole array and its terminator
+    size_t bound = size;
+    for (const StringLiteral& literal : mStrings)
+        bound += (literal.dataEnd - literal.dataStart) * size;
 
-            // Get the next character
-            i += utf8Decode(s, &c, i); 
+    if (mStringData.size() < bound)
+        mStringData.resize(bound);
 
-            // Check if this is an escape sequence
-            if (convert)
+    char* begin = &mStringData[0];
+    char* out = begin;
+
+    for (const StringLiteral& literal : mStrings)
+    {
+        const char* p = source + literal.dataStart;
+        const char* end = source + literal.dataEnd;
+
+        while (p < end)
+        {
+            unsigned long c = (unsigned char)*p;
+
+            if (c == '\\' && !literal.raw)
             {
-                switch (c)
+                const char* error = nullptr;
+
+                if ((p = decodeEscape(p, end, c, error)) == nullptr)
                 {
-                case 'a':
-                    appendEncoded(str, 0x07, type);
-                    break;
-                case 'b':
-                    appendEncoded(str, 0x08, type);
-                    break;
-                case 't':
-                    appendEncoded(str, 0x09, type);
-                    break;
-                case 'n':
-                    appendEncoded(str, 0x0a, type);
-                    break;
-                case 'v':
-                    appendEncoded(str, 0x0b, type);
-                    break;
-                case 'f':
-                    appendEncoded(str, 0x0c, type);
-                    break;
-                case 'r':
-                    appendEncoded(str, 0x0d, type);
-                    break;
-                case '\'':
-                    appendEncoded(str, '\'', type);
-                    break;
-                case '"':
-                    appendEncoded(str, '"', type);
-                    break;
-                case '?':
-                    appendEncoded(str, '?', type);
-                    break;
-                case '\\':
-                    appendEncoded(str, '\\', type);
-                    break;
-                case 'x':
-                    {
-                        const char *start = s.c_str() + i;
-                        char *end = nullptr;
-                        unsigned long value;
-
-                        // Decode the value
-                        errno = 0;
-                        value = strtoul(start, &end, 16);
-
-                        // This is already validated in preprocessing but
-                        // we'll check here just to be thorough.
-                        if (start == end)
-                        {
-                            invalidateStringLiterals("invalid hex escape "
-                                "sequence");
-                            return;
-                        }
-
-                        // Verify the value isn't larger than an unsigned
-                        // long and is in the valid course-defined range.
-                        if ((value == ULONG_MAX && errno != 0) ||
-                            (value >= 0xD800 && value < 0xE000) ||
-                            (value >= 0x110000))
-                        {
-                            invalidateStringLiterals("hexidecimal value "
-                                "out-of-range");
-                            return;
-                        }
-
-                        // Encode the value
-                        appendEncoded(str, value, type);
-                        i += end - (s.c_str() + i);
-                    }
-                    break;
-                default:
-                    {
-                        // If this is not a digit it must be a bad escape
-                        // sequence
-                        if (!isdigit(c))
-                        {
-                            invalidateStringLiterals("invalid escape "
-                                "sequence");
-                        }
-
-                        const char *start = s.c_str() + i - 1;
-                        char *end = nullptr;
-                        unsigned long value;
-
-                        // Decode the value
-                        errno = 0;
-                        value = strtoul(start, &end, 8);
-
-                        // This is already validated in preprocessing but
-                        // we'll check here just to be thorough.
-                        if (start == end)
-                        {
-                            invalidateStringLiterals("invalid octal escape "
-                                "sequence");
-                            return;
-                        }
-
-                        // An octal literal can only be three digits so it
-                        // can't overflow an unsigned long so just encode
-                        // it
-                        appendEncoded(str, value, type);
-                        i += end - (s.c_str() + i);
-                    }
+                    invalidateStringLiterals(error);
+                    return;
                 }
 
-                convert = false;
+                out = encodeCodeUnits(out, c, type);
+                continue;
             }
-            else if (!isRaw && c == '\\')
-                convert = true;
+
+            // The text up to the next escape is converted in one go.  Narrow
+            // literals are UTF-8 already so it is copied as it is.
+            const char* run = literal.raw ? nullptr :
+                (const char*)memchr(p, '\\', end - p);
+
+            if (run == nullptr)
+                run = end;
+
+            if (type == FT_CHAR)
+            {
+                memcpy(out, p, run - p);
+                out += run - p;
+            }
+            else if (type == FT_CHAR16_T)
+                out = transcodeUtf8<uint16_t>(p, run, out);
             else
-                appendEncoded(str, c, type);
+                out = transcodeUtf8<uint32_t>(p, run, out);
+
+            p = run;
         }
     }
 
     // Append the terminating character
-    appendEncoded(str, 0, type);
+    out = encodeCodeUnits(out, 0, type);
 
-    // If there is a suffix, then this is user defined
-    if (suffix.length() > 0)
-        mOutput.emit_user_defined_literal_string_array(source, suffix,
-            str.length() / size, type, str.c_str(), str.length());
+    emitStringLiterals(mPool.add(mStringSource, type, (out - begin) / size,
+        suffixed ? mStringSuffix : string(), begin, out - begin));
+}
+
+// Queue a string literal to be concatenated with any that follow it.  The
+// positions of its parts are found once here.
+void TokenStream::queueStringLiteral(const string& data)
+{
+    StringLiteral literal;
+    size_t quote = data.find('"');
+    size_t endQuote = data.rfind('"');
+
+    // Literals in a sequence are separated by spaces in the source
+    if (!mStrings.empty())
+        mStringSource.push_back(' ');
+
+    literal.start = mStringSource.length();
+    literal.quote = literal.start + quote;
+    literal.suffix = literal.start + endQuote + 1;
+    literal.end = literal.start + data.length();
+    literal.raw = quote > 0 && data[quote - 1] == 'R';
+
+    if (literal.raw)
+    {
+        // Skip the delimiter and the parentheses around the contents
+        size_t delimiter = data.find('(', quote) - quote - 1;
+
+        literal.dataStart = literal.quote + delimiter + 2;
+        literal.dataEnd = literal.start + endQuote - delimiter - 1;
+    }
     else
-        mOutput.emit_literal_array(source, str.length() / size, type,
-            str.c_str(), str.length());
+    {
+        literal.dataStart = literal.quote + 1;
+        literal.dataEnd = literal.start + endQuote;
+    }
 
-    mStrings.clear();
+    mStringSource.append(data);
+    mStrings.push_back(literal);
 }
 
 void TokenStream::emit_string_literal(const string& data)
 {
-    // Add this string to the list of strings
-    mStrings.push_back(data);
+    queueStringLiteral(data);
 }
 
 void TokenStream::emit_user_defined_string_literal(const string& data)
 {
-    // Add this string to the list of strings
-    mStrings.push_back(data);
+    queueStringLiteral(data);
 }
 
 void TokenStream::emit_preprocessing_op_or_punc(const string& data)
 {
+    ETokenType type;
+
     processStringLiterals();
 
     // At this point preprocessing identifiers are invalid
     if (data == "#" || data == "##" || data == "%:" || data == "%:%:")
         mOutput.emit_invalid(data);
     // Check if this is a simple token
-    else if (StringToTokenTypeMap.find(data) != StringToTokenTypeMap.end())
-        mOutput.emit_simple(data, StringToTokenTypeMap.at(data));
+    else if (SimpleTokenType(data, type))
+        mOutput.emit_simple(data, type);
     else
     {
         mOutput.emit_invalid(data);
@@ -1433,6 +1716,15 @@ void TokenStream::emit_non_whitespace_char(const string& data)
     printError("Non-whitespace characters are invalid: ", data);
 }
 
+void TokenStream::emit_error(const string& data, const string& message)
+{
+    processStringLiterals();
+
+    // The tokenizer already skipped the rest of the line
+    mOutput.emit_invalid(data);
+    printError(message + ": ", data);
+}
+
 void TokenStream::emit_eof()
 {
     processStringLiterals();
@@ -1442,5 +1734,10 @@ void TokenStream::emit_eof()
 
 void TokenStream::printError(const string& msg, const string& value)
 {
-    cerr << "ERROR: " << msg << value << endl;
+    if (mErrorOutput)
+        mErrorOutput->append("ERROR: ").append(msg).append(value) += '\n';
+    else
+        cerr << "ERROR: " << msg << value << endl;
+
+    mErrors++;
 }
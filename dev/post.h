@@ -2,12 +2,17 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include "token.h"
 #include "pp.h"
 
 using namespace std;
 
+// Look up the ETokenType of a `simple` `preprocessing-token`, returns false
+// if data isn't one
+bool SimpleTokenType(const string& data, ETokenType& type);
+
 // DebugPostTokenOutputStream: helper class to produce PA2 output format
 class IPostTokenOutputStream
 {
@@ -22,6 +27,46 @@ public:
     virtual void emit_user_defined_literal_integer(const string& source, const string& ud_suffix, const string& prefix) = 0;
     virtual void emit_user_defined_literal_floating(const string& source, const string& ud_suffix, const string& prefix) = 0;
     virtual void emit_eof() = 0;
+
+    // String literal sequences also come with the ID of their entry in the
+    // StringLiteralPool, which is the same for every repeat of the sequence
+    virtual void emit_pooled_literal_array(size_t id, const string& source, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+    {
+        emit_literal_array(source, num_elements, type, data, nbytes);
+    }
+
+    virtual void emit_pooled_user_defined_literal_string_array(size_t id, const string& source, const string& ud_suffix, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+    {
+        emit_user_defined_literal_string_array(source, ud_suffix, num_elements, type, data, nbytes);
+    }
+};
+
+// StringLiteralPool: decoded string literal sequences keyed by their
+// spelling, encoding-prefixes and raw delimiters included, so a repeated
+// sequence is decoded only once
+class StringLiteralPool
+{
+public:
+    struct Entry
+    {
+        EFundamentalType type;
+        size_t count;       // number of elements, including the terminator
+        string suffix;      // empty unless user defined
+        string data;
+    };
+
+    // Find the entry for source, returns nullptr if there is none
+    const Entry* find(const string& source, size_t& id) const;
+
+    size_t add(const string& source, EFundamentalType type, size_t count,
+        const string& suffix, const char* data, size_t nbytes);
+
+    const Entry& operator[](size_t id) const { return mEntries[id]; }
+    size_t size() const { return mEntries.size(); }
+
+protected:
+    unordered_map<string, size_t> mIds;
+    vector<Entry> mEntries;
 };
 
 class TokenStream : public IPPTokenStream
@@ -36,30 +81,52 @@ public:
     virtual void emit_identifier(const string& data);
     EFundamentalType getFloatSuffixSize(const string& suffix);
     void processFloat(const string& data);
-    EFundamentalType sizeDecimal(unsigned long long value,
-        EFundamentalType type);
-    EFundamentalType sizeOctOrHex(unsigned long long value,
-        EFundamentalType type);
-    EFundamentalType getIntSuffixSize(const string& suffix);
-    void processDecimal(const string& data);
-    void processHexidecimal(const string& data);
-    void processOctal(const string& data);
+    void processInteger(const string& data, unsigned int base);
     virtual void emit_pp_number(const string& data);
     bool processCharLiteral(const string& data, EFundamentalType *type,
         unsigned long *value, unsigned int *size);
     virtual void emit_character_literal(const string& data);
     virtual void emit_user_defined_character_literal(const string& data);
     void invalidateStringLiterals(const string& err);
-    bool appendEncoded(string& output, unsigned long c, EFundamentalType type);
+    void emitStringLiterals(size_t id);
     void processStringLiterals();
+    void queueStringLiteral(const string& data);
     virtual void emit_string_literal(const string& data);
     virtual void emit_user_defined_string_literal(const string& data);
     virtual void emit_preprocessing_op_or_punc(const string& data);
     virtual void emit_non_whitespace_char(const string& data);
+    virtual void emit_error(const string& data, const string& message);
     virtual void emit_eof();
     void printError(const string& msg, const string& value);
 
+    const StringLiteralPool& pool() const { return mPool; }
+
+    // Number of diagnostics printed so far
+    size_t errors() const { return mErrors; }
+
+    // Append diagnostics to errors instead of writing them to cerr
+    void setErrorOutput(string* errors) { mErrorOutput = errors; }
+
 protected:
+    // StringLiteral: where the parts of a queued string literal are in
+    // mStringSource
+    struct StringLiteral
+    {
+        size_t start;       // encoding-prefix
+        size_t quote;       // opening quote
+        size_t dataStart;   // contents, without a raw string's delimiters
+        size_t dataEnd;
+        size_t suffix;      // ud-suffix after the closing quote
+        size_t end;
+        bool raw;
+    };
+
     IPostTokenOutputStream& mOutput;
-    vector<string> mStrings;
+    vector<StringLiteral> mStrings;
+    string mStringSource;   // queued literals separated by spaces
+    string mStringSuffix;
+    string mStringData;     // encoded array, reused between sequences
+    StringLiteralPool mPool;
+    size_t mErrors;
+    string* mErrorOutput;
 };
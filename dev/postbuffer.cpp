@@ -0,0 +1,354 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "token.h"
+#include "post.h"
+#include "postbuffer.h"
+
+using namespace std;
+
+// Size of a value of a fundamental type as emitted by TokenStream
+static size_t fundamentalSize(EFundamentalType type)
+{
+    switch (type)
+    {
+    case FT_SIGNED_CHAR: return sizeof(signed char);
+    case FT_SHORT_INT: return sizeof(short int);
+    case FT_INT: return sizeof(int);
+    case FT_LONG_INT: return sizeof(long int);
+    case FT_LONG_LONG_INT: return sizeof(long long int);
+    case FT_UNSIGNED_CHAR: return sizeof(unsigned char);
+    case FT_UNSIGNED_SHORT_INT: return sizeof(unsigned short int);
+    case FT_UNSIGNED_INT: return sizeof(unsigned int);
+    case FT_UNSIGNED_LONG_INT: return sizeof(unsigned long int);
+    case FT_UNSIGNED_LONG_LONG_INT: return sizeof(unsigned long long int);
+    case FT_WCHAR_T: return sizeof(wchar_t);
+    case FT_CHAR: return sizeof(char);
+    case FT_CHAR16_T: return sizeof(char16_t);
+    case FT_CHAR32_T: return sizeof(char32_t);
+    case FT_BOOL: return sizeof(bool);
+    case FT_FLOAT: return sizeof(float);
+    case FT_DOUBLE: return sizeof(double);
+    case FT_LONG_DOUBLE: return sizeof(long double);
+    default: return 0;
+    }
+}
+
+template<typename T>
+static uint64_t integerValue(const void* data)
+{
+    T value;
+
+    memcpy(&value, data, sizeof(value));
+    return (uint64_t)value;
+}
+
+static string spanText(const char* arena, Span span)
+{
+    return string(arena + span.offset, span.length);
+}
+
+Span PostTokenBuffer::store(const void* data, size_t nbytes)
+{
+    Span span;
+
+    if (mArena.length() + nbytes > UINT32_MAX)
+        throw length_error("post-token arena is full");
+
+    span.offset = mArena.length();
+    span.length = nbytes;
+
+    mArena.append((const char*)data, nbytes);
+
+    return span;
+}
+
+PostToken& PostTokenBuffer::push(EPostTokenKind kind, const string& source)
+{
+    PostToken token;
+
+    memset(&token, 0, sizeof(token));
+    token.kind = kind;
+    token.source = store(source.data(), source.length());
+
+    mTokens.push_back(token);
+
+    return mTokens.back();
+}
+
+void PostTokenBuffer::setValue(PostToken& token, EFundamentalType type,
+    const void* data, size_t nbytes)
+{
+    token.type = type;
+
+    // Integral values are widened with their own signedness so the low
+    // bytes are the emitted ones
+    switch (type)
+    {
+    case FT_SIGNED_CHAR: token.value.integer = integerValue<signed char>(data); break;
+    case FT_SHORT_INT: token.value.integer = integerValue<short int>(data); break;
+    case FT_INT: token.value.integer = integerValue<int>(data); break;
+    case FT_LONG_INT: token.value.integer = integerValue<long int>(data); break;
+    case FT_LONG_LONG_INT: token.value.integer = integerValue<long long int>(data); break;
+    case FT_UNSIGNED_CHAR: token.value.integer = integerValue<unsigned char>(data); break;
+    case FT_UNSIGNED_SHORT_INT: token.value.integer = integerValue<unsigned short int>(data); break;
+    case FT_UNSIGNED_INT: token.value.integer = integerValue<unsigned int>(data); break;
+    case FT_UNSIGNED_LONG_INT: token.value.integer = integerValue<unsigned long int>(data); break;
+    case FT_UNSIGNED_LONG_LONG_INT: token.value.integer = integerValue<unsigned long long int>(data); break;
+    case FT_WCHAR_T: token.value.integer = integerValue<wchar_t>(data); break;
+    case FT_CHAR: token.value.integer = integerValue<char>(data); break;
+    case FT_CHAR16_T: token.value.integer = integerValue<char16_t>(data); break;
+    case FT_CHAR32_T: token.value.integer = integerValue<char32_t>(data); break;
+    case FT_BOOL: token.value.integer = integerValue<bool>(data); break;
+    case FT_FLOAT: memcpy(&token.value.f, data, sizeof(float)); break;
+    case FT_DOUBLE: memcpy(&token.value.d, data, sizeof(double)); break;
+    default: token.value.bytes = store(data, nbytes); break;
+    }
+}
+
+// Arrays of a pooled string literal sequence are stored once.  Checking the
+// bytes as well keeps this right if the buffer outlives the TokenStream
+// whose pool the ID came from.
+Span PostTokenBuffer::storeArray(size_t id, const void* data, size_t nbytes)
+{
+    if (id < mPooled.size() && mPooled[id].length == nbytes &&
+            memcmp(this->data(mPooled[id]), data, nbytes) == 0)
+        return mPooled[id];
+
+    Span span = store(data, nbytes);
+
+    if (id >= mPooled.size())
+        mPooled.resize(id + 1, Span());
+
+    mPooled[id] = span;
+
+    return span;
+}
+
+void PostTokenBuffer::emit_invalid(const string& source)
+{
+    push(POST_INVALID, source);
+}
+
+void PostTokenBuffer::emit_simple(const string& source, ETokenType token_type)
+{
+    push(POST_SIMPLE, source).simple = token_type;
+}
+
+void PostTokenBuffer::emit_identifier(const string& source)
+{
+    push(POST_IDENTIFIER, source);
+}
+
+void PostTokenBuffer::emit_literal(const string& source, EFundamentalType type, const void* data, size_t nbytes)
+{
+    setValue(push(POST_LITERAL, source), type, data, nbytes);
+}
+
+void PostTokenBuffer::emit_literal_array(const string& source, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+{
+    PostToken& token = push(POST_LITERAL_ARRAY, source);
+
+    token.type = type;
+    token.value.bytes = store(data, nbytes);
+}
+
+void PostTokenBuffer::emit_user_defined_literal_character(const string& source, const string& ud_suffix, EFundamentalType type, const void* data, size_t nbytes)
+{
+    PostToken& token = push(POST_USER_DEFINED_CHARACTER, source);
+
+    token.suffix = store(ud_suffix.data(), ud_suffix.length());
+    setValue(token, type, data, nbytes);
+}
+
+void PostTokenBuffer::emit_user_defined_literal_string_array(const string& source, const string& ud_suffix, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+{
+    PostToken& token = push(POST_USER_DEFINED_STRING_ARRAY, source);
+
+    token.type = type;
+    token.suffix = store(ud_suffix.data(), ud_suffix.length());
+    token.value.bytes = store(data, nbytes);
+}
+
+void PostTokenBuffer::emit_user_defined_literal_integer(const string& source, const string& ud_suffix, const string& prefix)
+{
+    PostToken& token = push(POST_USER_DEFINED_INTEGER, source);
+
+    token.suffix = store(ud_suffix.data(), ud_suffix.length());
+    token.value.prefix = store(prefix.data(), prefix.length());
+}
+
+void PostTokenBuffer::emit_user_defined_literal_floating(const string& source, const string& ud_suffix, const string& prefix)
+{
+    PostToken& token = push(POST_USER_DEFINED_FLOATING, source);
+
+    token.suffix = store(ud_suffix.data(), ud_suffix.length());
+    token.value.prefix = store(prefix.data(), prefix.length());
+}
+
+void PostTokenBuffer::emit_eof()
+{
+    push(POST_EOF, "");
+}
+
+void PostTokenBuffer::emit_pooled_literal_array(size_t id, const string& source, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+{
+    PostToken& token = push(POST_LITERAL_ARRAY, source);
+
+    token.type = type;
+    token.value.bytes = storeArray(id, data, nbytes);
+}
+
+void PostTokenBuffer::emit_pooled_user_defined_literal_string_array(size_t id, const string& source, const string& ud_suffix, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes)
+{
+    PostToken& token = push(POST_USER_DEFINED_STRING_ARRAY, source);
+
+    token.type = type;
+    token.suffix = store(ud_suffix.data(), ud_suffix.length());
+    token.value.bytes = storeArray(id, data, nbytes);
+}
+
+size_t PostTokenBuffer::elements(const PostToken& token)
+{
+    size_t size = fundamentalSize(token.type);
+
+    return size > 0 ? token.value.bytes.length / size : 0;
+}
+
+void PostTokenBuffer::clear()
+{
+    mTokens.clear();
+    mArena.clear();
+    mPooled.clear();
+}
+
+void PostTokenBuffer::replay(IPostTokenOutputStream& output) const
+{
+    for (const PostToken& token : mTokens)
+        replay(token, mArena.data(), output);
+}
+
+#define COUNT_TYPE(name, spelling) + 1
+#define COUNT_TOKEN(name) + 1
+
+static const unsigned int FundamentalTypeCount =
+    0 FUNDAMENTAL_TYPES(COUNT_TYPE);
+static const unsigned int TokenTypeCount =
+    0 KEYWORD_TOKEN_TYPES(COUNT_TOKEN) OPERATOR_TOKEN_TYPES(COUNT_TOKEN);
+
+#undef COUNT_TYPE
+#undef COUNT_TOKEN
+
+static bool inArena(Span span, size_t arenaLength)
+{
+    return span.offset <= arenaLength &&
+        span.length <= arenaLength - span.offset;
+}
+
+// Values that don't fit the union keep their bytes in the arena
+static bool valueInArena(const PostToken& token)
+{
+    return (token.kind == POST_LITERAL ||
+            token.kind == POST_USER_DEFINED_CHARACTER) &&
+        (token.type == FT_LONG_DOUBLE || fundamentalSize(token.type) == 0);
+}
+
+bool PostTokenBuffer::replayable(const PostToken& token, size_t arenaLength)
+{
+    if (!inArena(token.source, arenaLength))
+        return false;
+
+    switch (token.kind)
+    {
+    case POST_INVALID:
+    case POST_IDENTIFIER:
+    case POST_EOF:
+        return true;
+    case POST_SIMPLE:
+        return (unsigned int)token.simple < TokenTypeCount;
+    case POST_LITERAL:
+    case POST_LITERAL_ARRAY:
+    case POST_USER_DEFINED_CHARACTER:
+    case POST_USER_DEFINED_STRING_ARRAY:
+        if ((unsigned int)token.type >= FundamentalTypeCount)
+            return false;
+
+        if ((token.kind == POST_USER_DEFINED_CHARACTER ||
+                token.kind == POST_USER_DEFINED_STRING_ARRAY) &&
+                !inArena(token.suffix, arenaLength))
+            return false;
+
+        if ((token.kind == POST_LITERAL_ARRAY ||
+                token.kind == POST_USER_DEFINED_STRING_ARRAY ||
+                valueInArena(token)) &&
+                !inArena(token.value.bytes, arenaLength))
+            return false;
+
+        return true;
+    case POST_USER_DEFINED_INTEGER:
+    case POST_USER_DEFINED_FLOATING:
+        return inArena(token.suffix, arenaLength) &&
+            inArena(token.value.prefix, arenaLength);
+    default:
+        return false;
+    }
+}
+
+// Replay a token whose text and arrays are in arena, which need not belong
+// to a PostTokenBuffer
+void PostTokenBuffer::replay(const PostToken& token, const char* arena,
+    IPostTokenOutputStream& output)
+{
+    const void* value = &token.value;
+    size_t nbytes = fundamentalSize(token.type);
+
+    if (valueInArena(token))
+    {
+        value = arena + token.value.bytes.offset;
+        nbytes = token.value.bytes.length;
+    }
+
+    string source = spanText(arena, token.source);
+
+    switch (token.kind)
+    {
+    case POST_INVALID:
+        output.emit_invalid(source);
+        break;
+    case POST_SIMPLE:
+        output.emit_simple(source, token.simple);
+        break;
+    case POST_IDENTIFIER:
+        output.emit_identifier(source);
+        break;
+    case POST_LITERAL:
+        output.emit_literal(source, token.type, value, nbytes);
+        break;
+    case POST_LITERAL_ARRAY:
+        output.emit_literal_array(source, elements(token), token.type,
+            arena + token.value.bytes.offset, token.value.bytes.length);
+        break;
+    case POST_USER_DEFINED_CHARACTER:
+        output.emit_user_defined_literal_character(source,
+            spanText(arena, token.suffix), token.type, value, nbytes);
+        break;
+    case POST_USER_DEFINED_STRING_ARRAY:
+        output.emit_user_defined_literal_string_array(source,
+            spanText(arena, token.suffix), elements(token), token.type,
+            arena + token.value.bytes.offset, token.value.bytes.length);
+        break;
+    case POST_USER_DEFINED_INTEGER:
+        output.emit_user_defined_literal_integer(source,
+            spanText(arena, token.suffix), spanText(arena, token.value.prefix));
+        break;
+    case POST_USER_DEFINED_FLOATING:
+        output.emit_user_defined_literal_floating(source,
+            spanText(arena, token.suffix), spanText(arena, token.value.prefix));
+        break;
+    case POST_EOF:
+        output.emit_eof();
+        break;
+    }
+}
@@ -0,0 +1,114 @@
+/// Recorded stream of post-tokens as plain records
+///
+/// @file postbuffer.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "token.h"
+#include "post.h"
+
+using namespace std;
+
+// Kinds of tokens emitted through IPostTokenOutputStream
+enum EPostTokenKind
+{
+    POST_INVALID,
+    POST_SIMPLE,
+    POST_IDENTIFIER,
+    POST_LITERAL,
+    POST_LITERAL_ARRAY,
+    POST_USER_DEFINED_CHARACTER,
+    POST_USER_DEFINED_STRING_ARRAY,
+    POST_USER_DEFINED_INTEGER,
+    POST_USER_DEFINED_FLOATING,
+    POST_EOF
+};
+
+// Span: a range of bytes in the arena of a PostTokenBuffer
+struct Span
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+// PostToken: a post-token with its value already decoded.  Any text or
+// array data lives in the arena of the buffer that holds the token.
+struct PostToken
+{
+    EPostTokenKind kind;
+
+    union
+    {
+        ETokenType simple;      // POST_SIMPLE
+        EFundamentalType type;  // literals
+    };
+
+    Span source;
+    Span suffix;                // ud-suffix of user defined literals
+
+    union
+    {
+        uint64_t integer;       // integral and character literals
+        float f;
+        double d;
+        Span bytes;             // arrays and long double literals
+        Span prefix;            // user defined integer and floating literals
+    } value;
+};
+
+// PostTokenBuffer: records every emitted post-token in one vector so later
+// phases can scan them without virtual calls or decoding them again
+class PostTokenBuffer : public IPostTokenOutputStream
+{
+public:
+    typedef vector<PostToken> TokenList;
+
+    void emit_invalid(const string& source);
+    void emit_simple(const string& source, ETokenType token_type);
+    void emit_identifier(const string& source);
+    void emit_literal(const string& source, EFundamentalType type, const void* data, size_t nbytes);
+    void emit_literal_array(const string& source, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes);
+    void emit_user_defined_literal_character(const string& source, const string& ud_suffix, EFundamentalType type, const void* data, size_t nbytes);
+    void emit_user_defined_literal_string_array(const string& source, const string& ud_suffix, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes);
+    void emit_user_defined_literal_integer(const string& source, const string& ud_suffix, const string& prefix);
+    void emit_user_defined_literal_floating(const string& source, const string& ud_suffix, const string& prefix);
+    void emit_eof();
+
+    void emit_pooled_literal_array(size_t id, const string& source, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes);
+    void emit_pooled_user_defined_literal_string_array(size_t id, const string& source, const string& ud_suffix, size_t num_elements, EFundamentalType type, const void* data, size_t nbytes);
+
+    void replay(IPostTokenOutputStream& output) const;
+    static void replay(const PostToken& token, const char* arena,
+        IPostTokenOutputStream& output);
+
+    // Whether replay reads only inside an arena of arenaLength bytes for
+    // token and finds a kind and types it knows, for tokens read from files
+    static bool replayable(const PostToken& token, size_t arenaLength);
+
+    const char* data(Span span) const { return mArena.data() + span.offset; }
+    string text(Span span) const { return string(data(span), span.length); }
+
+    // Number of elements of an array, including the terminator
+    static size_t elements(const PostToken& token);
+
+    TokenList& tokens() { return mTokens; }
+    const TokenList& tokens() const { return mTokens; }
+    const string& arena() const { return mArena; }
+
+    void clear();
+
+protected:
+    Span store(const void* data, size_t nbytes);
+    PostToken& push(EPostTokenKind kind, const string& source);
+    void setValue(PostToken& token, EFundamentalType type, const void* data,
+        size_t nbytes);
+    Span storeArray(size_t id, const void* data, size_t nbytes);
+
+    TokenList mTokens;
+    string mArena;
+    vector<Span> mPooled;   // arrays of the StringLiteralPool entries seen
+};
@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "post.h"
+#include "postbuffer.h"
+#include "postcache.h"
+#include "wordhash.h"
+
+using namespace std;
+
+// The Makefile sets this to a checksum of the sources the tokens depend on,
+// so cache files from any other build are no longer found
+#ifndef POST_TOKEN_CACHE_VERSION
+#error POST_TOKEN_CACHE_VERSION must be set by the build
+#endif
+
+static const uint32_t PostTokenCacheVersion = POST_TOKEN_CACHE_VERSION;
+
+static const char PostTokenCacheMagic[8] = "PTCACHE";
+
+struct PostTokenCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;    // sizeof(PostToken)
+    uint64_t key;
+    uint64_t inputLength;
+    uint64_t tokens;
+    uint64_t arenaLength;
+};
+
+// Mapping: a read-only mapping of a whole file, unmapped when it goes away
+struct Mapping
+{
+    Mapping(const string& path)
+        : data(MAP_FAILED), size(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+            return;
+
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            size = st.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+
+        close(fd);
+    }
+
+    ~Mapping()
+    {
+        if (data != MAP_FAILED)
+            munmap(data, size);
+    }
+
+    void* data;
+    size_t size;
+};
+
+PostTokenCache::PostTokenCache(const string& directory)
+    : mDirectory(directory)
+{}
+
+// Hash the input a word at a time.  The version is the seed so a new
+// version gives every input a new key.
+uint64_t PostTokenCache::hash(const char* data, size_t length)
+{
+    return WordHash(data, length, PostTokenCacheVersion);
+}
+
+string PostTokenCache::path(uint64_t key) const
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "/%016llx.ptc", (unsigned long long)key);
+
+    return mDirectory + name;
+}
+
+bool PostTokenCache::replay(const string& input,
+    IPostTokenOutputStream& output) const
+{
+    uint64_t key = hash(input.data(), input.length());
+    Mapping file(path(key));
+
+    if (file.data == MAP_FAILED || file.size < sizeof(PostTokenCacheHeader))
+        return false;
+
+    const PostTokenCacheHeader* header =
+        (const PostTokenCacheHeader*)file.data;
+
+    // A header that doesn't match exactly is a miss, including that of a
+    // file that was cut short
+    if (memcmp(header->magic, PostTokenCacheMagic, sizeof(header->magic)) ||
+            header->version != PostTokenCacheVersion ||
+            header->recordSize != sizeof(PostToken) ||
+            header->key != key ||
+            header->inputLength != input.length() ||
+            header->tokens > file.size / sizeof(PostToken) ||
+            header->arenaLength > file.size ||
+            sizeof(PostTokenCacheHeader) + header->tokens * sizeof(PostToken) +
+                header->arenaLength != file.size)
+        return false;
+
+    const PostToken* tokens = (const PostToken*)(header + 1);
+    const char* arena = (const char*)(tokens + header->tokens);
+
+    // So is a damaged file with a token that would make replay read outside
+    // the arena, checked before anything is replayed
+    for (uint64_t i = 0; i < header->tokens; i++)
+    {
+        if (!PostTokenBuffer::replayable(tokens[i], header->arenaLength))
+            return false;
+    }
+
+    for (uint64_t i = 0; i < header->tokens; i++)
+        PostTokenBuffer::replay(tokens[i], arena, output);
+
+    return true;
+}
+
+bool PostTokenCache::store(const string& input,
+    const PostTokenBuffer& buffer) const
+{
+    PostTokenCacheHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PostTokenCacheMagic, sizeof(header.magic));
+    header.version = PostTokenCacheVersion;
+    header.recordSize = sizeof(PostToken);
+    header.key = hash(input.data(), input.length());
+    header.inputLength = input.length();
+    header.tokens = buffer.tokens().size();
+    header.arenaLength = buffer.arena().length();
+
+    mkdir(mDirectory.c_str(), 0777);
+
+    // Write to a file of our own and rename it into place so readers never
+    // see a partial file
+    string file = path(header.key);
+    string temp = file + "." + to_string(getpid());
+
+    ofstream out(temp, ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)buffer.tokens().data(),
+        buffer.tokens().size() * sizeof(PostToken));
+    out.write(buffer.arena().data(), buffer.arena().length());
+    out.close();
+
+    if (!out || rename(temp.c_str(), file.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
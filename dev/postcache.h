@@ -0,0 +1,37 @@
+/// On-disk cache of post-token streams
+///
+/// @file postcache.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "post.h"
+#include "postbuffer.h"
+
+using namespace std;
+
+// PostTokenCache: the post-tokens of whole inputs kept in a directory, one
+// file per input named after a hash of its contents and the cache version.
+// A file holds the PostToken records of a PostTokenBuffer followed by its
+// arena, so a hit replays them straight from the mapped file.
+class PostTokenCache
+{
+public:
+    PostTokenCache(const string& directory);
+
+    // Replay the cached tokens of input to output, returns false on a miss
+    bool replay(const string& input, IPostTokenOutputStream& output) const;
+
+    // Store the tokens of a complete run over input, returns false if the
+    // cache file couldn't be written
+    bool store(const string& input, const PostTokenBuffer& buffer) const;
+
+    static uint64_t hash(const char* data, size_t length);
+
+protected:
+    string path(uint64_t key) const;
+
+    string mDirectory;
+};
@@ -5,6 +5,9 @@
 #include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include <cstring>
+#include <cstdint>
 
 using namespace std;
 
@@ -37,7 +40,8 @@ static int HexCharToValue(int c)
     case 'e': return 14;
     case 'F': return 15;
     case 'f': return 15;
-    default: throw logic_error("HexCharToValue of nonhex char");
+    // Callers check IS_HEXDIGIT first
+    default: return -1;
     }
 }
 
@@ -131,7 +135,8 @@ static const unordered_set<int> SimpleEscapeSequence_CodePoints =
     mState = x;} while (false)
 
 #define EMIT_TOKEN(type, x) do { \
-    output.emit_##type(utf8Encode(mCpStream.substr(0, x))); \
+    if (emits(x)) \
+        output.emit_##type(utf8Encode(mCpStream.substr(0, x))); \
     RESET_STATE(x);} while (false)
 
 #define RESET_STATE(x) do { \
@@ -149,16 +154,252 @@ static const unordered_set<int> SimpleEscapeSequence_CodePoints =
     mState = mReturnState; \
     mReturnState = 0;} while (false)
 
+#define DISCARD_STATE() do { \
+    mCpStream.erase(0, mForward+1); \
+    mForward = 0;} while (false)
+
 PPTokenizer::PPTokenizer(IPPTokenStream& output)
 :   output(output),
     mForward(0),
     mTranslate(true),
-    mTransState(TRIGRAPH_DECODE),
+    mTransState(TRANS_START),
     mState(PTOKEN_START),
     mLastToken(0),
-    mReturnState(0)
+    mReturnState(0),
+    mTransForward(0),
+    mUtf8Count(0),
+    mUtf8Value(0),
+    mDirectivesOnly(false),
+    mLineStart(true),
+    mSkipLine(false),
+    mRecovery(false),
+    mSkipping(false)
 {}
 
+bool PPTokenizer::Checkpoint::operator==(const Checkpoint& other) const
+{
+    return state == other.state && returnState == other.returnState &&
+        lastToken == other.lastToken && forward == other.forward &&
+        translate == other.translate && lineStart == other.lineStart &&
+        skipLine == other.skipLine && cpStream == other.cpStream &&
+        rawDelim == other.rawDelim;
+}
+
+bool PPTokenizer::checkpoint(Checkpoint& cp) const
+{
+    // Only the tokenizer state is saved so the translator must be between
+    // characters
+    if (!translatorIdle())
+        return false;
+
+    cp.state = mState;
+    cp.returnState = mReturnState;
+    cp.lastToken = mLastToken;
+    cp.forward = mForward;
+    cp.translate = mTranslate;
+    cp.lineStart = mLineStart;
+    cp.skipLine = mSkipLine;
+    cp.cpStream = mCpStream;
+    cp.rawDelim = mRawDelim;
+
+    return true;
+}
+
+void PPTokenizer::resume(const Checkpoint& cp)
+{
+    mState = cp.state;
+    mReturnState = cp.returnState;
+    mLastToken = cp.lastToken;
+    mForward = cp.forward;
+    mTranslate = cp.translate;
+    mLineStart = cp.lineStart;
+    mSkipLine = cp.skipLine;
+    mCpStream = cp.cpStream;
+    mRawDelim = cp.rawDelim;
+
+    mTransBuffer.clear();
+    mTransForward = 0;
+    mTransState = TRANS_START;
+    mUtf8Count = 0;
+    mUtf8Value = 0;
+}
+
+// Snapshots start with this magic and version followed by every field of
+// the tokenizer and translator as a varint.  Code point strings are stored
+// as their length followed by each code point.
+static const char SnapshotMagic[4] = { 'P', 'P', 'T', 'K' };
+static const unsigned int SnapshotVersion = 4;
+
+static void putVarint(string& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back((char)value);
+}
+
+static uint32_t getVarint(const string& in, size_t& pos)
+{
+    uint32_t value = 0;
+
+    for (unsigned int shift = 0; shift < 35; shift += 7)
+    {
+        if (pos >= in.length())
+            throw runtime_error("truncated tokenizer snapshot");
+
+        unsigned char c = in[pos++];
+        value |= (uint32_t)(c & 0x7f) << shift;
+
+        if (!(c & 0x80))
+            return value;
+    }
+
+    throw runtime_error("malformed tokenizer snapshot");
+}
+
+static void putCodePoints(string& out, const u32string& str)
+{
+    putVarint(out, str.length());
+
+    for (char32_t c : str)
+        putVarint(out, c);
+}
+
+static u32string getCodePoints(const string& in, size_t& pos)
+{
+    uint32_t length = getVarint(in, pos);
+    u32string str;
+
+    // Every code point takes at least a byte so don't trust a length that
+    // is longer than what is left
+    if (length > in.length() - pos)
+        throw runtime_error("truncated tokenizer snapshot");
+
+    str.reserve(length);
+    for (uint32_t i = 0; i < length; i++)
+        str.push_back(getVarint(in, pos));
+
+    return str;
+}
+
+string PPTokenizer::snapshot() const
+{
+    string out(SnapshotMagic, sizeof(SnapshotMagic));
+
+    putVarint(out, SnapshotVersion);
+    putVarint(out, mState);
+    putVarint(out, mReturnState);
+    putVarint(out, mLastToken);
+    putVarint(out, mForward);
+    putVarint(out, mTranslate);
+    putVarint(out, mTransState);
+    putVarint(out, mTransForward);
+    putVarint(out, mUtf8Count);
+    putVarint(out, mUtf8Value);
+    putVarint(out, mDirectivesOnly);
+    putVarint(out, mLineStart);
+    putVarint(out, mSkipLine);
+    putVarint(out, mRecovery);
+    putVarint(out, mSkipping);
+    putCodePoints(out, mCpStream);
+    putCodePoints(out, mRawDelim);
+    putCodePoints(out, mTransBuffer);
+
+    return out;
+}
+
+void PPTokenizer::restore(const string& snapshot)
+{
+    size_t pos = sizeof(SnapshotMagic);
+
+    if (snapshot.compare(0, pos, SnapshotMagic, pos) != 0)
+        throw runtime_error("not a tokenizer snapshot");
+
+    if (getVarint(snapshot, pos) != SnapshotVersion)
+        throw runtime_error("unsupported tokenizer snapshot version");
+
+    int state = getVarint(snapshot, pos);
+    int returnState = getVarint(snapshot, pos);
+    int lastToken = getVarint(snapshot, pos);
+    unsigned int forward = getVarint(snapshot, pos);
+    bool translate = getVarint(snapshot, pos) != 0;
+    int transState = getVarint(snapshot, pos);
+    unsigned int transForward = getVarint(snapshot, pos);
+    int utf8Count = getVarint(snapshot, pos);
+    int utf8Value = getVarint(snapshot, pos);
+    bool directivesOnly = getVarint(snapshot, pos) != 0;
+    bool lineStart = getVarint(snapshot, pos) != 0;
+    bool skipLine = getVarint(snapshot, pos) != 0;
+    bool recovery = getVarint(snapshot, pos) != 0;
+    bool skipping = getVarint(snapshot, pos) != 0;
+    u32string cpStream = getCodePoints(snapshot, pos);
+    u32string rawDelim = getCodePoints(snapshot, pos);
+    u32string transBuffer = getCodePoints(snapshot, pos);
+
+    if (pos != snapshot.length() ||
+            state < PTOKEN_START || state > RECOVER ||
+            returnState < 0 || returnState > RECOVER ||
+            lastToken < 0 || lastToken > RECOVER ||
+            forward > cpStream.length() ||
+            transState < TRANS_START || transState > UCN_DECODE_32 ||
+            transForward > transBuffer.length() ||
+            utf8Count < 0 || utf8Count > 3)
+        throw runtime_error("malformed tokenizer snapshot");
+
+    mState = state;
+    mReturnState = returnState;
+    mLastToken = lastToken;
+    mForward = forward;
+    mTranslate = translate;
+    mTransState = transState;
+    mTransForward = transForward;
+    mUtf8Count = utf8Count;
+    mUtf8Value = utf8Value;
+    mDirectivesOnly = directivesOnly;
+    mLineStart = lineStart;
+    mSkipLine = skipLine;
+    mRecovery = recovery;
+    mSkipping = skipping;
+    mCpStream = cpStream;
+    mRawDelim = rawDelim;
+    mTransBuffer = transBuffer;
+}
+
+void PPTokenizer::setDirectivesOnly(bool directivesOnly)
+{
+    mDirectivesOnly = directivesOnly;
+}
+
+bool PPTokenizer::translatorIdle() const
+{
+    return mTransState == TRANS_START && mTransBuffer.empty() &&
+        mTransForward == 0 && mUtf8Count == 0;
+}
+
+// Check if the token of the given length at the start of the stream should
+// be emitted.  The first token on each line decides if it is a directive.
+bool PPTokenizer::emits(unsigned int length)
+{
+    if (mLineStart)
+    {
+        mLineStart = false;
+        mSkipLine = mCpStream.compare(0, length, U"#") != 0 &&
+            mCpStream.compare(0, length, U"%:") != 0;
+    }
+
+    return !filters() || !mSkipLine;
+}
+
+// Whitespace and new-lines are only emitted inside directives, and never
+// before the # since the line might not be one
+bool PPTokenizer::emitsLayout() const
+{
+    return !filters() || (!mLineStart && !mSkipLine);
+}
+
 static bool isAnnexE1(int cp)
 {
     for(vector<pair<int, int>>::const_iterator it = \
@@ -185,46 +426,49 @@ static bool isAnnexE2(int cp)
     return false;
 }
 
-static int utf8Decode(int c)
+int PPTokenizer::utf8Decode(int c)
 {
-    static int utf8Count = 0, utf8Value = 0;
-
     // Check if the first byte is valid
-    if (utf8Count == 0)
+    if (mUtf8Count == 0)
     {
         if (c < 0x7f)
             return c;
         else if (c >= 0xf0 && c <= 0xf7)
         {
-            utf8Count = 3;
-            utf8Value = c & 0x07;
+            mUtf8Count = 3;
+            mUtf8Value = c & 0x07;
         }
         else if (c >= 0xe0 && c <= 0xe8)
         {
-            utf8Count = 2;
-            utf8Value = c & 0x0f;
+            mUtf8Count = 2;
+            mUtf8Value = c & 0x0f;
         }
         else if (c >= 0xc0 && c <= 0xdf)
         {
-            utf8Count = 1;
-            utf8Value = c & 0x1f;
+            mUtf8Count = 1;
+            mUtf8Value = c & 0x1f;
         }
         else
-            throw runtime_error("invalid UTF8 sequence");
+            error("invalid UTF8 sequence");
 
         return -1;
     }
 
-    // Check that continuation bytes are valid
+    // Check that continuation bytes are valid.  When recovering the byte
+    // can still start the next character.
     if (c < 0x80 || c > 0xbf)
-        throw runtime_error("invalid UTF8 sequence");
+    {
+        mUtf8Count = 0;
+        error("invalid UTF8 sequence");
+        return utf8Decode(c);
+    }
 
-    utf8Value <<= 6;
-    utf8Value |= c & 0x3f;
-    utf8Count--;
+    mUtf8Value <<= 6;
+    mUtf8Value |= c & 0x3f;
+    mUtf8Count--;
 
-    if (utf8Count == 0)
-        return utf8Value;
+    if (mUtf8Count == 0)
+        return mUtf8Value;
 
     return -1;
 }
@@ -260,6 +504,49 @@ static string utf8Encode(const u32string &input)
     return str;
 }
 
+void PPTokenizer::setRecovery(bool recovery)
+{
+    mRecovery = recovery;
+}
+
+void PPTokenizer::setSkipping(bool skipping)
+{
+    mSkipping = skipping;
+}
+
+// Report malformed input.  Unless recovering or skipping this throws,
+// otherwise the text of the bad token is emitted as an error and the rest
+// of the line is skipped.
+void PPTokenizer::error(const char* message)
+{
+    if (!mRecovery && !mSkipping)
+        throw runtime_error(message);
+
+    // Only the first error on a line is reported.  Whitespace and comments
+    // are not tokens so an error in them has no text.
+    if (mState == COMMENT_ONELINE || mState == COMMENT_MULTILINE ||
+        mState == COMMENT_MULTILINE_2 || mState == WHITESPACE_SEQ ||
+        mState == NEW_LINE)
+    {
+        if (emits(0))
+            output.emit_error("", message);
+    }
+    else if (mState != RECOVER && emits(mForward))
+        output.emit_error(utf8Encode(mCpStream.substr(0, mForward)), message);
+
+    // Anything half translated belongs to the skipped text too
+    mCpStream.erase(0, mForward);
+    mForward = 0;
+    mTransBuffer.clear();
+    mTransForward = 0;
+    mTransState = TRANS_START;
+    mTranslate = true;
+    mRawDelim.clear();
+    mReturnState = 0;
+    mLastToken = RECOVER;
+    mState = RECOVER;
+}
+
 static int ucnDecode(u32string str)
 {
     int out = 0;
@@ -276,12 +563,15 @@ static int ucnDecode(u32string str)
 
 bool PPTokenizer::translate(int c)
 {
-    static unsigned int state = 0, forward = 0;
-    static u32string buffer;
-
-    // Just exit if we reach the end of the file
+    // Flush anything still waiting in the translator and exit if we reach
+    // the end of the file
     if (c == EndOfFile)
     {
+        mCpStream.append(mTransBuffer);
+        mTransBuffer.clear();
+        mTransForward = 0;
+        mTransState = TRANS_START;
+
         mCpStream.push_back(c);
         return true;
     }
@@ -295,39 +585,50 @@ bool PPTokenizer::translate(int c)
     {
         // @todo There is a bug somewhere here that has to do with raw
         // strings.  Remove the next two lines and try 200-trigraphs.t
-        mCpStream.append(buffer);
-        buffer.clear();
+        mCpStream.append(mTransBuffer);
+        mTransBuffer.clear();
+        mCpStream.push_back(c);
+        return true;
+    }
+
+    // Most characters can't start a sequence so skip the buffer for them
+    if (mTransBuffer.empty() && c != '?' && c != '\\')
+    {
         mCpStream.push_back(c);
         return true;
     }
 
-    buffer.push_back(c);
-    while (forward < buffer.length())
+    // Keep going until whatever is left in the buffer is the start of a
+    // sequence that needs more characters
+    size_t length = mCpStream.length();
+
+    mTransBuffer.push_back(c);
+    while (mTransForward < mTransBuffer.length())
     {
-        unsigned int cp = buffer[forward];
+        unsigned int cp = mTransBuffer[mTransForward];
 
-        switch (state)
+        switch (mTransState)
         {
         case TRANS_START:
             // This could be a question mark or a backslash
             if (cp == '?')
             {
-                forward++;
-                state = TRIGRAPH_DECODE;
+                mTransForward++;
+                mTransState = TRIGRAPH_DECODE;
             }
             else if (cp == '\\')
             {
-                forward++;
-                state = UCN_OR_LINE_SPLICE;
+                mTransForward++;
+                mTransState = UCN_OR_LINE_SPLICE;
             }
             else
             {
-                mCpStream.push_back(buffer[0]);
-                buffer.erase(0, 1);
+                mCpStream.push_back(mTransBuffer[0]);
+                mTransBuffer.erase(0, 1);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             break;
@@ -336,18 +637,18 @@ bool PPTokenizer::translate(int c)
             // Check for the second question mark
             if (cp == '?')
             {
-                forward++;
-                state = TRIGRAPH_DECODE_2;
+                mTransForward++;
+                mTransState = TRIGRAPH_DECODE_2;
             }
             else
             {
                 // The first character should be returned
-                mCpStream.push_back(buffer[0]);
-                buffer.erase(0, 1);
+                mCpStream.push_back(mTransBuffer[0]);
+                mTransBuffer.erase(0, 1);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             break;
@@ -357,58 +658,58 @@ bool PPTokenizer::translate(int c)
             switch (cp)
             {
             case '=':
-                buffer.clear();
-                buffer.push_back('#');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('#');
                 break;
             case '/':
-                buffer.clear();
-                buffer.push_back('\\');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('\\');
                 break;
             case '\'':
-                buffer.clear();
-                buffer.push_back('^');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('^');
                 break;
             case '(':
-                buffer.clear();
-                buffer.push_back('[');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('[');
                 break;
             case ')':
-                buffer.clear();
-                buffer.push_back(']');
+                mTransBuffer.clear();
+                mTransBuffer.push_back(']');
                 break;
             case '!':
-                buffer.clear();
-                buffer.push_back('|');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('|');
                 break;
             case '<':
-                buffer.clear();
-                buffer.push_back('{');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('{');
                 break;
             case '>':
-                buffer.clear();
-                buffer.push_back('}');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('}');
                 break;
             case '-':
-                buffer.clear();
-                buffer.push_back('~');
+                mTransBuffer.clear();
+                mTransBuffer.push_back('~');
                 break;
             case '?':
                 // This makes the third question mark.  Return the first and
                 // stay in this state.
-                mCpStream.push_back(buffer[0]);
-                buffer.erase(0, 1);
+                mCpStream.push_back(mTransBuffer[0]);
+                mTransBuffer.erase(0, 1);
 
-                forward = 2;
-                return true;
+                mTransForward = 2;
+                continue;
             default:
                 // This is not a trigraph
-                mCpStream.append(buffer.substr(0, 2));
-                buffer.erase(0, 2);
+                mCpStream.append(mTransBuffer.substr(0, 2));
+                mTransBuffer.erase(0, 2);
             }
 
-            forward = 0;
-            state = TRANS_START;
-            return true;
+            mTransForward = 0;
+            mTransState = TRANS_START;
+            continue;
 
             break;
 
@@ -417,29 +718,29 @@ bool PPTokenizer::translate(int c)
             // a 'u' other wise it could be a line-splice
             if (cp == 'u')
             {
-                forward++;
-                state = UCN_DECODE_16;
+                mTransForward++;
+                mTransState = UCN_DECODE_16;
             }
             else if (cp == 'U')
             {
-                forward++;
-                state = UCN_DECODE_32;
+                mTransForward++;
+                mTransState = UCN_DECODE_32;
             }
             else if (cp == '\n')
             {
-                buffer.erase(0, 2);
+                mTransBuffer.erase(0, 2);
 
-                forward = 0;
-                state = TRANS_START;
+                mTransForward = 0;
+                mTransState = TRANS_START;
             }
             else
             {
-                mCpStream.append(buffer.substr(0, 2));
-                buffer.erase(0, 2);
+                mCpStream.append(mTransBuffer.substr(0, 2));
+                mTransBuffer.erase(0, 2);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             break;
@@ -448,27 +749,27 @@ bool PPTokenizer::translate(int c)
             // For this to be a valid universal-character-name it must be
             // followed by hex digits
             if (IS_HEXDIGIT(cp))
-                forward++;
+                mTransForward++;
             else
             {
                 // Return what we parsed thus far
-                mCpStream.append(buffer.substr(0, forward));
-                buffer.erase(0, forward);
+                mCpStream.append(mTransBuffer.substr(0, mTransForward));
+                mTransBuffer.erase(0, mTransForward);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             // Check if we have a full universal-character-code
-            if (buffer.length() == 6)
+            if (mTransBuffer.length() == 6)
             {
-                mCpStream.push_back(ucnDecode(buffer));
-                buffer.erase(0, 6);
+                mCpStream.push_back(ucnDecode(mTransBuffer));
+                mTransBuffer.erase(0, 6);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             break;
@@ -477,36 +778,368 @@ bool PPTokenizer::translate(int c)
             // For this to be a valid universal-character-name it must be
             // followed by hex digits
             if (IS_HEXDIGIT(cp))
-                forward++;
+                mTransForward++;
             else
             {
                 // Return what we parsed thus far
-                mCpStream.append(buffer.substr(0, forward));
-                buffer.erase(0, forward);
+                mCpStream.append(mTransBuffer.substr(0, mTransForward));
+                mTransBuffer.erase(0, mTransForward);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             // Check if we have a full universal-character-code
-            if (buffer.length() == 10)
+            if (mTransBuffer.length() == 10)
             {
-                mCpStream.push_back(ucnDecode(buffer));
-                buffer.erase(0, 10);
+                mCpStream.push_back(ucnDecode(mTransBuffer));
+                mTransBuffer.erase(0, 10);
 
-                forward = 0;
-                state = TRANS_START;
-                return true;
+                mTransForward = 0;
+                mTransState = TRANS_START;
+                continue;
             }
 
             break;
         }
     }
 
+    return mCpStream.length() != length;
+}
+
+// Return the length of the leading run of data that is plain ASCII, not
+// counting DEL which utf8Decode rejects.  Bytes are checked a word at a time
+// since this runs over entire comment bodies.
+static size_t asciiLength(const char* data, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+
+        memcpy(&word, data + i, sizeof(word));
+        if ((word | (word + 0x0101010101010101ULL)) & 0x8080808080808080ULL)
+            break;
+    }
+
+    while (i < length && (unsigned char)data[i] < 0x7f)
+        i++;
+
+    return i;
+}
+
+size_t PPTokenizer::skipComment(const char* data, size_t length)
+{
+    const char* end = data + length;
+
+    // Only a new-line can end a line comment and only an asterisk can start
+    // the end of a block comment
+    const char* stop = (const char*)memchr(data,
+        mState == COMMENT_MULTILINE ? '*' : '\n', length);
+    if (stop == nullptr)
+        stop = end;
+
+    // A backslash, or the ??/ trigraph for one, may start a line-splice or
+    // a universal-character-name for the terminator, so those still have
+    // to go through the translator
+    const char* escape = (const char*)memchr(data, '\\', stop - data);
+    if (escape != nullptr)
+        stop = escape;
+
+    const char* trigraph = (const char*)memchr(data, '?', stop - data);
+    if (trigraph != nullptr)
+        stop = trigraph;
+
+    // Anything that isn't ASCII still needs to be validated as UTF-8
+    return asciiLength(data, stop - data);
+}
+
+// Classes of bytes used when skipping lines that aren't directives
+enum SkipClass
+{
+    SKIP_TOKEN = 0,     // identifiers, numbers, punctuators, and whitespace
+    SKIP_NEW_LINE,
+    SKIP_SLASH,         // can start a comment
+    SKIP_STOP           // literals, translation, and anything not ASCII
+};
+
+struct SkipClassTable
+{
+    SkipClassTable()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if (c == '"' || c == '\'' || c == '\\' || c == '?' || c >= 0x7f)
+                classes[c] = SKIP_STOP;
+            else
+                classes[c] = SKIP_TOKEN;
+        }
+
+        classes['\n'] = SKIP_NEW_LINE;
+        classes['/'] = SKIP_SLASH;
+    }
+
+    unsigned char classes[256];
+};
+
+static const SkipClassTable SkipClasses;
+
+// Check if the identifier from start to end makes the literal opened by
+// quote a raw string literal
+static bool isRawPrefix(const unsigned char* start, const unsigned char* end,
+    unsigned char quote)
+{
+    size_t length = end - start;
+
+    if (quote != '"' || length == 0 || length > 3 || end[-1] != 'R')
+        return false;
+
+    return length == 1 || (length == 2 &&
+        (start[0] == 'u' || start[0] == 'U' || start[0] == 'L')) ||
+        (length == 3 && start[0] == 'u' && start[1] == '8');
+}
+
+// Return the start of the identifier or pp-number that ends at end, or end
+// if there is none.  Nothing but these characters and signs can be part of
+// one, so there is a token boundary before them and the tokens can be found
+// from there.
+static const unsigned char* runStart(const unsigned char* start,
+    const unsigned char* end)
+{
+    const unsigned char* p = end;
+
+    while (p > start && (IS_DIGIT(p[-1]) || IS_IDNONDIGIT(p[-1]) ||
+            p[-1] == '.' || p[-1] == '+' || p[-1] == '-'))
+        p--;
+
+    const unsigned char* token = end;
+
+    while (p < end)
+    {
+        token = p;
+
+        if (IS_DIGIT(*p) || (*p == '.' && (p + 1 == end || IS_DIGIT(p[1]))))
+        {
+            // Only a pp-number can have a sign after its exponent
+            for (p++; p < end; p++)
+            {
+                if ((*p == 'e' || *p == 'E') && p + 1 < end &&
+                        (p[1] == '+' || p[1] == '-'))
+                    p++;
+                else if (!IS_DIGIT(*p) && !IS_IDNONDIGIT(*p) && *p != '.')
+                    break;
+            }
+        }
+        else if (IS_IDNONDIGIT(*p))
+        {
+            while (p < end && (IS_DIGIT(*p) || IS_IDNONDIGIT(*p)))
+                p++;
+        }
+        else
+            token = ++p;
+    }
+
+    return token;
+}
+
+size_t PPTokenizer::skipLine(const char* data, size_t length)
+{
+    const unsigned char* start = (const unsigned char*)data;
+    const unsigned char* end = start + length;
+    const unsigned char* p = start;
+
+    while (p < end)
+    {
+        if (mLineStart)
+        {
+            // Whitespace before the first token is never emitted
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\v'))
+            {
+                mLastToken = WHITESPACE_SEQ;
+                p++;
+            }
+
+            if (p == end)
+                break;
+
+            if (*p == '\n')
+            {
+                mLastToken = NEW_LINE;
+                p++;
+                continue;
+            }
+
+            // Leave anything that could still start a directive to the
+            // tokenizer
+            if (*p == '#' || *p == '%')
+                break;
+        }
+
+        const unsigned char* line = p;
+
+        while (p < end && SkipClasses.classes[*p] == SKIP_TOKEN)
+            p++;
+
+        if (p > line)
+        {
+            mLineStart = false;
+            mSkipLine = true;
+            mLastToken = PRE_OP_OR_PUNC;
+        }
+
+        // An identifier or number right before the end of the data might
+        // continue so let the tokenizer start over at the beginning of it
+        if (p == end)
+            return runStart(line, p) - start;
+
+        switch (*p)
+        {
+        case '\n':
+            mLastToken = NEW_LINE;
+            mLineStart = true;
+            mSkipLine = false;
+            p++;
+            continue;
+
+        case '/':
+            // Comments are left to the tokenizer, which skips them in bulk
+            if (p + 1 == end || SkipClasses.classes[p[1]] == SKIP_STOP)
+                return p - start;
+            else if (p[1] == '/')
+            {
+                mState = COMMENT_ONELINE;
+                return p + 2 - start;
+            }
+            else if (p[1] == '*')
+            {
+                mState = COMMENT_MULTILINE;
+                return p + 2 - start;
+            }
+
+            break;
+
+        case '?':
+            // Anything but a trigraph is just an operator
+            if (p + 1 == end || p[1] == '?')
+                return runStart(line, p) - start;
+
+            break;
+
+        case '"':
+        case '\'':
+            // A literal might have an encoding prefix.  When skipping only a
+            // raw string's matters since its new-lines don't end the line.
+            if (runStart(line, p) != p &&
+                    (!mSkipping || isRawPrefix(runStart(line, p), p, *p)))
+                return runStart(line, p) - start;
+
+            mState = *p == '"' ? STRING_LITERAL : CHAR_LITERAL;
+            mLineStart = false;
+            mSkipLine = true;
+            return p + 1 - start;
+
+        default:
+            // An identifier or number might continue after a line-splice,
+            // UCN, or UTF-8 character, and each of these is checked by the
+            // tokenizer the same way whether or not the line is skipped
+            return runStart(line, p) - start;
+        }
+
+        mLineStart = false;
+        mSkipLine = true;
+        mLastToken = PRE_OP_OR_PUNC;
+        p++;
+    }
+
+    return p - start;
+}
+
+// Drop a pending token if it can't change how the rest of a skipped line is
+// tokenized and return true if the tokenizer is then between tokens
+bool PPTokenizer::skipPending()
+{
+    if (mState == PTOKEN_START)
+        return mCpStream.empty();
+
+    if (mState == NEW_LINE)
+    {
+        mLineStart = true;
+        mSkipLine = false;
+        RESET_STATE(mForward);
+        return true;
+    }
+
+    // Whitespace is never emitted before the first token of a line, and
+    // what follows an operator doesn't depend on the operator unless it
+    // could still start a directive
+    if (mState == WHITESPACE_SEQ ||
+            (mSkipLine && mState >= PRE_OP_OR_PUNC &&
+                mState <= PRE_OP_OR_PUNC_EQUALS))
+    {
+        RESET_STATE(mForward);
+        return true;
+    }
+
     return false;
 }
 
+size_t PPTokenizer::skipLiteral(const char* data, size_t length)
+{
+    size_t i = 0;
+
+    // Nothing but the closing quote, an escape sequence, or a new-line can
+    // change the state of a literal that won't be emitted
+    while (i < length &&
+            SkipClasses.classes[(unsigned char)data[i]] != SKIP_STOP &&
+            data[i] != '\n')
+        i++;
+
+    return i;
+}
+
+void PPTokenizer::process(const char* data, size_t length)
+{
+    size_t i = 0;
+
+    while (i < length)
+    {
+        size_t skipped = 0;
+
+        // Comment bodies and lines after an error are skipped in bulk as
+        // long as there is nothing pending in the tokenizer or translator
+        // that could depend on them
+        if ((mState == COMMENT_ONELINE || mState == COMMENT_MULTILINE ||
+                    mState == RECOVER) &&
+                mForward == mCpStream.length() && mTranslate &&
+                translatorIdle())
+        {
+            mCpStream.clear();
+            mForward = 0;
+
+            skipped = skipComment(data + i, length - i);
+        }
+        // Lines that aren't directives are skipped in bulk between tokens
+        else if (filters() && (mLineStart || mSkipLine) &&
+                mForward == mCpStream.length() && mTranslate &&
+                translatorIdle() && skipPending())
+            skipped = skipLine(data + i, length - i);
+        // The same goes for the contents of their literals
+        else if (filters() && mSkipLine &&
+                (mState == STRING_LITERAL || mState == CHAR_LITERAL) &&
+                mForward == mCpStream.length() && mTranslate &&
+                translatorIdle())
+            skipped = skipLiteral(data + i, length - i);
+
+        // Anything that couldn't be skipped goes through the tokenizer
+        if (skipped > 0)
+            i += skipped;
+        else
+            process((unsigned char)data[i++]);
+    }
+}
+
 void PPTokenizer::process(int c)
 {
     // Translate the read character.  When translate returns true we can
@@ -540,8 +1173,8 @@ void PPTokenizer::process(int c)
             else if (cp == '/')
                 NEXT_STATE(COMMENT);
             // Check for an include header
-            else if ((mLastToken == 0 || mLastToken == NEW_LINE) && \
-                    cp == '#')
+            else if ((mLastToken == 0 || mLastToken == NEW_LINE || \
+                    (filters() && mLineStart)) && cp == '#')
                 NEXT_STATE(INCLUDE_HASH);
             // Check for a single preprocessing_op_or_punc character
             else if (cp == '{' || cp == '}' || cp == '[' || cp == ']' ||
@@ -575,7 +1208,8 @@ void PPTokenizer::process(int c)
             {
                 // A new-line should be emitted at the end of a file unless
                 // the file is empty
-                if (mLastToken != 0 && mLastToken != NEW_LINE)
+                if (mLastToken != 0 && mLastToken != NEW_LINE &&
+                        emitsLayout())
                     output.emit_new_line();
 
                 output.emit_eof();
@@ -640,12 +1274,13 @@ void PPTokenizer::process(int c)
             {
                 EMIT_TOKEN(preprocessing_op_or_punc, 1);
                 EMIT_TOKEN(identifier, 7);
-                output.emit_whitespace_sequence();
+                if (emitsLayout())
+                    output.emit_whitespace_sequence();
                 RESET_STATE(1);
                 EMIT_TOKEN(header_name, mCpStream.length());
             }
             else if (cp == '\n')
-                throw runtime_error("unterminated header name");
+                error("unterminated header name");
             else
                 mForward++;
 
@@ -658,12 +1293,13 @@ void PPTokenizer::process(int c)
             {
                 EMIT_TOKEN(preprocessing_op_or_punc, 1);
                 EMIT_TOKEN(identifier, 7);
-                output.emit_whitespace_sequence();
+                if (emitsLayout())
+                    output.emit_whitespace_sequence();
                 RESET_STATE(1);
                 EMIT_TOKEN(header_name, mCpStream.length());
             }
             else if (cp == '\n')
-                throw runtime_error("unterminated header name");
+                error("unterminated header name");
             else
                 mForward++;
 
@@ -725,7 +1361,7 @@ void PPTokenizer::process(int c)
         case CHAR_LITERAL:
             // Continues reading until a quote, backslash, or new-line
             if (cp == '\n')
-                throw runtime_error("unterminated character literal");
+                error("unterminated character literal");
             else if (cp == '\\')
                 CALL_STATE(ESC_SEQUENCE);
             else if (cp == '\'')
@@ -756,7 +1392,7 @@ void PPTokenizer::process(int c)
         case STRING_LITERAL:
             // Continues reading until a quote, backslash, or new-line
             if (cp == '\n')
-                throw runtime_error("unterminated string literal");
+                error("unterminated string literal");
             else if (cp == '\\')
                 CALL_STATE(ESC_SEQUENCE);
             else if (cp == '"')
@@ -830,14 +1466,16 @@ void PPTokenizer::process(int c)
                 NEXT_STATE(RAW_STRING_LITERAL);
             else if (cp == ' ' || cp == ')' || cp == '\\' || cp == '\t' || \
                     cp == '\v' || cp == '\f' || cp == '\n')
-                throw runtime_error("invalid characters in raw string delimeter");
+                error("invalid characters in raw string delimeter");
             else
             {
                 if (mRawDelim.length() >= 16)
-                    throw runtime_error("raw string delimeter too long");
-
-                mRawDelim.push_back(cp);
-                mForward++;
+                    error("raw string delimeter too long");
+                else
+                {
+                    mRawDelim.push_back(cp);
+                    mForward++;
+                }
             }
 
             break;
@@ -1108,13 +1746,14 @@ void PPTokenizer::process(int c)
             break;
 
         case COMMENT_ONELINE:
-            // Consume all characters until a new-line
+            // Consume all characters until a new-line.  The comment is never
+            // emitted so there is no reason to keep it in the stream.
             if ((int)cp == EndOfFile)
                 SET_STATE(WHITESPACE_SEQ);
             else if (cp == '\n')
                 SET_STATE(WHITESPACE_SEQ);
             else
-                mForward++;
+                DISCARD_STATE();
 
             break;
 
@@ -1123,9 +1762,9 @@ void PPTokenizer::process(int c)
             if (cp == '*')
                 NEXT_STATE(COMMENT_MULTILINE_2);
             else if ((int)cp == EndOfFile)
-                throw runtime_error("partial comment");
+                error("partial comment");
             else
-                mForward++;
+                DISCARD_STATE();
 
             break;
 
@@ -1133,10 +1772,10 @@ void PPTokenizer::process(int c)
             // Check if this terminates the comment
             if (cp == '/')
                 NEXT_STATE(WHITESPACE_SEQ);
+            else if ((int)cp == EndOfFile)
+                error("partial comment");
             else if (cp != '*')
                 NEXT_STATE(COMMENT_MULTILINE);
-            else if ((int)cp == EndOfFile)
-                throw runtime_error("partial comment");
             else
                 mForward++;
 
@@ -1148,7 +1787,7 @@ void PPTokenizer::process(int c)
                 mForward++;
             else
             {
-                if (mLastToken != WHITESPACE_SEQ)
+                if (mLastToken != WHITESPACE_SEQ && emitsLayout())
                     output.emit_whitespace_sequence();
 
                 RESET_STATE(mForward);
@@ -1158,7 +1797,11 @@ void PPTokenizer::process(int c)
 
         case NEW_LINE:
             // No further states
-            output.emit_new_line();
+            if (emitsLayout())
+                output.emit_new_line();
+
+            mLineStart = true;
+            mSkipLine = false;
             RESET_STATE(1);
 
             break;
@@ -1183,14 +1826,17 @@ void PPTokenizer::process(int c)
                 NEXT_STATE(ESC_SEQUENCE_UCN_4);
             else
                 // This is an invalid escape sequence
-                throw runtime_error("invalid escape sequence");
+                error("invalid escape sequence");
 
             break;
 
         case ESC_SEQUENCE_HEX:
             // This must be a hexadecimal character
             if (!IS_HEXDIGIT(cp))
-                throw runtime_error("invalid hex escape sequence");
+            {
+                error("invalid hex escape sequence");
+                break;
+            }
 
             // There is no maximum number of hex characters that can follow
             // so after we match one we will just return
@@ -1205,7 +1851,10 @@ void PPTokenizer::process(int c)
         case ESC_SEQUENCE_UCN_1:
             // This must be a hexadecimal character
             if (!IS_HEXDIGIT(cp))
-                throw runtime_error("invalid escape sequence");
+            {
+                error("invalid escape sequence");
+                break;
+            }
 
             mForward++;
 
@@ -1217,6 +1866,15 @@ void PPTokenizer::process(int c)
 
             break;
 
+        case RECOVER:
+            // Drop everything up to the next new-line after an error
+            if (cp == '\n' || (int)cp == EndOfFile)
+                SET_STATE(PTOKEN_START);
+            else
+                DISCARD_STATE();
+
+            break;
+
         default:
             // We should never get here!
             throw runtime_error("Bad tokenization state");
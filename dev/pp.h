@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 using namespace std;
@@ -30,6 +31,7 @@ public:
     virtual void emit_user_defined_string_literal(const string& data) = 0;
     virtual void emit_preprocessing_op_or_punc(const string& data) = 0;
     virtual void emit_non_whitespace_char(const string& data) = 0;
+    virtual void emit_error(const string& data, const string& message) = 0;
     virtual void emit_eof() = 0;
 };
 
@@ -37,9 +39,57 @@ public:
 class PPTokenizer
 {
 public:
+    // Checkpoint: tokenizer state between two input bytes which can be used
+    // to resume tokenizing from that point in the input
+    struct Checkpoint
+    {
+        int state;
+        int returnState;
+        int lastToken;
+        unsigned int forward;
+        bool translate;
+        bool lineStart;
+        bool skipLine;
+        u32string cpStream;
+        u32string rawDelim;
+
+        bool operator==(const Checkpoint& other) const;
+        bool operator!=(const Checkpoint& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
     PPTokenizer(IPPTokenStream& output);
 
     void process(int c);
+    void process(const char* data, size_t length);
+
+    bool checkpoint(Checkpoint& cp) const;
+    void resume(const Checkpoint& cp);
+
+    string snapshot() const;
+    void restore(const string& snapshot);
+
+    // In directives-only mode every line is still tokenized but only the
+    // tokens of lines starting with a # (or %:) are emitted along with their
+    // new-line.  Other lines are skipped in bulk where possible.
+    void setDirectivesOnly(bool directivesOnly);
+    bool directivesOnly() const { return mDirectivesOnly; }
+
+    // In recovery mode malformed input is emitted as an error token instead
+    // of throwing and tokenizing continues on the next line
+    void setRecovery(bool recovery);
+    bool recovery() const { return mRecovery; }
+
+    // Skip mode is for conditional groups that are skipped.  Lines are
+    // filtered like in directives-only mode but the other lines are only
+    // scanned for what can end them: comments, literals, raw strings and
+    // line-splices.  Nothing in a skipped group is diagnosed but malformed
+    // input still ends its line as in recovery mode, however the input is
+    // split up.  The mode can be changed at any new-line.
+    void setSkipping(bool skipping);
+    bool skipping() const { return mSkipping; }
 
 protected:
     enum TransState {
@@ -108,9 +158,20 @@ protected:
         COMMENT_MULTILINE_2,
         WHITESPACE_SEQ,
         NEW_LINE,
+        RECOVER,
     };
 
     bool translate(int c);
+    int utf8Decode(int c);
+    size_t skipComment(const char* data, size_t length);
+    size_t skipLine(const char* data, size_t length);
+    size_t skipLiteral(const char* data, size_t length);
+    bool skipPending();
+    bool translatorIdle() const;
+    bool emits(unsigned int length);
+    bool emitsLayout() const;
+    bool filters() const { return mDirectivesOnly || mSkipping; }
+    void error(const char* message);
 
     IPPTokenStream& output;
     u32string mCpStream;
@@ -121,4 +182,13 @@ protected:
     int mLastToken;
     int mReturnState;
     u32string mRawDelim;
+    u32string mTransBuffer;
+    unsigned int mTransForward;
+    int mUtf8Count;
+    int mUtf8Value;
+    bool mDirectivesOnly;
+    bool mLineStart;
+    bool mSkipLine;
+    bool mRecovery;
+    bool mSkipping;
 };
@@ -0,0 +1,243 @@
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "pp.h"
+#include "ppbuffer.h"
+
+using namespace std;
+
+void PPTokenBuffer::emit_whitespace_sequence()
+{
+    mTokens.push_back(PPTokenRecord(PPT_WHITESPACE_SEQUENCE, ""));
+}
+
+void PPTokenBuffer::emit_new_line()
+{
+    mTokens.push_back(PPTokenRecord(PPT_NEW_LINE, ""));
+}
+
+void PPTokenBuffer::emit_header_name(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_HEADER_NAME, data));
+}
+
+void PPTokenBuffer::emit_identifier(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_IDENTIFIER, data));
+}
+
+void PPTokenBuffer::emit_pp_number(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_PP_NUMBER, data));
+}
+
+void PPTokenBuffer::emit_character_literal(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_CHARACTER_LITERAL, data));
+}
+
+void PPTokenBuffer::emit_user_defined_character_literal(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_USER_DEFINED_CHARACTER_LITERAL,
+        data));
+}
+
+void PPTokenBuffer::emit_string_literal(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_STRING_LITERAL, data));
+}
+
+void PPTokenBuffer::emit_user_defined_string_literal(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_USER_DEFINED_STRING_LITERAL, data));
+}
+
+void PPTokenBuffer::emit_preprocessing_op_or_punc(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_PREPROCESSING_OP_OR_PUNC, data));
+}
+
+void PPTokenBuffer::emit_non_whitespace_char(const string& data)
+{
+    mTokens.push_back(PPTokenRecord(PPT_NON_WHITESPACE_CHAR, data));
+}
+
+void PPTokenBuffer::emit_error(const string& data, const string& message)
+{
+    mTokens.push_back(PPTokenRecord(PPT_ERROR, data, message));
+}
+
+void PPTokenBuffer::emit_eof()
+{
+    mTokens.push_back(PPTokenRecord(PPT_EOF, ""));
+}
+
+void PPTokenBuffer::replay(IPPTokenStream& output) const
+{
+    for (const PPTokenRecord& token : mTokens)
+        replay(token, output);
+}
+
+void PPTokenBuffer::replay(const PPTokenRecord& token, IPPTokenStream& output)
+{
+    switch (token.kind)
+    {
+    case PPT_WHITESPACE_SEQUENCE:
+        output.emit_whitespace_sequence();
+        break;
+    case PPT_NEW_LINE:
+        output.emit_new_line();
+        break;
+    case PPT_HEADER_NAME:
+        output.emit_header_name(token.data);
+        break;
+    case PPT_IDENTIFIER:
+        output.emit_identifier(token.data);
+        break;
+    case PPT_PP_NUMBER:
+        output.emit_pp_number(token.data);
+        break;
+    case PPT_CHARACTER_LITERAL:
+        output.emit_character_literal(token.data);
+        break;
+    case PPT_USER_DEFINED_CHARACTER_LITERAL:
+        output.emit_user_defined_character_literal(token.data);
+        break;
+    case PPT_STRING_LITERAL:
+        output.emit_string_literal(token.data);
+        break;
+    case PPT_USER_DEFINED_STRING_LITERAL:
+        output.emit_user_defined_string_literal(token.data);
+        break;
+    case PPT_PREPROCESSING_OP_OR_PUNC:
+        output.emit_preprocessing_op_or_punc(token.data);
+        break;
+    case PPT_NON_WHITESPACE_CHAR:
+        output.emit_non_whitespace_char(token.data);
+        break;
+    case PPT_ERROR:
+        output.emit_error(token.data, token.message);
+        break;
+    case PPT_EOF:
+        output.emit_eof();
+        break;
+    }
+}
+
+void PackedPPTokenBuffer::push(EPPTokenKind kind, const string& data)
+{
+    PackedPPToken token;
+
+    if (mArena.length() + data.length() > UINT32_MAX)
+        throw length_error("pp-token arena is full");
+
+    token.kind = kind;
+    token.offset = mArena.length();
+    token.length = data.length();
+    token.messageLength = 0;
+
+    mArena += data;
+    mTokens.push_back(token);
+}
+
+void PackedPPTokenBuffer::emit_whitespace_sequence()
+{
+    push(PPT_WHITESPACE_SEQUENCE, "");
+}
+
+void PackedPPTokenBuffer::emit_new_line()
+{
+    push(PPT_NEW_LINE, "");
+}
+
+void PackedPPTokenBuffer::emit_header_name(const string& data)
+{
+    push(PPT_HEADER_NAME, data);
+}
+
+void PackedPPTokenBuffer::emit_identifier(const string& data)
+{
+    push(PPT_IDENTIFIER, data);
+}
+
+void PackedPPTokenBuffer::emit_pp_number(const string& data)
+{
+    push(PPT_PP_NUMBER, data);
+}
+
+void PackedPPTokenBuffer::emit_character_literal(const string& data)
+{
+    push(PPT_CHARACTER_LITERAL, data);
+}
+
+void PackedPPTokenBuffer::emit_user_defined_character_literal(const string& data)
+{
+    push(PPT_USER_DEFINED_CHARACTER_LITERAL, data);
+}
+
+void PackedPPTokenBuffer::emit_string_literal(const string& data)
+{
+    push(PPT_STRING_LITERAL, data);
+}
+
+void PackedPPTokenBuffer::emit_user_defined_string_literal(const string& data)
+{
+    push(PPT_USER_DEFINED_STRING_LITERAL, data);
+}
+
+void PackedPPTokenBuffer::emit_preprocessing_op_or_punc(const string& data)
+{
+    push(PPT_PREPROCESSING_OP_OR_PUNC, data);
+}
+
+void PackedPPTokenBuffer::emit_non_whitespace_char(const string& data)
+{
+    push(PPT_NON_WHITESPACE_CHAR, data);
+}
+
+void PackedPPTokenBuffer::emit_error(const string& data, const string& message)
+{
+    if (mArena.length() + data.length() + message.length() > UINT32_MAX)
+        throw length_error("pp-token arena is full");
+
+    push(PPT_ERROR, data);
+
+    mTokens.back().messageLength = message.length();
+    mArena += message;
+}
+
+void PackedPPTokenBuffer::emit_eof()
+{
+    push(PPT_EOF, "");
+}
+
+void PackedPPTokenBuffer::replay(IPPTokenStream& output) const
+{
+    // One record is filled in for every token so its strings keep their
+    // storage
+    PPTokenRecord record(PPT_EOF, "");
+
+    for (const PackedPPToken& token : mTokens)
+    {
+        const char* data = mArena.data() + token.offset;
+
+        record.kind = token.kind;
+        record.data.assign(data, token.length);
+        record.message.assign(data + token.length, token.messageLength);
+
+        PPTokenBuffer::replay(record, output);
+    }
+}
+
+size_t PackedPPTokenBuffer::footprint() const
+{
+    return sizeof(*this) + mTokens.capacity() * sizeof(PackedPPToken) +
+        mArena.capacity();
+}
+
+void PackedPPTokenBuffer::shrink()
+{
+    mTokens.shrink_to_fit();
+    mArena.shrink_to_fit();
+}
@@ -0,0 +1,126 @@
+/// Recorded stream of preprocessing tokens
+///
+/// @file ppbuffer.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pp.h"
+
+using namespace std;
+
+// Kinds of tokens emitted through IPPTokenStream
+enum EPPTokenKind
+{
+    PPT_WHITESPACE_SEQUENCE,
+    PPT_NEW_LINE,
+    PPT_HEADER_NAME,
+    PPT_IDENTIFIER,
+    PPT_PP_NUMBER,
+    PPT_CHARACTER_LITERAL,
+    PPT_USER_DEFINED_CHARACTER_LITERAL,
+    PPT_STRING_LITERAL,
+    PPT_USER_DEFINED_STRING_LITERAL,
+    PPT_PREPROCESSING_OP_OR_PUNC,
+    PPT_NON_WHITESPACE_CHAR,
+    PPT_ERROR,
+    PPT_EOF
+};
+
+struct PPTokenRecord
+{
+    PPTokenRecord(EPPTokenKind kind, const string& data,
+            const string& message = "")
+        : kind(kind), data(data), message(message) {}
+
+    bool operator==(const PPTokenRecord& other) const
+    {
+        return kind == other.kind && data == other.data &&
+            message == other.message;
+    }
+
+    EPPTokenKind kind;
+    string data;
+    string message; // diagnostic of a PPT_ERROR token
+};
+
+// PPTokenBuffer: records every emitted token so it can be replayed later
+class PPTokenBuffer : public IPPTokenStream
+{
+public:
+    typedef vector<PPTokenRecord> TokenList;
+
+    void emit_whitespace_sequence();
+    void emit_new_line();
+    void emit_header_name(const string& data);
+    void emit_identifier(const string& data);
+    void emit_pp_number(const string& data);
+    void emit_character_literal(const string& data);
+    void emit_user_defined_character_literal(const string& data);
+    void emit_string_literal(const string& data);
+    void emit_user_defined_string_literal(const string& data);
+    void emit_preprocessing_op_or_punc(const string& data);
+    void emit_non_whitespace_char(const string& data);
+    void emit_error(const string& data, const string& message);
+    void emit_eof();
+
+    void replay(IPPTokenStream& output) const;
+    static void replay(const PPTokenRecord& token, IPPTokenStream& output);
+
+    TokenList& tokens() { return mTokens; }
+    const TokenList& tokens() const { return mTokens; }
+
+protected:
+    TokenList mTokens;
+};
+
+// PackedPPToken: a token of a PackedPPTokenBuffer.  The diagnostic of a
+// PPT_ERROR token follows its data in the arena.
+struct PackedPPToken
+{
+    EPPTokenKind kind;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t messageLength;
+};
+
+// PackedPPTokenBuffer: records tokens like PPTokenBuffer, but with their
+// text in one arena instead of a string each, so it takes a fraction of the
+// memory and replays without allocating
+class PackedPPTokenBuffer : public IPPTokenStream
+{
+public:
+    void emit_whitespace_sequence();
+    void emit_new_line();
+    void emit_header_name(const string& data);
+    void emit_identifier(const string& data);
+    void emit_pp_number(const string& data);
+    void emit_character_literal(const string& data);
+    void emit_user_defined_character_literal(const string& data);
+    void emit_string_literal(const string& data);
+    void emit_user_defined_string_literal(const string& data);
+    void emit_preprocessing_op_or_punc(const string& data);
+    void emit_non_whitespace_char(const string& data);
+    void emit_error(const string& data, const string& message);
+    void emit_eof();
+
+    void replay(IPPTokenStream& output) const;
+
+    const vector<PackedPPToken>& tokens() const { return mTokens; }
+    const string& arena() const { return mArena; }
+
+    // Memory taken by the tokens and their text
+    size_t footprint() const;
+
+    // Give back the memory reserved for tokens still to come
+    void shrink();
+
+protected:
+    void push(EPPTokenKind kind, const string& data);
+
+    vector<PackedPPToken> mTokens;
+    string mArena;
+};
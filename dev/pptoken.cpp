@@ -61,11 +61,20 @@ struct DebugPPTokenStream : IPPTokenStream
 		write_token("non-whitespace-character", data);
 	}
 
+	void emit_error(const string& data, const string& message)
+	{
+		write_token("error", data);
+		cerr << "ERROR: " << message << endl;
+		errors++;
+	}
+
 	void emit_eof()
 	{
 		cout << "eof" << endl;
 	}
 
+	size_t errors = 0;
+
 private:
 
 	void write_token(const string& type, const string& data)
@@ -76,8 +85,18 @@ private:
 	}
 };
 
-int main()
+int main(int argc, char** argv)
 {
+    // pptoken --recover emits malformed input as an error token and goes on
+    // with the next line, still failing at the end
+    bool recovery = argc == 2 && string(argv[1]) == "--recover";
+
+    if (argc != 1 && !recovery)
+    {
+        cerr << "usage: pptoken [--recover] < input" << endl;
+        return EXIT_FAILURE;
+    }
+
     try
     {
         ostringstream oss;
@@ -89,13 +108,14 @@ int main()
 
         PPTokenizer tokenizer(output);
 
-        for (char c : input)
-        {
-            unsigned char code_unit = c;
-            tokenizer.process(code_unit);
-        }
+        tokenizer.setRecovery(recovery);
+
+        tokenizer.process(input.data(), input.size());
 
         tokenizer.process(EndOfFile);
+
+        if (output.errors != 0)
+            return EXIT_FAILURE;
     }
     catch (exception& e)
     {
@@ -0,0 +1,128 @@
+// Count the allocations of CtrlExpr evaluating lines it has seen before,
+// which must be none once every program is compiled
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "exparse.h"
+
+using namespace std;
+
+static size_t Allocations = 0;
+
+void* operator new(size_t size)
+{
+    Allocations++;
+
+    void* p = malloc(size ? size : 1);
+
+    if (!p)
+        throw bad_alloc();
+
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// Lines of every kind CtrlExpr handles, including each kind of error
+static const char* const Lines[] = {
+    "defined(HAVE_CONFIG_H) && !defined __cplusplus",
+    "__GNUC__ >= 4 && (__GNUC_MINOR__ > 2 || __clang__)",
+    "X86_64 || (ARM && !THUMB) ? 1 : 0",
+    "0x7fffffffffffffff + 1",
+    "18446744073709551615u * 2 >> 3",
+    "'a' + u'x' - L'\\n' + U'\\U0001F600'",
+    "017 | 0b1 ^ 1ull << 40",
+    "true ? -1 : 2u",
+    "1 / 0",
+    "1 << 64 ? 1 : 2",
+    "(1 + 2",
+    "1.5 == 1",
+    "08 + 1",
+    "'abc' + 1",
+    "u'\\x1D11E'",
+    "\"string\" + 1",
+};
+
+class NullPPTokenStream : public IPPTokenStream
+{
+public:
+    void emit_whitespace_sequence() {}
+    void emit_new_line() {}
+    void emit_header_name(const string&) {}
+    void emit_identifier(const string&) {}
+    void emit_pp_number(const string&) {}
+    void emit_character_literal(const string&) {}
+    void emit_user_defined_character_literal(const string&) {}
+    void emit_string_literal(const string&) {}
+    void emit_user_defined_string_literal(const string&) {}
+    void emit_preprocessing_op_or_punc(const string&) {}
+    void emit_non_whitespace_char(const string&) {}
+    void emit_error(const string&, const string&) {}
+    void emit_eof() {}
+};
+
+int main()
+{
+    // Each line a few hundred times, numbered so there are many programs
+    string source;
+
+    for (int i = 0; i < 400; i++)
+        for (const char* line : Lines)
+            source += string(line) + " + " + to_string(i % 50) + "\n";
+
+    PPTokenBuffer tokens;
+    PPTokenizer tokenizer(tokens);
+
+    tokenizer.process(source.data(), source.size());
+    tokenizer.process(EndOfFile);
+
+    NullPPTokenStream output;
+    PA3MockMacroTable macros;
+    CtrlExpr expr(output, macros);
+    string results, errors;
+
+    expr.setOutput(&results, &errors);
+
+    // The first pass compiles every program and grows the buffers
+    tokens.replay(expr);
+
+    string expected = results;
+    size_t before = Allocations;
+
+    results.clear();
+    errors.clear();
+    tokens.replay(expr);
+
+    size_t steady = Allocations - before;
+
+    if (results != expected)
+    {
+        cerr << "ERROR: the second pass gave different results" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (steady != 0)
+    {
+        cerr << "ERROR: " << steady << " allocations evaluating "
+            << expr.stats().expressions / 2 << " lines again" << endl;
+        return EXIT_FAILURE;
+    }
+
+    cout << "alloc: " << expr.stats().expressions / 2
+        << " lines evaluated again without allocating" << endl;
+
+    return EXIT_SUCCESS;
+}
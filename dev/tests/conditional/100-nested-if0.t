@@ -0,0 +1,33 @@
+#if 0
+int a;
+#if 1
+int b;
+#else
+int c;
+#endif
+#ifdef ON
+int d;
+#elif 1
+int e;
+#endif
+# if 0
+#  if 0
+int f;
+#  endif
+# endif
+#else
+int g;
+#if 0
+#if 0
+#else
+int h;
+#endif
+#elif defined(ON)
+int i;
+#endif
+#endif
+%:if 0
+%:  else
+int j;
+%:endif
+int k;
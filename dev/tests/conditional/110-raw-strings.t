@@ -0,0 +1,24 @@
+#if 0
+const char* a = R"(
+#endif
+int not_active;
+)";
+const char* b = R"x(")
+#else
+)x";
+#endif
+const char* c = R"(
+#if 1
+)";
+#ifdef ON
+const char* d = R"(
+#endif
+)";
+#endif
+#ifndef ON
+const char* e = u8R"delim(
+#else
+)" )delim";
+#else
+int f;
+#endif
@@ -0,0 +1,17 @@
+#if 0
+don't do "this
+it's a 'quote
+bad '\q' "\q" "abc
+#error it's
+  #ifdef X
+'
+  #endif
+#else
+int ok = '\n';
+#endif
+int after;
+#if 0
+"no end
+#elif 1
+int taken;
+#endif
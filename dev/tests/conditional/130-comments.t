@@ -0,0 +1,34 @@
+#if 0
+/* a comment
+#else
+#endif
+*/
+int skipped1;
+// #else
+// line comment \
+#endif
+int skipped2;
+#else /* comment
+#endif
+*/
+int active1;
+#endif
+#if 0 // comment \
+#else
+int skipped3;
+#endif
+#if 0
+/* a comment is whitespace */ #else
+int active4;
+#endif
+#if 0 /*
+*/
+#else
+int active2;
+#endif
+#if 0
+??/
+#else
+int active5;
+#endif
+int after;
@@ -0,0 +1,31 @@
+#if 0
+"a\q" /* a bad escape ends the line
+#else
+int escape;
+#endif
+#if 0
+a  /* so does a byte that isn't UTF-8
+#else
+int utf8;
+#endif
+#if 0
+bad "\x" '\u12' /* and bad hex digits
+#else
+int hex;
+#endif
+#if 0
+uéR"( is an identifier before a plain string
+#else
+int prefix;
+#endif
+#if 0
+"x"R"( is a string with a suffix before a plain string
+#else
+int suffix;
+#endif
+#if 0
+e+R"( is a raw string after a sign
+#else
+)"
+#endif
+int sign;
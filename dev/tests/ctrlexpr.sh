@@ -0,0 +1,45 @@
+#!/bin/sh
+# ctrlexpr.sh: run the pa3 tests through ctrlexpr and compare its output with
+# their .ref files, then run the tests/ctrlexpr cases, which the reference
+# ctrlexpr can't produce, and compare what it prints, diagnostics included,
+# and its exit status with the .ref files
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+status=0
+
+for t in ../pa3/tests/*.t
+do
+    if ! ./ctrlexpr < "$t" 2> /dev/null | cmp -s - "${t%.t}.ref"
+    then
+        echo "ERROR: $t: ctrlexpr output differs from the reference"
+        status=1
+    fi
+done
+
+for t in tests/ctrlexpr/*.t
+do
+    ref=${t%.t}.ref
+
+    if ./ctrlexpr < "$t" > "$work/out" 2> "$work/stderr"
+    then
+        echo EXIT_SUCCESS
+    else
+        echo EXIT_FAILURE
+    fi >> "$work/out"
+
+    cat "$work/stderr" >> "$work/out"
+
+    if ! cmp -s "$work/out" "$ref"
+    then
+        echo "ERROR: $t: ctrlexpr output differs from $ref"
+        status=1
+    fi
+done
+
+[ $status -eq 0 ] && echo "ctrlexpr: all cases pass"
+
+exit $status
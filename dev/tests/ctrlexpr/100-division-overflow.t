@@ -0,0 +1,13 @@
+(-9223372036854775807 - 1) / -1
+(-9223372036854775807 - 1) % -1
+-9223372036854775807 / -1
+-9223372036854775807 % -1
+(-9223372036854775807 - 1) / -1 ? 1 : 2
+1 || (-9223372036854775807 - 1) / -1
+0 && (-9223372036854775807 - 1) % -1
+1 ? 2 : (-9223372036854775807 - 1) / -1
+(-9223372036854775807 - 1) / -1u
+(-9223372036854775807 - 1) / 1
+(-9223372036854775807 - 1) % 2
+-7 / -1
+-7 % -1
@@ -0,0 +1,118 @@
+#!/bin/sh
+# depscan.sh: run the tests/depscan cases through depscan and compare with
+# the .ref files, and with the #includes found in the full pptoken output
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Print the #includes of a pptoken run in the depscan format
+includes()
+{
+    awk '
+    BEGIN { printf "-:"; state = 0 }
+    {
+        kind = $1
+        data = $0
+        sub(/^[^ ]* [^ ]* /, "", data)
+    }
+    kind == "new-line" || kind == "eof" { state = 0; next }
+    kind == "whitespace-sequence" { if (state == 3) header = header " "; next }
+    state == 0 { state = (data == "#" || data == "%:") ? 1 : 9; next }
+    state == 1 { state = (kind == "identifier" && data == "include") ? 2 : 9; next }
+    state == 2 {
+        if (kind == "header-name" || kind == "string-literal")
+            printf " %s", data
+        else if (data == "<")
+        {
+            header = data
+            state = 3
+            next
+        }
+        state = 9
+        next
+    }
+    state == 3 {
+        header = header data
+        if (data == ">")
+        {
+            printf " %s", header
+            state = 9
+        }
+    }
+    END { printf "\n" }'
+}
+
+status=0
+
+for t in tests/depscan/*.t
+do
+    ref=${t%.t}.ref
+
+    if ./depscan < "$t" > "$work/out" 2> /dev/null
+    then
+        echo EXIT_SUCCESS
+    else
+        echo EXIT_FAILURE
+    fi > "$work/exit_status"
+
+    if ! cmp -s "$work/out" "$ref" ||
+            ! cmp -s "$work/exit_status" "$ref.exit_status"
+    then
+        echo "ERROR: $t: depscan output differs from $ref"
+        status=1
+    fi
+
+    if ! ./pptoken < "$t" | includes | cmp -s - "$ref"
+    then
+        echo "ERROR: $t: $ref differs from the #includes pptoken finds"
+        status=1
+    fi
+done
+
+# --follow reads standard input too when no files are given, and none of
+# the includes of this case can be found
+if ! ./depscan --follow < tests/depscan/100-simple.t 2> /dev/null |
+        cmp -s - tests/depscan/100-simple.ref
+then
+    echo "ERROR: depscan --follow differs on standard input"
+    status=1
+fi
+
+# A guard macro defined in a group that can't be evaluated may not be
+# defined, so neither the guarded group nor a later #include of the header
+# may be skipped, whether or not another unit included it first
+printf '#if LEVEL > 3\n#define FOO_H\n#endif\n#include "foo.h"\n' \
+    > "$work/main.c"
+printf '#ifndef FOO_H\n#define FOO_H\n#include "bar.h"\n#endif\n' \
+    > "$work/foo.h"
+printf 'int bar;\n' > "$work/bar.h"
+printf '#include "foo.h"\n' > "$work/first.c"
+
+for units in main.c "first.c main.c"
+do
+    if ! (cd "$work" && "$OLDPWD/depscan" --follow -DLEVEL=1 $units) |
+            tail -n 1 | grep -qx 'main.c: foo.h bar.h'
+    then
+        echo "ERROR: depscan --follow $units skips a maybe defined guard"
+        status=1
+    fi
+done
+
+# Headers that include each other stop at their #pragma once, before
+# either has been read in full
+printf '#pragma once\n#include "b.h"\n' > "$work/a.h"
+printf '#pragma once\n#include "a.h"\n' > "$work/b.h"
+printf '#include "a.h"\n' > "$work/m.cpp"
+
+if ! (cd "$work" && "$OLDPWD/depscan" --follow m.cpp 2> /dev/null) |
+        grep -qx 'm.cpp: a.h b.h'
+then
+    echo "ERROR: depscan --follow doesn't stop at #pragma once in a cycle"
+    status=1
+fi
+
+[ $status -eq 0 ] && echo "depscan: all cases pass"
+
+exit $status
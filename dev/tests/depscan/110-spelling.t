@@ -0,0 +1,5 @@
+  #  include <spaced.h>
+%:include "digraph.h"
+??=include <trigraph.h>
+#include <with space.h>
+#	include	"tab.h"
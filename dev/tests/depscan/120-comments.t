@@ -0,0 +1,7 @@
+/* #include <in_block.h>
+#include <still_in_block.h> */
+// #include <in_line.h>
+// splice \
+#include <spliced_comment.h>
+/* c */ #include <after_comment.h>
+#include <trailing.h> // x
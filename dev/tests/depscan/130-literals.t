@@ -0,0 +1,6 @@
+const char* s = "#include <in_string.h>";
+auto r = R"x(
+#include <in_raw.h>
+)x";
+char c = '#';
+#include <after_literals.h>
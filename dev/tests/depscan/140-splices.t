@@ -0,0 +1,6 @@
+#inc\
+lude <spliced_name.h>
+\
+#include <spliced_line.h>
+#include \
+<spliced_header.h>
@@ -0,0 +1,7 @@
+x #include <not_first.h>
+#define INC <macro.h>
+#include INC
+#  if 0
+#include <in_if0.h>
+#endif
+#include < angled . h >
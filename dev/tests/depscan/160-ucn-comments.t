@@ -0,0 +1,8 @@
+x /* \u002A/ #include "f.h" */
+/* \u002A/ #include "a.h" */
+// \u000a#include "b.h"
+/* ??/u002A/
+#include "c.h"
+*/
+// ??/U0000000A #include "d.h"
+#include "e.h"
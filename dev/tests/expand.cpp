@@ -0,0 +1,156 @@
+// Run the tests/macroexpand cases through MacroExpander and compare the
+// text it gives with their .ref files.  A case is source with #define and
+// #undef lines, and the text between them is expanded with the macros
+// defined so far.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pp.h"
+#include "macrotable.h"
+#include "macroexpand.h"
+
+using namespace std;
+
+static string ReadFile(const string& path)
+{
+    ifstream in(path);
+    ostringstream oss;
+
+    oss << in.rdbuf();
+
+    return oss.str();
+}
+
+// ExpansionCase: the macros and expanded text of one case
+class ExpansionCase
+{
+public:
+    ExpansionCase()
+        : mExpander(mMacros)
+    {
+        SpellingTable& spellings = mMacros.spellings();
+
+        mHash = spellings.intern("#");
+        mDefine = spellings.intern("define");
+        mUndef = spellings.intern("undef");
+    }
+
+    string run(const string& source)
+    {
+        MacroTokenBuffer buffer(mMacros.spellings());
+        PPTokenizer tokenizer(buffer);
+
+        tokenizer.process(source.data(), source.size());
+        tokenizer.process(EndOfFile);
+
+        const vector<MacroToken>& tokens = buffer.tokens();
+
+        for (size_t i = 0; i < tokens.size(); )
+        {
+            size_t end = i;
+
+            while (end < tokens.size() && tokens[end].kind != PPT_NEW_LINE)
+                end++;
+
+            // The new-line goes with the line
+            size_t next = min(end + 1, tokens.size());
+
+            if (end - i >= 2 && tokens[i].spelling == mHash &&
+                    (tokens[i + 1].spelling == mDefine ||
+                        tokens[i + 1].spelling == mUndef))
+            {
+                flush();
+                directive(&tokens[i + 1], end - i - 1);
+            }
+            else
+                mText.insert(mText.end(), &tokens[i], &tokens[0] + next);
+
+            i = next;
+        }
+
+        flush();
+
+        return mOutput;
+    }
+
+protected:
+    void directive(const MacroToken* tokens, size_t count)
+    {
+        try
+        {
+            if (tokens[0].spelling == mDefine)
+                mMacros.define(tokens + 1, count - 1);
+            else if (count > 1)
+                mMacros.undefine(mMacros.spellings().spelling(tokens[1].spelling));
+        }
+        catch (exception& e)
+        {
+            mOutput += string("ERROR: ") + e.what() + "\n";
+        }
+    }
+
+    // Expand the text collected since the last directive
+    void flush()
+    {
+        vector<MacroToken> expanded;
+
+        try
+        {
+            mExpander.expand(mText.data(), mText.size(), expanded);
+            mOutput += mExpander.spell(expanded.data(), expanded.size());
+        }
+        catch (exception& e)
+        {
+            mOutput += string("ERROR: ") + e.what() + "\n";
+        }
+
+        mText.clear();
+    }
+
+    MacroTable mMacros;
+    MacroExpander mExpander;
+    vector<MacroToken> mText;
+    string mOutput;
+    uint32_t mHash, mDefine, mUndef;
+};
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string test = argv[i];
+        string ref = test.substr(0, test.rfind('.')) + ".ref";
+        string output;
+
+        try
+        {
+            ExpansionCase expansion;
+
+            output = expansion.run(ReadFile(test));
+        }
+        catch (exception& e)
+        {
+            output = string("ERROR: ") + e.what() + "\n";
+        }
+
+        if (output != ReadFile(ref))
+        {
+            cerr << "ERROR: " << test << ": expansion differs from " << ref
+                << ":" << endl << output;
+            failures++;
+        }
+    }
+
+    if (failures)
+        return EXIT_FAILURE;
+
+    cout << "macroexpand: " << argc - 1 << " cases pass" << endl;
+
+    return EXIT_SUCCESS;
+}
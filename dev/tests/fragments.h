@@ -0,0 +1,46 @@
+/// Random source text for the randomized tokenizer tests
+///
+/// @file fragments.h
+
+#pragma once
+
+#include <random>
+#include <string>
+
+using namespace std;
+
+// Pieces the sources and edits are made of, chosen to cut comments, raw
+// strings, splices and directives at every point and to move them across
+// checkpoints.  The pieces at the end only come up when asked for, as they
+// make most sources invalid.
+static const char* const Fragments[] = {
+    "//", "/*", "*/", "*", "/", "\\\n", "?\?/\n", "?\?/", "?", "?\?=", "\n",
+    " ", "abc", "R\"x(", ")x\"", "\"s\"", "'c'", "#include <a.h>\n",
+    "#include \"b.h\"\n", "#define X 1\n", "123", "1.5e+3", "\\u00e9",
+    "\xc3\xa9", "\t", "u8\"q\"", "#", "%:", "<:", "x", "/**/",
+    "// c\\\nstill\n", "R\"(a\nb)\"", "int a = 1;\n", "\n\n",
+    "\\u002A", "\\U0000002a/", "\\u000a", "?\?/u000A",
+
+    // pieces of escape sequences, literals and UTF-8 characters, mostly
+    // malformed
+    "\"a\\q\"", "\xff", "'", "\"", "\\", "u8R\"(", ")\"", "\xe2\x82", "\xac",
+    "e+", "\"\\x41\"", "'\\u12'", "L'"
+};
+
+static const size_t FragmentCount = sizeof(Fragments) / sizeof(Fragments[0]);
+static const size_t MalformedFragmentCount = 13;
+
+// Up to maxFragments random fragments, malformed ones only if asked for
+static inline string RandomText(mt19937& rng, size_t maxFragments,
+    bool malformed = false)
+{
+    string text;
+    size_t count = rng() % (maxFragments + 1);
+    size_t choices = malformed ? FragmentCount :
+        FragmentCount - MalformedFragmentCount;
+
+    for (size_t i = 0; i < count; i++)
+        text += Fragments[rng() % choices];
+
+    return text;
+}
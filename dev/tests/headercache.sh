@@ -0,0 +1,81 @@
+#!/bin/sh
+# headercache.sh: scan generated translation units with depscan --follow on
+# several threads sharing a header cache too small to hold their headers,
+# and check that the output is the same as without a cache
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# 120 headers of some 10 KB each, every one including a dozen later ones
+# behind include guards, #pragma once or none, and 16 units including 20
+# headers each
+awk -v dir="$work" 'BEGIN {
+    srand(1)
+    headers = 120
+
+    for (i = 0; i < headers; i++)
+    {
+        file = dir "/h" i ".h"
+        includes = ""
+
+        for (j = 0; j < 12 && i + 10 < headers; j++)
+            includes = includes "#include \"h" (i + 10 + int(rand() * (headers - i - 10))) ".h\"\n"
+
+        if (i % 4 == 0)
+            printf "#pragma once\n%s", includes > file
+        else if (i % 4 == 1)
+            printf "#ifndef H%d_H\n#define H%d_H\n%s", i, i, includes > file
+        else if (i % 4 == 2)
+            printf "#if !defined(H%d_H)\n#define H%d_H\n%s#if 0\n#include \"missing.h\"\n#endif\n", i, i, includes > file
+
+        for (j = 0; j < 200; j++)
+            printf "int f%d_%d(int x) { return x * %d; } // filler\n", i, j, j > file
+
+        if (i % 4 == 1 || i % 4 == 2)
+            printf "#endif\n" > file
+
+        close(file)
+    }
+
+    for (t = 0; t < 16; t++)
+    {
+        file = dir "/tu" t ".cpp"
+
+        for (j = 0; j < 20; j++)
+            printf "#include <h%d.h>\n", int(rand() * headers) > file
+
+        printf "int main() {}\n" > file
+        close(file)
+    }
+}'
+
+status=0
+
+./depscan --follow -I "$work" --cache-size 0 "$work"/tu*.cpp > "$work/expected" ||
+    status=1
+
+for threads in 1 4
+do
+    ./depscan --follow -I "$work" --threads $threads --cache-size 1 --stats \
+        "$work"/tu*.cpp > "$work/out" 2> "$work/stats" || status=1
+
+    if ! cmp -s "$work/expected" "$work/out"
+    then
+        echo "ERROR: depscan --threads $threads with a 1 MB cache differs" \
+            "from no cache"
+        status=1
+    fi
+
+    if ! grep -q 'evictions: [1-9]' "$work/stats"
+    then
+        echo "ERROR: depscan --threads $threads evicted nothing from a 1 MB" \
+            "cache"
+        status=1
+    fi
+done
+
+[ $status -eq 0 ] && echo "headercache: cached scans match, with evictions"
+
+exit $status
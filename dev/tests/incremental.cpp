@@ -0,0 +1,158 @@
+// Randomized edits of IncrementalTokenizer checked against tokenizing the
+// whole edited buffer again
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "incremental.h"
+#include "fragments.h"
+
+using namespace std;
+
+// Tokenize source from scratch, false if the tokenizer rejects it
+static bool Tokenize(const string& source, PPTokenBuffer::TokenList& tokens)
+{
+    PPTokenBuffer buffer;
+    PPTokenizer tokenizer(buffer);
+
+    try
+    {
+        tokenizer.process(source.data(), source.size());
+        tokenizer.process(EndOfFile);
+    }
+    catch (exception&)
+    {
+        return false;
+    }
+
+    tokens = buffer.tokens();
+    return true;
+}
+
+// Edits that leave the tokenizer in the same state past their own line,
+// each of which must only lex from the checkpoint before it up to the first
+// one after it
+static bool CheckLocalEdits()
+{
+    const unsigned int interval = 16;
+    const string line = "int value = 12345; /* a comment */\n";
+    const size_t lines = 4096;
+    string source;
+
+    for (size_t i = 0; i < lines; i++)
+        source += line;
+
+    IncrementalTokenizer incremental(interval);
+    incremental.tokenize(source);
+
+    if (incremental.lexed() != source.size())
+    {
+        cerr << "ERROR: tokenizing lexed " << incremental.lexed()
+            << " bytes of " << source.size() << endl;
+        return false;
+    }
+
+    struct LocalEdit
+    {
+        size_t line;
+        size_t column;
+        size_t removed;
+        const char* inserted;
+    };
+
+    static const LocalEdit Edits[] = {
+        { 2000, 12, 5, "67" },                // change a number
+        { 2000, 0, 0, "#define X 1\n" },      // insert a line
+        { 2000, 19, 0, "\\\n" },              // splice a line
+        { 3000, 22, 3, "*/ /*" },             // end and start a comment
+        { 3000, 33, 1, "" },                  // join two lines
+        { 1, 0, 0, "x" },                     // edit near the start
+        { lines - 1, 0, line.size(), "" }     // remove the last line
+    };
+
+    for (const LocalEdit& edit : Edits)
+    {
+        size_t offset = min(edit.line * line.size() + edit.column,
+            source.size());
+        PPTokenBuffer::TokenList expected;
+
+        source.replace(offset, edit.removed, edit.inserted);
+        incremental.edit(offset, edit.removed, edit.inserted);
+
+        // Up to interval lines back to the checkpoint, the edited lines, and
+        // up to interval lines on to the next one
+        size_t bound = (2 * interval + 2) * line.size() + strlen(edit.inserted);
+
+        if (!Tokenize(source, expected) || incremental.tokens() != expected)
+        {
+            cerr << "ERROR: tokens differ after a local edit at " << offset
+                << endl;
+            return false;
+        }
+
+        if (incremental.lexed() > bound)
+        {
+            cerr << "ERROR: a local edit at " << offset << " lexed "
+                << incremental.lexed() << " bytes, more than " << bound
+                << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    size_t edits = 0;
+
+    if (!CheckLocalEdits())
+        return EXIT_FAILURE;
+
+    for (int run = 0; run < 2000; run++)
+    {
+        string source = RandomText(rng, 80);
+        IncrementalTokenizer incremental(1 + rng() % 4);
+        PPTokenBuffer::TokenList expected;
+
+        if (!Tokenize(source, expected))
+            continue;
+
+        incremental.tokenize(source);
+
+        // Edit until the source becomes invalid, which ends the run
+        for (int i = 0; i < 20; i++)
+        {
+            size_t offset = rng() % (source.size() + 1);
+            size_t removed = rng() % (source.size() - offset + 1);
+            string inserted = RandomText(rng, 2);
+
+            if (removed > 6)
+                removed = min<size_t>(rng() % 3, source.size() - offset);
+
+            source.replace(offset, removed, inserted);
+
+            if (!Tokenize(source, expected))
+                break;
+
+            incremental.edit(offset, removed, inserted);
+            edits++;
+
+            if (incremental.tokens() != expected)
+            {
+                cerr << "ERROR: tokens differ after edit " << i << " of run "
+                    << run << " at " << offset << endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    cout << "incremental: " << edits << " edits match" << endl;
+
+    return EXIT_SUCCESS;
+}
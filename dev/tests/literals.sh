@@ -0,0 +1,35 @@
+#!/bin/sh
+# literals.sh: run the tests/literals cases through posttoken and compare
+# what it prints, diagnostics included, and its exit status with the .ref
+# files
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+status=0
+
+for t in tests/literals/*.t
+do
+    ref=${t%.t}.ref
+
+    if ./posttoken < "$t" > "$work/out" 2> "$work/stderr"
+    then
+        echo EXIT_SUCCESS
+    else
+        echo EXIT_FAILURE
+    fi >> "$work/out"
+
+    cat "$work/stderr" >> "$work/out"
+
+    if ! cmp -s "$work/out" "$ref"
+    then
+        echo "ERROR: $t: posttoken output differs from $ref"
+        status=1
+    fi
+done
+
+[ $status -eq 0 ] && echo "literals: all cases pass"
+
+exit $status
@@ -0,0 +1,2 @@
+0 00 07 017 0777u 01234567ull 0_9
+08 09 0128 019u 08_x
@@ -0,0 +1,3 @@
+0x1ffffffffffffffff 07777777777777777777777 99999999999999999999
+18446744073709551615 0xffffffffffffffff 0xffffffffffffffffu 01777777777777777777777
+0x100000000l 2147483648 0x 0xg
@@ -0,0 +1,7 @@
+"\x7f" u8"\x7f" "\x7e\x80";
+u8"\x7f" "\x7f";
+u"a"_x "b"_y U"c";
+U"a" "b"_x u"c"_y;
+u"a" "b" U"c";
+"a"_x "b"_y;
+"a"_x "b" "c"_x;
@@ -0,0 +1,18 @@
+#define foo foo
+foo
+#define AA BB
+#define BB AA
+AA BB
+#define bar(x) bar(x) x
+bar(bar(1))
+#define LOW LOW ", world"
+LOW
+#define x 3
+#define f(a) f(x * (a))
+#undef x
+#define x 2
+#define g f
+#define z z[0]
+f(y+1) + f(f(z)) % g(x)
+#define ind(a) a ind
+ind(ind)(1)
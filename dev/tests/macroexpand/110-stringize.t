@@ -0,0 +1,13 @@
+#define str(x) # x
+char c[2][6] = { str(hello), str() };
+str(  a   +   b  )
+str("a\n" 'b' "\\")
+#define xstr(s) str(s)
+#define INCFILE(n) vers ## n
+xstr(INCFILE(2).h)
+fputs(str(strncmp("abc\0d", "abc", '\4') // this goes away
+ == 0) str(: @\n), s);
+#define showlist(...) puts(#__VA_ARGS__)
+showlist(The first, second, and third items.);
+#define report(test, ...) ((test)?puts(#test): printf(__VA_ARGS__))
+report(x>y, "x is %d but y is %d", x, y);
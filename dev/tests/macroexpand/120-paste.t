@@ -0,0 +1,18 @@
+#define debug(s, t) printf("x" # s "= %d, x" # t "= %s", x ## s, x ## t)
+debug(1, 2);
+#define glue(a, b) a ## b
+#define xglue(a, b) glue(a, b)
+#define HIGHLOW "hello"
+#define LOW LOW ", world"
+glue(HIGH, LOW);
+xglue(HIGH, LOW)
+#define hash_hash # ## #
+#define mkstr(a) # a
+#define in_between(a) mkstr(a)
+#define join(c, d) in_between(c hash_hash d)
+char p[] = join(x, y);
+#define t(x,y,z) x ## y ## z
+int j[] = { t(1,2,3), t(,4,5), t(6,,7), t(8,9,),
+ t(10,,), t(,11,), t(,,12), t(,,) };
+#define ARROW(a,b) a ## b
+ARROW(-,>) ARROW(<,<=) ARROW(%:,%:)
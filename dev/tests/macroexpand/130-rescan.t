@@ -0,0 +1,41 @@
+#define x 2
+#define f(a) f(x * (a))
+#define g f
+#define h g(~
+#define m(a) a(w)
+#define w 0,1
+#define t(a) a
+#define p() int
+#define q(x) x
+#define r(x,y) x ## y
+f(y+1) + f(f(2)) % t(t(g)(0) + t)(1);
+g(x+(3,4)-w) | h 5) & m
+(f)^m(m);
+p() i[q()] = { q(1), r(2,3), r(4,), r(,5), r(,) };
+#define CAT(a, b) CAT_I(a, b)
+#define CAT_I(a, b) a ## b
+#define INC(x) CAT(INC_, x)
+#define INC_0 1
+#define INC_1 2
+#define INC_2 3
+#define INC_3 4
+#define REPEAT(n, m) CAT(REPEAT_, n)(m)
+#define REPEAT_0(m)
+#define REPEAT_1(m) REPEAT_0(m) m(0)
+#define REPEAT_2(m) REPEAT_1(m) m(1)
+#define REPEAT_3(m) REPEAT_2(m) m(2)
+#define REPEAT_4(m) REPEAT_3(m) m(3)
+#define DECL(i) int CAT(v, i) = INC(i);
+REPEAT(4, DECL)
+#define EMPTY()
+#define DEFER(id) id EMPTY()
+#define EXPAND(...) __VA_ARGS__
+#define A() 123
+DEFER(A)()
+EXPAND(DEFER(A)())
+#define lparen (
+#define fn(x) [x]
+fn lparen 1)
+fn
+(2)
+fn
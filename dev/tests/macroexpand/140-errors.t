@@ -0,0 +1,8 @@
+#define ARROW(a,b) a ## b
+ARROW(+,-)
+#define two(a,b) a b
+two(1)
+#define one(a) a
+one(1
+#define one(a) [a]
+#define dup(a,a) a
@@ -0,0 +1,115 @@
+#!/bin/sh
+# postcache.sh: run the pa2 tests through posttoken without a cache, with an
+# empty cache and with the cache the previous run filled, and check that the
+# three runs print the same and that the last one was replayed.  Then check
+# that a damaged cache file is a miss.
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cache=$work/cache
+mkdir "$cache"
+
+# run <name> <input> <posttoken arguments...>: save the output of a run,
+# stdout and the exit status in one file and stderr in another
+run()
+{
+    name=$1
+    input=$2
+    shift 2
+
+    if ./posttoken "$@" < "$input" > "$work/$name.out" \
+            2> "$work/$name.stderr"
+    then
+        echo EXIT_SUCCESS
+    else
+        echo EXIT_FAILURE
+    fi >> "$work/$name.out"
+}
+
+# same <name...>: whether the named runs printed the same as the fresh one
+same()
+{
+    for name in "$@"
+    do
+        for out in out stderr
+        do
+            cmp -s "$work/fresh.$out" "$work/$name.$out" || return 1
+        done
+    done
+}
+
+# Every store writes a new file and renames it into place, so the inode
+# numbers of the cache files only stay the same if nothing was stored
+files()
+{
+    ls -i "$cache"
+}
+
+status=0
+cases=0
+replayed=0
+
+for t in ../pa2/tests/*.t
+do
+    run fresh "$t"
+    before=$(files)
+    run store "$t" --cache "$cache"
+    stored=$(files)
+    run replay "$t" --cache "$cache"
+
+    if ! same store replay
+    then
+        echo "ERROR: $t: posttoken prints differently with a cache"
+        status=1
+    fi
+
+    # Runs with diagnostics aren't stored, the others must be replayed
+    if [ "$stored" != "$before" ]
+    then
+        if [ "$(files)" != "$stored" ]
+        then
+            echo "ERROR: $t: posttoken stored again instead of replaying"
+            status=1
+        fi
+
+        replayed=$((replayed + 1))
+    fi
+
+    cases=$((cases + 1))
+done
+
+if [ $replayed -eq 0 ]
+then
+    echo "ERROR: nothing was stored in the cache"
+    status=1
+fi
+
+# Point the source of the first token of a cache file far outside its arena.
+# It starts 8 bytes into the PostToken records, which follow the 48 byte
+# header.  The damaged file must be a miss, so it is stored again.
+printf 'int x = 1;\n' > "$work/damaged.t"
+rm -f "$cache"/*
+
+run fresh "$work/damaged.t"
+run store "$work/damaged.t" --cache "$cache"
+
+file=$(ls "$cache"/*)
+printf '\377\377\377\377' |
+    dd of="$file" bs=1 seek=56 conv=notrunc 2> /dev/null
+stored=$(files)
+
+run damaged "$work/damaged.t" --cache "$cache"
+
+if ! same store damaged || [ "$(files)" = "$stored" ]
+then
+    echo "ERROR: a damaged cache file wasn't a miss"
+    status=1
+fi
+
+[ $status -eq 0 ] &&
+    echo "postcache: $cases cases match, $replayed replayed, damage missed"
+
+exit $status
@@ -0,0 +1,40 @@
+#!/bin/sh
+# recover.sh: run the tests/recover cases through pptoken --recover and
+# posttoken --recover and compare what they print, diagnostics included, and
+# their exit status with the .ref and .post.ref files
+
+cd "$(dirname "$0")/.." || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+status=0
+
+# run <app> <input> <ref>: compare a run of app in recovery mode with ref
+run()
+{
+    if ./$1 --recover < "$2" > "$work/out" 2> "$work/stderr"
+    then
+        echo EXIT_SUCCESS
+    else
+        echo EXIT_FAILURE
+    fi >> "$work/out"
+
+    cat "$work/stderr" >> "$work/out"
+
+    if ! cmp -s "$work/out" "$3"
+    then
+        echo "ERROR: $2: $1 --recover output differs from $3"
+        status=1
+    fi
+}
+
+for t in tests/recover/*.t
+do
+    run pptoken "$t" "${t%.t}.ref"
+    run posttoken "$t" "${t%.t}.post.ref"
+done
+
+[ $status -eq 0 ] && echo "recover: all cases pass"
+
+exit $status
@@ -0,0 +1,3 @@
+int a = 'ab;
+"one" "\q" "\q" error;
+int b = 1;
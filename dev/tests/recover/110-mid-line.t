@@ -0,0 +1,3 @@
+x = y @ "\x" + z;
+w = "ok" $ v;
+next = 1;
@@ -0,0 +1,7 @@
+a /* comment
+still  comment */ b
+c */ d
+R"x(raw
+ raw)x" e
+R"bad delim(
+f
@@ -0,0 +1,177 @@
+// Run the tests/conditional cases through ConditionalSkipper twice: once
+// over the tokens of a full tokenization and once with the tokenizer in
+// skip mode for the inactive groups, given the input whole, a byte at a
+// time and in random pieces, each either in bulk or a byte at a time.
+// Every run must keep the same tokens, and those must be the ones in the
+// .ref file.  Cases with no errors outside their skipped groups must keep
+// the same tokens without recovery mode too.  ON is the only macro defined.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "macrotable.h"
+#include "conditional.h"
+
+using namespace std;
+
+static const char* const TokenKindNames[] = {
+    "whitespace-sequence",
+    "new-line",
+    "header-name",
+    "identifier",
+    "pp-number",
+    "character-literal",
+    "user-defined-character-literal",
+    "string-literal",
+    "user-defined-string-literal",
+    "preprocessing-op-or-punc",
+    "non-whitespace-character",
+    "error",
+    "eof"
+};
+
+static string ReadFile(const string& path)
+{
+    ifstream in(path, ios::binary);
+    ostringstream oss;
+
+    oss << in.rdbuf();
+
+    return oss.str();
+}
+
+static string Describe(const PPTokenBuffer::TokenList& tokens)
+{
+    string text;
+
+    for (const PPTokenRecord& token : tokens)
+    {
+        text += TokenKindNames[token.kind];
+
+        if (!token.data.empty())
+            text += " " + token.data;
+
+        if (!token.message.empty())
+            text += ": " + token.message;
+
+        text += "\n";
+    }
+
+    return text;
+}
+
+// Tokens kept from tokenizing all of source and filtering them afterwards
+static PPTokenBuffer::TokenList Full(const string& source,
+    const IMacroTable& macros)
+{
+    PPTokenBuffer tokens, kept;
+    PPTokenizer tokenizer(tokens);
+    ConditionalSkipper skipper(kept, macros);
+
+    tokenizer.setRecovery(true);
+    tokenizer.process(source.data(), source.size());
+    tokenizer.process(EndOfFile);
+
+    tokens.replay(skipper);
+
+    return kept.tokens();
+}
+
+// Tokens kept with the skipper switching the tokenizer to skip mode, the
+// source given in pieces of up to piece bytes, random ones if rng is set.
+// With bytes the pieces go through the tokenizer a byte at a time, which
+// never skips anything in bulk.
+static PPTokenBuffer::TokenList Skipped(const string& source,
+    const IMacroTable& macros, bool recovery, size_t piece, mt19937* rng,
+    bool bytes)
+{
+    PPTokenBuffer kept;
+    ConditionalSkipper skipper(kept, macros);
+    PPTokenizer tokenizer(skipper);
+
+    tokenizer.setRecovery(recovery);
+    skipper.setTokenizer(&tokenizer);
+
+    for (size_t i = 0; i < source.size(); )
+    {
+        size_t n = min(rng ? 1 + (*rng)() % piece : piece, source.size() - i);
+
+        if (bytes)
+        {
+            for (size_t j = i; j < i + n; j++)
+                tokenizer.process((unsigned char)source[j]);
+        }
+        else
+            tokenizer.process(source.data() + i, n);
+
+        i += n;
+    }
+
+    tokenizer.process(EndOfFile);
+
+    return kept.tokens();
+}
+
+int main(int argc, char** argv)
+{
+    MacroTable macros;
+    mt19937 rng(1);
+    int failures = 0;
+
+    macros.define("ON");
+
+    for (int i = 1; i < argc; i++)
+    {
+        string test = argv[i];
+        string ref = test.substr(0, test.rfind('.')) + ".ref";
+        string source = ReadFile(test);
+        PPTokenBuffer::TokenList expected = Full(source, macros);
+        bool same = true;
+
+        // Errors in skipped groups are never emitted, so only those outside
+        // them stop the case from running without recovery mode
+        bool errors = any_of(expected.begin(), expected.end(),
+            [](const PPTokenRecord& token) { return token.kind == PPT_ERROR; });
+
+        for (int recovery = errors; recovery < 2; recovery++)
+        {
+            same &= Skipped(source, macros, recovery, source.size() + 1,
+                nullptr, false) == expected;
+            same &= Skipped(source, macros, recovery, 1, nullptr,
+                false) == expected;
+            same &= Skipped(source, macros, recovery, 1, nullptr,
+                true) == expected;
+
+            for (int run = 0; run < 20; run++)
+                same &= Skipped(source, macros, recovery, 40, &rng,
+                    run % 2) == expected;
+        }
+
+        if (!same)
+        {
+            cerr << "ERROR: " << test << ": skip mode keeps other tokens than"
+                " full tokenization" << endl;
+            failures++;
+        }
+
+        if (Describe(expected) != ReadFile(ref))
+        {
+            cerr << "ERROR: " << test << ": tokens kept differ from " << ref
+                << ":" << endl << Describe(expected);
+            failures++;
+        }
+    }
+
+    if (failures)
+        return EXIT_FAILURE;
+
+    cout << "conditional: " << argc - 1 << " cases pass" << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+// Randomized sources tokenized with a snapshot taken after every byte and
+// restored into a fresh tokenizer, checked against tokenizing them in one
+// go in every combination of recovery, directives-only and skip mode
+
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "pp.h"
+#include "ppbuffer.h"
+#include "fragments.h"
+
+using namespace std;
+
+struct Mode
+{
+    bool recovery;
+    bool directivesOnly;
+    bool skipping;
+};
+
+// Tokenize source in the given mode, moving to a fresh tokenizer through a
+// snapshot once cut bytes are processed unless cut is past the end.  The
+// tokens are followed by what the tokenizer threw, if anything.
+static string Tokenize(const string& source, Mode mode, size_t cut)
+{
+    PPTokenBuffer buffer;
+    string error;
+
+    try
+    {
+        PPTokenizer tokenizer(buffer);
+
+        tokenizer.setRecovery(mode.recovery);
+        tokenizer.setDirectivesOnly(mode.directivesOnly);
+        tokenizer.setSkipping(mode.skipping);
+
+        if (cut > source.size())
+        {
+            tokenizer.process(source.data(), source.size());
+            tokenizer.process(EndOfFile);
+        }
+        else
+        {
+            tokenizer.process(source.data(), cut);
+
+            string snapshot = tokenizer.snapshot();
+            PPTokenizer restored(buffer);
+
+            restored.restore(snapshot);
+
+            if (restored.snapshot() != snapshot)
+                return "snapshot of the restored tokenizer differs";
+
+            restored.process(source.data() + cut, source.size() - cut);
+            restored.process(EndOfFile);
+        }
+    }
+    catch (exception& e)
+    {
+        error = e.what();
+    }
+
+    string text;
+
+    for (const PPTokenRecord& token : buffer.tokens())
+        text += to_string(token.kind) + " " + token.data + " " +
+            token.message + "\n";
+
+    return text + "throws " + error;
+}
+
+int main(int argc, char** argv)
+{
+    mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    size_t cuts = 0;
+
+    for (int run = 0; run < 200; run++)
+    {
+        string source = RandomText(rng, 30, true);
+
+        for (int m = 0; m < 8; m++)
+        {
+            Mode mode = { (m & 1) != 0, (m & 2) != 0, (m & 4) != 0 };
+            string expected = Tokenize(source, mode, source.size() + 1);
+
+            for (size_t cut = 0; cut <= source.size(); cut++, cuts++)
+            {
+                if (Tokenize(source, mode, cut) != expected)
+                {
+                    cerr << "ERROR: tokens differ restoring at " << cut
+                        << " of run " << run << " in mode " << m << endl;
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    cout << "snapshot: " << cuts << " restored snapshots match" << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -2,172 +2,183 @@
 
 #pragma once
 
-// See 3.9.1: Fundamental Types
-enum EFundamentalType
-{
-    FT_INVALID = 0,
-
-    // 3.9.1.2
-    FT_SIGNED_CHAR,
-    FT_SHORT_INT,
-    FT_INT,
-    FT_LONG_INT,
-    FT_LONG_LONG_INT,
-
-    // 3.9.1.3
-    FT_UNSIGNED_CHAR,
-    FT_UNSIGNED_SHORT_INT,
-    FT_UNSIGNED_INT,
-    FT_UNSIGNED_LONG_INT,
-    FT_UNSIGNED_LONG_LONG_INT,
+// The enums below are generated from these lists so tables indexed by them
+// (see posttoken.cpp) can be generated from the same lists and can't get out
+// of step with them.  Fundamental types are X(enumerator, spelling), tokens
+// are X(enumerator) as they are printed by their enumerator's name.
 
-    // 3.9.1.1 / 3.9.1.5
-    FT_WCHAR_T,
-    FT_CHAR,
-    FT_CHAR16_T,
-    FT_CHAR32_T,
+// See 3.9.1: Fundamental Types
+#define FUNDAMENTAL_TYPES(X) \
+    X(FT_INVALID, "invalid") \
+    /* 3.9.1.2 */ \
+    X(FT_SIGNED_CHAR, "signed char") \
+    X(FT_SHORT_INT, "short int") \
+    X(FT_INT, "int") \
+    X(FT_LONG_INT, "long int") \
+    X(FT_LONG_LONG_INT, "long long int") \
+    /* 3.9.1.3 */ \
+    X(FT_UNSIGNED_CHAR, "unsigned char") \
+    X(FT_UNSIGNED_SHORT_INT, "unsigned short int") \
+    X(FT_UNSIGNED_INT, "unsigned int") \
+    X(FT_UNSIGNED_LONG_INT, "unsigned long int") \
+    X(FT_UNSIGNED_LONG_LONG_INT, "unsigned long long int") \
+    /* 3.9.1.1 / 3.9.1.5 */ \
+    X(FT_WCHAR_T, "wchar_t") \
+    X(FT_CHAR, "char") \
+    X(FT_CHAR16_T, "char16_t") \
+    X(FT_CHAR32_T, "char32_t") \
+    /* 3.9.1.6 */ \
+    X(FT_BOOL, "bool") \
+    /* 3.9.1.8 */ \
+    X(FT_FLOAT, "float") \
+    X(FT_DOUBLE, "double") \
+    X(FT_LONG_DOUBLE, "long double") \
+    /* 3.9.1.9 */ \
+    X(FT_VOID, "void") \
+    /* 3.9.1.10 */ \
+    X(FT_NULLPTR_T, "nullptr_t")
 
-    // 3.9.1.6
-    FT_BOOL,
+// token types for `simples`
+#define KEYWORD_TOKEN_TYPES(X) \
+    X(KW_ALIGNAS) \
+    X(KW_ALIGNOF) \
+    X(KW_ASM) \
+    X(KW_AUTO) \
+    X(KW_BOOL) \
+    X(KW_BREAK) \
+    X(KW_CASE) \
+    X(KW_CATCH) \
+    X(KW_CHAR) \
+    X(KW_CHAR16_T) \
+    X(KW_CHAR32_T) \
+    X(KW_CLASS) \
+    X(KW_CONST) \
+    X(KW_CONSTEXPR) \
+    X(KW_CONST_CAST) \
+    X(KW_CONTINUE) \
+    X(KW_DECLTYPE) \
+    X(KW_DEFAULT) \
+    X(KW_DELETE) \
+    X(KW_DO) \
+    X(KW_DOUBLE) \
+    X(KW_DYNAMIC_CAST) \
+    X(KW_ELSE) \
+    X(KW_ENUM) \
+    X(KW_EXPLICIT) \
+    X(KW_EXPORT) \
+    X(KW_EXTERN) \
+    X(KW_FALSE) \
+    X(KW_FLOAT) \
+    X(KW_FOR) \
+    X(KW_FRIEND) \
+    X(KW_GOTO) \
+    X(KW_IF) \
+    X(KW_INLINE) \
+    X(KW_INT) \
+    X(KW_LONG) \
+    X(KW_MUTABLE) \
+    X(KW_NAMESPACE) \
+    X(KW_NEW) \
+    X(KW_NOEXCEPT) \
+    X(KW_NULLPTR) \
+    X(KW_OPERATOR) \
+    X(KW_PRIVATE) \
+    X(KW_PROTECTED) \
+    X(KW_PUBLIC) \
+    X(KW_REGISTER) \
+    X(KW_REINTERPET_CAST) \
+    X(KW_RETURN) \
+    X(KW_SHORT) \
+    X(KW_SIGNED) \
+    X(KW_SIZEOF) \
+    X(KW_STATIC) \
+    X(KW_STATIC_ASSERT) \
+    X(KW_STATIC_CAST) \
+    X(KW_STRUCT) \
+    X(KW_SWITCH) \
+    X(KW_TEMPLATE) \
+    X(KW_THIS) \
+    X(KW_THREAD_LOCAL) \
+    X(KW_THROW) \
+    X(KW_TRUE) \
+    X(KW_TRY) \
+    X(KW_TYPEDEF) \
+    X(KW_TYPEID) \
+    X(KW_TYPENAME) \
+    X(KW_UNION) \
+    X(KW_UNSIGNED) \
+    X(KW_USING) \
+    X(KW_VIRTUAL) \
+    X(KW_VOID) \
+    X(KW_VOLATILE) \
+    X(KW_WCHAR_T) \
+    X(KW_WHILE)
 
-    // 3.9.1.8
-    FT_FLOAT,
-    FT_DOUBLE,
-    FT_LONG_DOUBLE,
+#define OPERATOR_TOKEN_TYPES(X) \
+    X(OP_LBRACE) \
+    X(OP_RBRACE) \
+    X(OP_LSQUARE) \
+    X(OP_RSQUARE) \
+    X(OP_LPAREN) \
+    X(OP_RPAREN) \
+    X(OP_BOR) \
+    X(OP_XOR) \
+    X(OP_COMPL) \
+    X(OP_AMP) \
+    X(OP_LNOT) \
+    X(OP_SEMICOLON) \
+    X(OP_COLON) \
+    X(OP_DOTS) \
+    X(OP_QMARK) \
+    X(OP_COLON2) \
+    X(OP_DOT) \
+    X(OP_DOTSTAR) \
+    X(OP_PLUS) \
+    X(OP_MINUS) \
+    X(OP_STAR) \
+    X(OP_DIV) \
+    X(OP_MOD) \
+    X(OP_ASS) \
+    X(OP_LT) \
+    X(OP_GT) \
+    X(OP_PLUSASS) \
+    X(OP_MINUSASS) \
+    X(OP_STARASS) \
+    X(OP_DIVASS) \
+    X(OP_MODASS) \
+    X(OP_XORASS) \
+    X(OP_BANDASS) \
+    X(OP_BORASS) \
+    X(OP_LSHIFT) \
+    X(OP_RSHIFT) \
+    X(OP_RSHIFTASS) \
+    X(OP_LSHIFTASS) \
+    X(OP_EQ) \
+    X(OP_NE) \
+    X(OP_LE) \
+    X(OP_GE) \
+    X(OP_LAND) \
+    X(OP_LOR) \
+    X(OP_INC) \
+    X(OP_DEC) \
+    X(OP_COMMA) \
+    X(OP_ARROWSTAR) \
+    X(OP_ARROW)
 
-    // 3.9.1.9
-    FT_VOID,
+#define TYPE_ENUMERATOR(name, spelling) name,
+#define TOKEN_ENUMERATOR(name) name,
 
-    // 3.9.1.10
-    FT_NULLPTR_T
+enum EFundamentalType
+{
+    FUNDAMENTAL_TYPES(TYPE_ENUMERATOR)
 };
 
 // token type enum for `simples`
 enum ETokenType
 {
-    // keywords
-    KW_ALIGNAS,
-    KW_ALIGNOF,
-    KW_ASM,
-    KW_AUTO,
-    KW_BOOL,
-    KW_BREAK,
-    KW_CASE,
-    KW_CATCH,
-    KW_CHAR,
-    KW_CHAR16_T,
-    KW_CHAR32_T,
-    KW_CLASS,
-    KW_CONST,
-    KW_CONSTEXPR,
-    KW_CONST_CAST,
-    KW_CONTINUE,
-    KW_DECLTYPE,
-    KW_DEFAULT,
-    KW_DELETE,
-    KW_DO,
-    KW_DOUBLE,
-    KW_DYNAMIC_CAST,
-    KW_ELSE,
-    KW_ENUM,
-    KW_EXPLICIT,
-    KW_EXPORT,
-    KW_EXTERN,
-    KW_FALSE,
-    KW_FLOAT,
-    KW_FOR,
-    KW_FRIEND,
-    KW_GOTO,
-    KW_IF,
-    KW_INLINE,
-    KW_INT,
-    KW_LONG,
-    KW_MUTABLE,
-    KW_NAMESPACE,
-    KW_NEW,
-    KW_NOEXCEPT,
-    KW_NULLPTR,
-    KW_OPERATOR,
-    KW_PRIVATE,
-    KW_PROTECTED,
-    KW_PUBLIC,
-    KW_REGISTER,
-    KW_REINTERPET_CAST,
-    KW_RETURN,
-    KW_SHORT,
-    KW_SIGNED,
-    KW_SIZEOF,
-    KW_STATIC,
-    KW_STATIC_ASSERT,
-    KW_STATIC_CAST,
-    KW_STRUCT,
-    KW_SWITCH,
-    KW_TEMPLATE,
-    KW_THIS,
-    KW_THREAD_LOCAL,
-    KW_THROW,
-    KW_TRUE,
-    KW_TRY,
-    KW_TYPEDEF,
-    KW_TYPEID,
-    KW_TYPENAME,
-    KW_UNION,
-    KW_UNSIGNED,
-    KW_USING,
-    KW_VIRTUAL,
-    KW_VOID,
-    KW_VOLATILE,
-    KW_WCHAR_T,
-    KW_WHILE,
-
-    // operators/punctuation
-    OP_LBRACE,
-    OP_RBRACE,
-    OP_LSQUARE,
-    OP_RSQUARE,
-    OP_LPAREN,
-    OP_RPAREN,
-    OP_BOR,
-    OP_XOR,
-    OP_COMPL,
-    OP_AMP,
-    OP_LNOT,
-    OP_SEMICOLON,
-    OP_COLON,
-    OP_DOTS,
-    OP_QMARK,
-    OP_COLON2,
-    OP_DOT,
-    OP_DOTSTAR,
-    OP_PLUS,
-    OP_MINUS,
-    OP_STAR,
-    OP_DIV,
-    OP_MOD,
-    OP_ASS,
-    OP_LT,
-    OP_GT,
-    OP_PLUSASS,
-    OP_MINUSASS,
-    OP_STARASS,
-    OP_DIVASS,
-    OP_MODASS,
-    OP_XORASS,
-    OP_BANDASS,
-    OP_BORASS,
-    OP_LSHIFT,
-    OP_RSHIFT,
-    OP_RSHIFTASS,
-    OP_LSHIFTASS,
-    OP_EQ,
-    OP_NE,
-    OP_LE,
-    OP_GE,
-    OP_LAND,
-    OP_LOR,
-    OP_INC,
-    OP_DEC,
-    OP_COMMA,
-    OP_ARROWSTAR,
-    OP_ARROW,
+    KEYWORD_TOKEN_TYPES(TOKEN_ENUMERATOR)
+    OPERATOR_TOKEN_TYPES(TOKEN_ENUMERATOR)
 };
+
+#undef TYPE_ENUMERATOR
+#undef TOKEN_ENUMERATOR
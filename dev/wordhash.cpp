@@ -0,0 +1,25 @@
+#include <cstring>
+
+#include "wordhash.h"
+
+uint64_t WordHash(const char* data, size_t length, uint64_t seed)
+{
+    const uint64_t K = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = (seed + length) * K;
+    uint64_t word;
+    size_t i = 0;
+
+    for (; i + sizeof(word) <= length; i += sizeof(word))
+    {
+        memcpy(&word, data + i, sizeof(word));
+        h = (h ^ word) * K;
+        h ^= h >> 32;
+    }
+
+    word = 0;
+    memcpy(&word, data + i, length - i);
+    h = (h ^ word) * K;
+    h ^= h >> 29;
+
+    return h;
+}
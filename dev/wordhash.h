@@ -0,0 +1,12 @@
+/// Hashing of file contents a word at a time
+///
+/// @file wordhash.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Hash of length bytes at data, read eight at a time.  Different seeds give
+// unrelated hashes of the same bytes.
+uint64_t WordHash(const char* data, size_t length, uint64_t seed = 0);
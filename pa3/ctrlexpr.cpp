@@ -5,6 +5,9 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
 #include "token.h"
 #include "ctrlexpr.h"
@@ -21,15 +24,166 @@ bool PA3Mock_IsDefinedIdentifier(const string& identifier)
 		return identifier[0] % 2;
 }
 
-class CtrlExprParser
+// Codes of controlling expression tokens.  The binary operators come first
+// so BinaryPrecedence can be indexed by them; CE_ADD and CE_SUB are also
+// the unary + and -.
+enum ECtrlExprOp : unsigned char
+{
+	CE_MUL,
+	CE_DIV,
+	CE_MOD,
+	CE_ADD,
+	CE_SUB,
+	CE_LSHIFT,
+	CE_RSHIFT,
+	CE_LT,
+	CE_GT,
+	CE_LE,
+	CE_GE,
+	CE_EQ,
+	CE_NE,
+	CE_BAND,
+	CE_XOR,
+	CE_BOR,
+	CE_LAND,
+	CE_LOR,
+	CE_QMARK,
+
+	CE_COLON,
+	CE_LNOT,
+	CE_COMPL,
+	CE_LPAREN,
+	CE_RPAREN,
+	CE_VALUE,
+	CE_IDENTIFIER,
+	CE_DEFINED,
+	CE_INVALID,
+	CE_END
+};
+
+// Precedence of each binary operator, higher binds tighter.  Everything
+// from CE_COLON on ends a binary expression.
+static const int BinaryPrecedence[CE_END + 1] =
+{
+	10, 10, 10,         // * / %
+	9, 9,               // + -
+	8, 8,               // << >>
+	7, 7, 7, 7,         // < > <= >=
+	6, 6,               // == !=
+	5,                  // &
+	4,                  // ^
+	3,                  // |
+	2,                  // &&
+	1,                  // ||
+	0,                  // ?:
+
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+// CtrlExprValue: a value promoted to intmax_t or uintmax_t.  Every
+// operand is evaluated, errors only make the whole expression an error
+// if they reach it through operands that are actually used.
+struct CtrlExprValue
+{
+	unsigned long long value;
+	bool isSigned;
+	bool error;
+};
+
+// CtrlExprToken: a post-token of a controlling expression
+struct CtrlExprToken
+{
+	ECtrlExprOp op;
+	bool identifier;        // true and false are also identifiers
+	bool defined;           // identifiers: result of `defined` on them
+	CtrlExprValue value;    // CE_VALUE
+};
+
+// Convert a simple token to its code, CE_INVALID if it can't appear in a
+// controlling expression
+static ECtrlExprOp CtrlExprOpOf(ETokenType type)
+{
+	switch (type)
+	{
+	case OP_STAR: return CE_MUL;
+	case OP_DIV: return CE_DIV;
+	case OP_MOD: return CE_MOD;
+	case OP_PLUS: return CE_ADD;
+	case OP_MINUS: return CE_SUB;
+	case OP_LSHIFT: return CE_LSHIFT;
+	case OP_RSHIFT: return CE_RSHIFT;
+	case OP_LT: return CE_LT;
+	case OP_GT: return CE_GT;
+	case OP_LE: return CE_LE;
+	case OP_GE: return CE_GE;
+	case OP_EQ: return CE_EQ;
+	case OP_NE: return CE_NE;
+	case OP_AMP: return CE_BAND;
+	case OP_XOR: return CE_XOR;
+	case OP_BOR: return CE_BOR;
+	case OP_LAND: return CE_LAND;
+	case OP_LOR: return CE_LOR;
+	case OP_QMARK: return CE_QMARK;
+	case OP_COLON: return CE_COLON;
+	case OP_LNOT: return CE_LNOT;
+	case OP_COMPL: return CE_COMPL;
+	case OP_LPAREN: return CE_LPAREN;
+	case OP_RPAREN: return CE_RPAREN;
+	default: return CE_INVALID;
+	}
+}
+
+// Promote an integral literal of type T.  bool counts as signed.
+template<typename T>
+static CtrlExprValue promote(const void* data)
+{
+	T value;
+	memcpy(&value, data, sizeof(value));
+
+	CtrlExprValue result;
+	result.error = false;
+	result.isSigned = numeric_limits<T>::is_signed || is_same<T, bool>::value;
+	result.value = result.isSigned ? (unsigned long long)(long long)value :
+		(unsigned long long)value;
+
+	return result;
+}
+
+// CtrlExprParser: collects the post-tokens of one controlling expression
+// and evaluates it by precedence climbing over their codes
+class CtrlExprParser : public IPostTokenStream
 {
 public:
-	CtrlExprParser() {}
-	typedef vector<pair<PPToken, string>> TokenList;
+	CtrlExprParser() : mPost(*this) {}
 
-	void addToken(PPToken tokenType, string value)
+	void addToken(PPToken tokenType, const string& value)
 	{
-		mTokens.push_back(make_pair(tokenType, value));
+		switch (tokenType)
+		{
+		case TK_IDENTIFIER:
+			// Keywords are identifiers here so these don't go through
+			// post-tokenization
+			if (value == "true" || value == "false")
+				addValue(value[0] == 't', true);
+			else
+				addOp(value == "defined" ? CE_DEFINED : CE_IDENTIFIER);
+
+			mTokens.back().identifier = true;
+			mTokens.back().defined = PA3Mock_IsDefinedIdentifier(value);
+			break;
+		case TK_PPNUMBER:
+			mPost.emit_pp_number(value);
+			break;
+		case TK_CHARLITERAL:
+			mPost.emit_character_literal(value);
+			break;
+		case TK_PREPROC:
+			mPost.emit_preprocessing_op_or_punc(value);
+			break;
+		default:
+			addOp(CE_INVALID);
+			break;
+		}
 	}
 
 	bool isEmpty() { return mTokens.empty(); }
@@ -42,137 +196,293 @@ public:
 	bool evaluate(unsigned long long *result, bool *isSigned)
 	{
 		*result = 0;
-		*isSigned = false;
+		*isSigned = true;
 
 		// Verify there are tokens
 		if (mTokens.size() == 0)
 			return false;
 
 		// Append the sentinal for the end of the stream
-		mTokens.push_back(make_pair(TK_END, ""));
+		addOp(CE_END);
 
 		// Start parsing
 		mCur = 0;
-		return parseControllingExpr(result, isSigned);
-	}
+		CtrlExprValue value = parseExpr(0);
 
-protected:
-	bool parseControllingExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseLogicalOrExpr(result, isSigned))
-			return true;
+		if (mTokens[mCur].op != CE_END)
+			throw runtime_error("syntax error");
 
-		return false;
+		if (value.error)
+			throw runtime_error("division by zero, overflow or shift out of range");
+
+		*result = value.value;
+		*isSigned = value.isSigned;
+		return true;
 	}
 
-	bool parseLogicalOrExpr(unsigned long long *result, bool *isSigned)
+	// IPostTokenStream: anything but an integral literal or an
+	// operator is an invalid token in a controlling expression
+	void emit_invalid(const string&) { addOp(CE_INVALID); }
+	void emit_simple(const string&, ETokenType type) { addOp(CtrlExprOpOf(type)); }
+	void emit_identifier(const string&) { addOp(CE_INVALID); }
+
+	void emit_literal(const string&, EFundamentalType type, const void* data, size_t)
 	{
-		if (parseLogicalAndExpr(result, isSigned))
-			return true;
+		CtrlExprValue value;
 
-		return false;
+		switch (type)
+		{
+		case FT_SIGNED_CHAR: value = promote<signed char>(data); break;
+		case FT_SHORT_INT: value = promote<short int>(data); break;
+		case FT_INT: value = promote<int>(data); break;
+		case FT_LONG_INT: value = promote<long int>(data); break;
+		case FT_LONG_LONG_INT: value = promote<long long int>(data); break;
+		case FT_UNSIGNED_CHAR: value = promote<unsigned char>(data); break;
+		case FT_UNSIGNED_SHORT_INT: value = promote<unsigned short int>(data); break;
+		case FT_UNSIGNED_INT: value = promote<unsigned int>(data); break;
+		case FT_UNSIGNED_LONG_INT: value = promote<unsigned long int>(data); break;
+		case FT_UNSIGNED_LONG_LONG_INT: value = promote<unsigned long long int>(data); break;
+		case FT_WCHAR_T: value = promote<wchar_t>(data); break;
+		case FT_CHAR: value = promote<char>(data); break;
+		case FT_CHAR16_T: value = promote<char16_t>(data); break;
+		case FT_CHAR32_T: value = promote<char32_t>(data); break;
+		case FT_BOOL: value = promote<bool>(data); break;
+		default:
+			addOp(CE_INVALID);
+			return;
+		}
+
+		addValue(value.value, value.isSigned);
 	}
 
-	bool parseLogicalAndExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseInclusiveOrExpr(result, isSigned))
-			return true;
+	void emit_literal_array(const string&, size_t, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_character(const string&, const string&, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_string_array(const string&, const string&, size_t, EFundamentalType, const void*, size_t) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_integer(const string&, const string&, const string&) { addOp(CE_INVALID); }
+	void emit_user_defined_literal_floating(const string&, const string&, const string&) { addOp(CE_INVALID); }
+	void emit_eof() {}
 
-		return false;
+protected:
+	void addOp(ECtrlExprOp op)
+	{
+		CtrlExprToken token;
+		token.op = op;
+		token.identifier = false;
+		token.defined = false;
+		token.value.value = 0;
+		token.value.isSigned = true;
+		token.value.error = false;
+
+		mTokens.push_back(token);
 	}
 
-	bool parseInclusiveOrExpr(unsigned long long *result, bool *isSigned)
+	void addValue(unsigned long long value, bool isSigned)
 	{
-		if (parseExclusiveOrExpr(result, isSigned))
-			return true;
-
-		return false;
+		addOp(CE_VALUE);
+		mTokens.back().value.value = value;
+		mTokens.back().value.isSigned = isSigned;
 	}
 
-	bool parseExclusiveOrExpr(unsigned long long *result, bool *isSigned)
+	// Parse operators binding at least as tight as minPrecedence
+	CtrlExprValue parseExpr(int minPrecedence)
 	{
-		if (parseAndExpr(result, isSigned))
-			return true;
+		CtrlExprValue left = parseUnaryExpr();
 
-		return false;
-	}
+		for (;;)
+		{
+			ECtrlExprOp op = mTokens[mCur].op;
+			int precedence = BinaryPrecedence[op];
 
-	bool parseAndExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseEqualityExpr(result, isSigned))
-			return true;
+			if (precedence < minPrecedence)
+				return left;
 
-		return false;
-	}
+			mCur++;
 
-	bool parseEqualityExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseRelationalExpr(result, isSigned))
-			return true;
+			if (op == CE_QMARK)
+			{
+				CtrlExprValue second = parseExpr(0);
 
-		return false;
-	}
+				if (mTokens[mCur++].op != CE_COLON)
+					throw runtime_error("expected : in conditional expression");
 
-	bool parseRelationalExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseShiftExpr(result, isSigned))
-			return true;
+				CtrlExprValue third = parseExpr(0);
 
-		return false;
-	}
+				// The type comes from both operands even though only one is
+				// used, unless the condition is already an error
+				if (!left.error)
+				{
+					const CtrlExprValue& chosen = left.value ? second : third;
 
-	bool parseShiftExpr(unsigned long long *result, bool *isSigned)
-	{
-		if (parseAdditiveExpr(result, isSigned))
-			return true;
+					left.value = chosen.value;
+					left.error = chosen.error;
+					left.isSigned = second.isSigned && third.isSigned;
+				}
+				continue;
+			}
 
-		return false;
+			left = applyBinary(op, left, parseExpr(precedence + 1));
+		}
 	}
 
-	bool parseAdditiveExpr(unsigned long long *result, bool *isSigned)
+	CtrlExprValue parseUnaryExpr()
 	{
-		if (parseMultiplicativeExpr(result, isSigned))
-			return true;
+		CtrlExprValue value;
 
-		return false;
+		switch (mTokens[mCur].op)
+		{
+		case CE_ADD:
+			mCur++;
+			return parseUnaryExpr();
+		case CE_SUB:
+			mCur++;
+			value = parseUnaryExpr();
+			value.value = 0 - value.value;
+			return value;
+		case CE_LNOT:
+			mCur++;
+			value = parseUnaryExpr();
+			value.value = value.value == 0;
+			value.isSigned = true;
+			return value;
+		case CE_COMPL:
+			mCur++;
+			value = parseUnaryExpr();
+			value.value = ~value.value;
+			return value;
+		default:
+			return parsePrimaryExpr();
+		}
 	}
 
-	bool parseMultiplicativeExpr(unsigned long long *result, bool *isSigned)
+	CtrlExprValue parsePrimaryExpr()
 	{
-		if (parseUnaryExpr(result, isSigned))
-			return true;
+		const CtrlExprToken& token = mTokens[mCur++];
+		CtrlExprValue value;
 
-		return false;
+		value.value = 0;
+		value.isSigned = true;
+		value.error = false;
+
+		switch (token.op)
+		{
+		case CE_VALUE:
+			return token.value;
+		case CE_IDENTIFIER:
+			return value;
+		case CE_LPAREN:
+			value = parseExpr(0);
+
+			if (mTokens[mCur++].op != CE_RPAREN)
+				throw runtime_error("expected )");
+
+			return value;
+		case CE_DEFINED:
+			{
+				bool paren = mTokens[mCur].op == CE_LPAREN;
+				if (paren)
+					mCur++;
+
+				const CtrlExprToken& identifier = mTokens[mCur++];
+				if (!identifier.identifier)
+					throw runtime_error("expected identifier after defined");
+
+				if (paren && mTokens[mCur++].op != CE_RPAREN)
+					throw runtime_error("expected ) after defined");
+
+				value.value = identifier.defined;
+				return value;
+			}
+		default:
+			throw runtime_error("syntax error");
+		}
 	}
 
-	bool parseUnaryExpr(unsigned long long *result, bool *isSigned)
+	static CtrlExprValue applyBinary(ECtrlExprOp op, CtrlExprValue left,
+		CtrlExprValue right)
 	{
-		if (parsePrimaryExpr(result, isSigned))
-			return true;
+		// Usual arithmetic conversions: unsigned if either operand is
+		bool common = left.isSigned && right.isSigned;
 
-		return false;
-	}
+		unsigned long long a = left.value, b = right.value;
+		long long sa = (long long)a, sb = (long long)b;
 
-	bool parsePrimaryExpr(unsigned long long *result, bool *isSigned)
-	{
-		char *endPtr = nullptr;
+		// The most negative value divided by -1 overflows, which is as much
+		// an error as dividing by zero
+		bool overflow = common && sa == numeric_limits<long long>::min() &&
+			sb == -1;
+
+		CtrlExprValue result;
+		result.value = 0;
+		result.isSigned = common;
+		result.error = left.error || right.error;
 
-		// Check if this is a integral-literal
-		if (mTokens[mCur].first == TK_PPNUMBER)
+		switch (op)
 		{
-			// Try and convert to an unsigned long long
-			errno = 0;
-			*result = strtoull(mTokens[mCur].second.c_str(), &endPtr, 0);
-
-			// Check for failure
-			if ((*result == 0 && errno != 0) ||
-					endPtr != (mTokens[mCur].second.c_str()+mTokens[mCur].second.length()))
-				throw runtime_error("malformed number");
+		case CE_MUL: result.value = a * b; break;
+		case CE_DIV:
+			if (b == 0 || overflow)
+				result.error = true;
+			else if (!common)
+				result.value = a / b;
+			else
+				result.value = sa / sb;
+			break;
+		case CE_MOD:
+			if (b == 0 || overflow)
+				result.error = true;
+			else if (!common)
+				result.value = a % b;
+			else
+				result.value = sa % sb;
+			break;
+		case CE_ADD: result.value = a + b; break;
+		case CE_SUB: result.value = a - b; break;
+		case CE_LSHIFT:
+		case CE_RSHIFT:
+			// The type of a shift is that of its left operand
+			result.isSigned = left.isSigned;
+
+			if ((right.isSigned && sb < 0) || b >= 64)
+				result.error = true;
+			else if (op == CE_LSHIFT)
+				result.value = a << b;
+			else
+				result.value = left.isSigned ?
+					(unsigned long long)(sa >> b) : a >> b;
+			break;
+		case CE_LT: result.value = common ? sa < sb : a < b; break;
+		case CE_GT: result.value = common ? sa > sb : a > b; break;
+		case CE_LE: result.value = common ? sa <= sb : a <= b; break;
+		case CE_GE: result.value = common ? sa >= sb : a >= b; break;
+		case CE_EQ: result.value = a == b; break;
+		case CE_NE: result.value = a != b; break;
+		case CE_BAND: result.value = a & b; break;
+		case CE_XOR: result.value = a ^ b; break;
+		case CE_BOR: result.value = a | b; break;
+		case CE_LAND:
+			// The right operand only counts if the left one is true
+			result.error = left.error || (a != 0 && right.error);
+			result.value = a && b;
+			break;
+		case CE_LOR:
+			result.error = left.error || (a == 0 && right.error);
+			result.value = a || b;
+			break;
+		default:
+			break;
 		}
-		return false;
+
+		// Comparisons and logical operators give a bool
+		if (op >= CE_LT && op <= CE_NE)
+			result.isSigned = true;
+		else if (op == CE_LAND || op == CE_LOR)
+			result.isSigned = true;
+
+		return result;
 	}
 
-	TokenList mTokens;
+	TokenStream mPost;
+	vector<CtrlExprToken> mTokens;
 	unsigned int mCur;
 };
 
@@ -235,7 +545,7 @@ void CtrlExpr::emit_preprocessing_op_or_punc(const string& data)
 
 void CtrlExpr::emit_non_whitespace_char(const string& data)
 {
-
+	mParser->addToken(TK_NON_WHITESPACE_CHAR, data);
 }
 
 void CtrlExpr::emit_eof()
@@ -256,10 +566,10 @@ void CtrlExpr::eval_expr()
 	{
 		mParser->evaluate(&result, &isSigned);
 
-		cout << result;
-		if (!isSigned)
-			cout << "u";
-		cout << endl;
+		if (isSigned)
+			cout << (long long)result << endl;
+		else
+			cout << result << "u" << endl;
 	}
 	catch (exception& e)
 	{
@@ -19,6 +19,7 @@ enum PPToken {
 	TK_STRINGLITERAL,
 	TK_USER_STRINGLITERAL,
 	TK_PREPROC,
+	TK_NON_WHITESPACE_CHAR,
 	
 	TK_END,
 };
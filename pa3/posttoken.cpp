@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <climits>
 #include <cfloat>
+#include <cmath>
 #include <map>
 
 #include "token.h"
@@ -21,151 +22,251 @@
 
 using namespace std;
 
-// StringToETokenTypeMap map of `simple` `preprocessing-tokens` to ETokenType
-static const unordered_map<string, ETokenType> StringToTokenTypeMap =
+// Simple tokens are found through a perfect hash of their length and their
+// first, middle and last characters.  The multiplier was searched for so
+// that no two spellings share a slot, which is checked below.
+constexpr uint32_t SimpleTokenHashMultiplier = 0xa4a75a93;
+constexpr unsigned int SimpleTokenHashBits = 10;
+
+constexpr unsigned int simpleTokenHash(const char* s, size_t length)
+{
+    return (uint32_t)(((uint32_t)(unsigned char)s[0] |
+        (uint32_t)(unsigned char)s[length / 2] << 8 |
+        (uint32_t)(unsigned char)s[length - 1] << 16 |
+        (uint32_t)length << 24) * SimpleTokenHashMultiplier) >>
+        (32 - SimpleTokenHashBits);
+}
+
+// SimpleToken: spelling of a `simple` `preprocessing-token` and its ETokenType
+struct SimpleToken
+{
+    const char* spelling;
+    size_t length;
+    ETokenType type;
+    unsigned int hash;
+};
+
+#define SIMPLE_TOKEN(spelling, type) {spelling, sizeof(spelling) - 1, type, \
+    simpleTokenHash(spelling, sizeof(spelling) - 1)}
+
+// SimpleTokens: table of `simple` `preprocessing-tokens` and their ETokenType
+constexpr SimpleToken SimpleTokens[] =
 {
     // keywords
-    {"alignas", KW_ALIGNAS},
-    {"alignof", KW_ALIGNOF},
-    {"asm", KW_ASM},
-    {"auto", KW_AUTO},
-    {"bool", KW_BOOL},
-    {"break", KW_BREAK},
-    {"case", KW_CASE},
-    {"catch", KW_CATCH},
-    {"char", KW_CHAR},
-    {"char16_t", KW_CHAR16_T},
-    {"char32_t", KW_CHAR32_T},
-    {"class", KW_CLASS},
-    {"const", KW_CONST},
-    {"constexpr", KW_CONSTEXPR},
-    {"const_cast", KW_CONST_CAST},
-    {"continue", KW_CONTINUE},
-    {"decltype", KW_DECLTYPE},
-    {"default", KW_DEFAULT},
-    {"delete", KW_DELETE},
-    {"do", KW_DO},
-    {"double", KW_DOUBLE},
-    {"dynamic_cast", KW_DYNAMIC_CAST},
-    {"else", KW_ELSE},
-    {"enum", KW_ENUM},
-    {"explicit", KW_EXPLICIT},
-    {"export", KW_EXPORT},
-    {"extern", KW_EXTERN},
-    {"false", KW_FALSE},
-    {"float", KW_FLOAT},
-    {"for", KW_FOR},
-    {"friend", KW_FRIEND},
-    {"goto", KW_GOTO},
-    {"if", KW_IF},
-    {"inline", KW_INLINE},
-    {"int", KW_INT},
-    {"long", KW_LONG},
-    {"mutable", KW_MUTABLE},
-    {"namespace", KW_NAMESPACE},
-    {"new", KW_NEW},
-    {"noexcept", KW_NOEXCEPT},
-    {"nullptr", KW_NULLPTR},
-    {"operator", KW_OPERATOR},
-    {"private", KW_PRIVATE},
-    {"protected", KW_PROTECTED},
-    {"public", KW_PUBLIC},
-    {"register", KW_REGISTER},
-    {"reinterpret_cast", KW_REINTERPET_CAST},
-    {"return", KW_RETURN},
-    {"short", KW_SHORT},
-    {"signed", KW_SIGNED},
-    {"sizeof", KW_SIZEOF},
-    {"static", KW_STATIC},
-    {"static_assert", KW_STATIC_ASSERT},
-    {"static_cast", KW_STATIC_CAST},
-    {"struct", KW_STRUCT},
-    {"switch", KW_SWITCH},
-    {"template", KW_TEMPLATE},
-    {"this", KW_THIS},
-    {"thread_local", KW_THREAD_LOCAL},
-    {"throw", KW_THROW},
-    {"true", KW_TRUE},
-    {"try", KW_TRY},
-    {"typedef", KW_TYPEDEF},
-    {"typeid", KW_TYPEID},
-    {"typename", KW_TYPENAME},
-    {"union", KW_UNION},
-    {"unsigned", KW_UNSIGNED},
-    {"using", KW_USING},
-    {"virtual", KW_VIRTUAL},
-    {"void", KW_VOID},
-    {"volatile", KW_VOLATILE},
-    {"wchar_t", KW_WCHAR_T},
-    {"while", KW_WHILE},
+    SIMPLE_TOKEN("alignas", KW_ALIGNAS),
+    SIMPLE_TOKEN("alignof", KW_ALIGNOF),
+    SIMPLE_TOKEN("asm", KW_ASM),
+    SIMPLE_TOKEN("auto", KW_AUTO),
+    SIMPLE_TOKEN("bool", KW_BOOL),
+    SIMPLE_TOKEN("break", KW_BREAK),
+    SIMPLE_TOKEN("case", KW_CASE),
+    SIMPLE_TOKEN("catch", KW_CATCH),
+    SIMPLE_TOKEN("char", KW_CHAR),
+    SIMPLE_TOKEN("char16_t", KW_CHAR16_T),
+    SIMPLE_TOKEN("char32_t", KW_CHAR32_T),
+    SIMPLE_TOKEN("class", KW_CLASS),
+    SIMPLE_TOKEN("const", KW_CONST),
+    SIMPLE_TOKEN("constexpr", KW_CONSTEXPR),
+    SIMPLE_TOKEN("const_cast", KW_CONST_CAST),
+    SIMPLE_TOKEN("continue", KW_CONTINUE),
+    SIMPLE_TOKEN("decltype", KW_DECLTYPE),
+    SIMPLE_TOKEN("default", KW_DEFAULT),
+    SIMPLE_TOKEN("delete", KW_DELETE),
+    SIMPLE_TOKEN("do", KW_DO),
+    SIMPLE_TOKEN("double", KW_DOUBLE),
+    SIMPLE_TOKEN("dynamic_cast", KW_DYNAMIC_CAST),
+    SIMPLE_TOKEN("else", KW_ELSE),
+    SIMPLE_TOKEN("enum", KW_ENUM),
+    SIMPLE_TOKEN("explicit", KW_EXPLICIT),
+    SIMPLE_TOKEN("export", KW_EXPORT),
+    SIMPLE_TOKEN("extern", KW_EXTERN),
+    SIMPLE_TOKEN("false", KW_FALSE),
+    SIMPLE_TOKEN("float", KW_FLOAT),
+    SIMPLE_TOKEN("for", KW_FOR),
+    SIMPLE_TOKEN("friend", KW_FRIEND),
+    SIMPLE_TOKEN("goto", KW_GOTO),
+    SIMPLE_TOKEN("if", KW_IF),
+    SIMPLE_TOKEN("inline", KW_INLINE),
+    SIMPLE_TOKEN("int", KW_INT),
+    SIMPLE_TOKEN("long", KW_LONG),
+    SIMPLE_TOKEN("mutable", KW_MUTABLE),
+    SIMPLE_TOKEN("namespace", KW_NAMESPACE),
+    SIMPLE_TOKEN("new", KW_NEW),
+    SIMPLE_TOKEN("noexcept", KW_NOEXCEPT),
+    SIMPLE_TOKEN("nullptr", KW_NULLPTR),
+    SIMPLE_TOKEN("operator", KW_OPERATOR),
+    SIMPLE_TOKEN("private", KW_PRIVATE),
+    SIMPLE_TOKEN("protected", KW_PROTECTED),
+    SIMPLE_TOKEN("public", KW_PUBLIC),
+    SIMPLE_TOKEN("register", KW_REGISTER),
+    SIMPLE_TOKEN("reinterpret_cast", KW_REINTERPET_CAST),
+    SIMPLE_TOKEN("return", KW_RETURN),
+    SIMPLE_TOKEN("short", KW_SHORT),
+    SIMPLE_TOKEN("signed", KW_SIGNED),
+    SIMPLE_TOKEN("sizeof", KW_SIZEOF),
+    SIMPLE_TOKEN("static", KW_STATIC),
+    SIMPLE_TOKEN("static_assert", KW_STATIC_ASSERT),
+    SIMPLE_TOKEN("static_cast", KW_STATIC_CAST),
+    SIMPLE_TOKEN("struct", KW_STRUCT),
+    SIMPLE_TOKEN("switch", KW_SWITCH),
+    SIMPLE_TOKEN("template", KW_TEMPLATE),
+    SIMPLE_TOKEN("this", KW_THIS),
+    SIMPLE_TOKEN("thread_local", KW_THREAD_LOCAL),
+    SIMPLE_TOKEN("throw", KW_THROW),
+    SIMPLE_TOKEN("true", KW_TRUE),
+    SIMPLE_TOKEN("try", KW_TRY),
+    SIMPLE_TOKEN("typedef", KW_TYPEDEF),
+    SIMPLE_TOKEN("typeid", KW_TYPEID),
+    SIMPLE_TOKEN("typename", KW_TYPENAME),
+    SIMPLE_TOKEN("union", KW_UNION),
+    SIMPLE_TOKEN("unsigned", KW_UNSIGNED),
+    SIMPLE_TOKEN("using", KW_USING),
+    SIMPLE_TOKEN("virtual", KW_VIRTUAL),
+    SIMPLE_TOKEN("void", KW_VOID),
+    SIMPLE_TOKEN("volatile", KW_VOLATILE),
+    SIMPLE_TOKEN("wchar_t", KW_WCHAR_T),
+    SIMPLE_TOKEN("while", KW_WHILE),
 
     // operators/punctuation
-    {"{", OP_LBRACE},
-    {"<%", OP_LBRACE},
-    {"}", OP_RBRACE},
-    {"%>", OP_RBRACE},
-    {"[", OP_LSQUARE},
-    {"<:", OP_LSQUARE},
-    {"]", OP_RSQUARE},
-    {":>", OP_RSQUARE},
-    {"(", OP_LPAREN},
-    {")", OP_RPAREN},
-    {"|", OP_BOR},
-    {"bitor", OP_BOR},
-    {"^", OP_XOR},
-    {"xor", OP_XOR},
-    {"~", OP_COMPL},
-    {"compl", OP_COMPL},
-    {"&", OP_AMP},
-    {"bitand", OP_AMP},
-    {"!", OP_LNOT},
-    {"not", OP_LNOT},
-    {";", OP_SEMICOLON},
-    {":", OP_COLON},
-    {"...", OP_DOTS},
-    {"?", OP_QMARK},
-    {"::", OP_COLON2},
-    {".", OP_DOT},
-    {".*", OP_DOTSTAR},
-    {"+", OP_PLUS},
-    {"-", OP_MINUS},
-    {"*", OP_STAR},
-    {"/", OP_DIV},
-    {"%", OP_MOD},
-    {"=", OP_ASS},
-    {"<", OP_LT},
-    {">", OP_GT},
-    {"+=", OP_PLUSASS},
-    {"-=", OP_MINUSASS},
-    {"*=", OP_STARASS},
-    {"/=", OP_DIVASS},
-    {"%=", OP_MODASS},
-    {"^=", OP_XORASS},
-    {"xor_eq", OP_XORASS},
-    {"&=", OP_BANDASS},
-    {"and_eq", OP_BANDASS},
-    {"|=", OP_BORASS},
-    {"or_eq", OP_BORASS},
-    {"<<", OP_LSHIFT},
-    {">>", OP_RSHIFT},
-    {">>=", OP_RSHIFTASS},
-    {"<<=", OP_LSHIFTASS},
-    {"==", OP_EQ},
-    {"!=", OP_NE},
-    {"not_eq", OP_NE},
-    {"<=", OP_LE},
-    {">=", OP_GE},
-    {"&&", OP_LAND},
-    {"and", OP_LAND},
-    {"||", OP_LOR},
-    {"or", OP_LOR},
-    {"++", OP_INC},
-    {"--", OP_DEC},
-    {",", OP_COMMA},
-    {"->*", OP_ARROWSTAR},
-    {"->", OP_ARROW}
+    SIMPLE_TOKEN("{", OP_LBRACE),
+    SIMPLE_TOKEN("<%", OP_LBRACE),
+    SIMPLE_TOKEN("}", OP_RBRACE),
+    SIMPLE_TOKEN("%>", OP_RBRACE),
+    SIMPLE_TOKEN("[", OP_LSQUARE),
+    SIMPLE_TOKEN("<:", OP_LSQUARE),
+    SIMPLE_TOKEN("]", OP_RSQUARE),
+    SIMPLE_TOKEN(":>", OP_RSQUARE),
+    SIMPLE_TOKEN("(", OP_LPAREN),
+    SIMPLE_TOKEN(")", OP_RPAREN),
+    SIMPLE_TOKEN("|", OP_BOR),
+    SIMPLE_TOKEN("bitor", OP_BOR),
+    SIMPLE_TOKEN("^", OP_XOR),
+    SIMPLE_TOKEN("xor", OP_XOR),
+    SIMPLE_TOKEN("~", OP_COMPL),
+    SIMPLE_TOKEN("compl", OP_COMPL),
+    SIMPLE_TOKEN("&", OP_AMP),
+    SIMPLE_TOKEN("bitand", OP_AMP),
+    SIMPLE_TOKEN("!", OP_LNOT),
+    SIMPLE_TOKEN("not", OP_LNOT),
+    SIMPLE_TOKEN(";", OP_SEMICOLON),
+    SIMPLE_TOKEN(":", OP_COLON),
+    SIMPLE_TOKEN("...", OP_DOTS),
+    SIMPLE_TOKEN("?", OP_QMARK),
+    SIMPLE_TOKEN("::", OP_COLON2),
+    SIMPLE_TOKEN(".", OP_DOT),
+    SIMPLE_TOKEN(".*", OP_DOTSTAR),
+    SIMPLE_TOKEN("+", OP_PLUS),
+    SIMPLE_TOKEN("-", OP_MINUS),
+    SIMPLE_TOKEN("*", OP_STAR),
+    SIMPLE_TOKEN("/", OP_DIV),
+    SIMPLE_TOKEN("%", OP_MOD),
+    SIMPLE_TOKEN("=", OP_ASS),
+    SIMPLE_TOKEN("<", OP_LT),
+    SIMPLE_TOKEN(">", OP_GT),
+    SIMPLE_TOKEN("+=", OP_PLUSASS),
+    SIMPLE_TOKEN("-=", OP_MINUSASS),
+    SIMPLE_TOKEN("*=", OP_STARASS),
+    SIMPLE_TOKEN("/=", OP_DIVASS),
+    SIMPLE_TOKEN("%=", OP_MODASS),
+    SIMPLE_TOKEN("^=", OP_XORASS),
+    SIMPLE_TOKEN("xor_eq", OP_XORASS),
+    SIMPLE_TOKEN("&=", OP_BANDASS),
+    SIMPLE_TOKEN("and_eq", OP_BANDASS),
+    SIMPLE_TOKEN("|=", OP_BORASS),
+    SIMPLE_TOKEN("or_eq", OP_BORASS),
+    SIMPLE_TOKEN("<<", OP_LSHIFT),
+    SIMPLE_TOKEN(">>", OP_RSHIFT),
+    SIMPLE_TOKEN(">>=", OP_RSHIFTASS),
+    SIMPLE_TOKEN("<<=", OP_LSHIFTASS),
+    SIMPLE_TOKEN("==", OP_EQ),
+    SIMPLE_TOKEN("!=", OP_NE),
+    SIMPLE_TOKEN("not_eq", OP_NE),
+    SIMPLE_TOKEN("<=", OP_LE),
+    SIMPLE_TOKEN(">=", OP_GE),
+    SIMPLE_TOKEN("&&", OP_LAND),
+    SIMPLE_TOKEN("and", OP_LAND),
+    SIMPLE_TOKEN("||", OP_LOR),
+    SIMPLE_TOKEN("or", OP_LOR),
+    SIMPLE_TOKEN("++", OP_INC),
+    SIMPLE_TOKEN("--", OP_DEC),
+    SIMPLE_TOKEN(",", OP_COMMA),
+    SIMPLE_TOKEN("->*", OP_ARROWSTAR),
+    SIMPLE_TOKEN("->", OP_ARROW)
 };
 
+constexpr size_t NumSimpleTokens =
+    sizeof(SimpleTokens) / sizeof(SimpleTokens[0]);
+
+// Length of the longest `simple` `preprocessing-token`
+constexpr size_t maxSimpleTokenLength(size_t i = 0, size_t longest = 0)
+{
+    return i == NumSimpleTokens ? longest : maxSimpleTokenLength(i + 1,
+        SimpleTokens[i].length > longest ? SimpleTokens[i].length : longest);
+}
+
+constexpr size_t MaxSimpleTokenLength = maxSimpleTokenLength();
+
+// Index of the first simple token that hashes to slot, or NumSimpleTokens
+constexpr size_t simpleTokenInSlot(unsigned int slot, size_t i = 0)
+{
+    return i == NumSimpleTokens || SimpleTokens[i].hash == slot ? i :
+        simpleTokenInSlot(slot, i + 1);
+}
+
+// Check that every simple token is the first one in its slot
+constexpr bool simpleTokenHashIsPerfect(size_t i = 0)
+{
+    return i == NumSimpleTokens ||
+        (simpleTokenInSlot(SimpleTokens[i].hash) == i &&
+        simpleTokenHashIsPerfect(i + 1));
+}
+
+static_assert(simpleTokenHashIsPerfect(),
+    "simple tokens collide, search for another SimpleTokenHashMultiplier");
+static_assert(NumSimpleTokens < 256, "too many simple tokens for the slots");
+
+#define SIMPLE_SLOTS_4(n) \
+    simpleTokenInSlot(n), simpleTokenInSlot(n + 1), \
+    simpleTokenInSlot(n + 2), simpleTokenInSlot(n + 3)
+#define SIMPLE_SLOTS_16(n) \
+    SIMPLE_SLOTS_4(n), SIMPLE_SLOTS_4(n + 4), \
+    SIMPLE_SLOTS_4(n + 8), SIMPLE_SLOTS_4(n + 12)
+#define SIMPLE_SLOTS_64(n) \
+    SIMPLE_SLOTS_16(n), SIMPLE_SLOTS_16(n + 16), \
+    SIMPLE_SLOTS_16(n + 32), SIMPLE_SLOTS_16(n + 48)
+#define SIMPLE_SLOTS_256(n) \
+    SIMPLE_SLOTS_64(n), SIMPLE_SLOTS_64(n + 64), \
+    SIMPLE_SLOTS_64(n + 128), SIMPLE_SLOTS_64(n + 192)
+
+// SimpleTokenSlots: index into SimpleTokens for every hash value
+constexpr unsigned char SimpleTokenSlots[1 << SimpleTokenHashBits] =
+{
+    SIMPLE_SLOTS_256(0), SIMPLE_SLOTS_256(256),
+    SIMPLE_SLOTS_256(512), SIMPLE_SLOTS_256(768)
+};
+
+// SimpleTokenType: look up the ETokenType of a `simple` `preprocessing-token`,
+// returns false if data isn't one
+static bool SimpleTokenType(const string& data, ETokenType& type)
+{
+    size_t length = data.length();
+
+    if (length == 0 || length > MaxSimpleTokenLength)
+        return false;
+
+    unsigned int slot = SimpleTokenSlots[simpleTokenHash(data.data(), length)];
+    if (slot == NumSimpleTokens)
+        return false;
+
+    const SimpleToken& token = SimpleTokens[slot];
+    if (token.length != length ||
+            memcmp(token.spelling, data.data(), length) != 0)
+        return false;
+
+    type = token.type;
+    return true;
+}
+
 // convert EFundamentalType to a source code
 static const map<EFundamentalType, string> FundamentalTypeToStringMap
 {
@@ -382,8 +483,10 @@ void TokenStream::emit_identifier(const string& data)
 
     // If the identifier is in the token type map then emit it as a simple
     // token, otherwise it's an identifier
-    if (StringToTokenTypeMap.find(data) != StringToTokenTypeMap.end())
-        mOutput.emit_simple(data, StringToTokenTypeMap.at(data));
+    ETokenType type;
+
+    if (SimpleTokenType(data, type))
+        mOutput.emit_simple(data, type);
     else
         mOutput.emit_identifier(data);
 }
@@ -763,6 +866,14 @@ void TokenStream::processOctal(const string& data)
         return;
     }
 
+    // A leading zero makes this octal, so an 8 or 9 can't start a suffix
+    if (index < data.length() && (data[index] == '8' || data[index] == '9'))
+    {
+        mOutput.emit_invalid(data);
+        printError("invalid digit in octal literal: ", data);
+        return;
+    }
+
     // Get any suffix
     suffix = data.substr(index);
 
@@ -832,32 +943,6 @@ void TokenStream::emit_pp_number(const string& data)
         return;
     }
 
-    // For this to be an octal number it must start with a zero and be
-    // followed by octal digits
-    if (data.length() >= 1 && data[0] == '0')
-    {
-        bool valid = true;
-
-        for (char c : data)
-        {
-            // This is still a valid octal if it has a suffix
-            if (c == '_' || c == 'l' || c == 'L' || c == 'u' || c == 'U')
-                break;
-
-            if (c < '0' || c > '7')
-            {
-                valid = false;
-                break;
-            }
-        }
-
-        if (valid)
-        {
-            processOctal(data);
-            return;
-        }
-    }
-
     // Check if this is a float with an exponent
     string::size_type underscore = data.find("_");
     if (underscore != string::npos)
@@ -883,8 +968,11 @@ void TokenStream::emit_pp_number(const string& data)
         return;
     }
 
-    // Try processing as a decimal
-    processDecimal(data);
+    // A leading zero makes this octal so an 8 or 9 makes it invalid
+    if (data[0] == '0')
+        processOctal(data);
+    else
+        processDecimal(data);
 }
 
 bool TokenStream::processCharLiteral(const string& data, EFundamentalType *type,
@@ -1403,14 +1491,16 @@ void TokenStream::emit_user_defined_string_literal(const string& data)
 
 void TokenStream::emit_preprocessing_op_or_punc(const string& data)
 {
+    ETokenType type;
+
     processStringLiterals();
 
     // At this point preprocessing identifiers are invalid
     if (data == "#" || data == "##" || data == "%:" || data == "%:%:")
         mOutput.emit_invalid(data);
     // Check if this is a simple token
-    else if (StringToTokenTypeMap.find(data) != StringToTokenTypeMap.end())
-        mOutput.emit_simple(data, StringToTokenTypeMap.at(data));
+    else if (SimpleTokenType(data, type))
+        mOutput.emit_simple(data, type);
     else
     {
         mOutput.emit_invalid(data);
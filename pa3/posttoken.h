@@ -8,11 +8,12 @@
 #include <string>
 
 #include "token.h"
+#include "IPPTokenStream.h"
 #include "IPostTokenStream.h"
 
 using namespace std;
 
-class TokenStream : public IPostTokenStream
+class TokenStream : public IPPTokenStream
 {
 public:
     TokenStream(IPostTokenStream& output);